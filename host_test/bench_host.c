@@ -0,0 +1,189 @@
+/**
+ * @file bench_host.c
+ * @brief Host versions of the led_bench numbers, for profiling without a board
+ *
+ * Prints the same BENCH {json} lines as led_bench.c, with nanoseconds on
+ * this machine instead of target cycles. Only useful relative to itself:
+ * run it before and after a change, or under perf record / valgrind
+ * --tool=callgrind to see where an effect or the encoder spends its time.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_err.h"
+#include "led_color.h"
+#include "led_effects.h"
+#include "led_framebuffer.h"
+#include "led_mock_rmt.h"
+#include "led_strip_encoder.h"
+
+#define BENCH_COLOR_PIXELS  1000     // Pixels converted per color round
+#define BENCH_EFFECT_PIXELS 300      // Strip length the effects are rendered for
+#define BENCH_RESOLUTION_HZ 10000000 // Same as the demo
+
+static const size_t s_bench_lengths[] = { 1, 60, 300, 1000 };
+static int s_rounds = 100;
+
+static uint16_t s_bench_hues[BENCH_COLOR_PIXELS];
+static uint8_t s_bench_grb[BENCH_COLOR_PIXELS * 3];
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/**
+ * @brief Nanoseconds per pixel of both HSV converters, best of s_rounds
+ */
+static void bench_color(void)
+{
+    for (size_t i = 0; i < BENCH_COLOR_PIXELS; i++) {
+        s_bench_hues[i] = (i * 7) % 360;
+    }
+    uint64_t best_single = UINT64_MAX;
+    uint64_t best_span = UINT64_MAX;
+    for (int round = 0; round < s_rounds; round++) {
+        uint64_t start = bench_now_ns();
+        for (size_t i = 0; i < BENCH_COLOR_PIXELS; i++) {
+            led_color_hsv_to_grb(s_bench_hues[i], 100, 100, &s_bench_grb[i * 3]);
+        }
+        uint64_t single = bench_now_ns() - start;
+
+        start = bench_now_ns();
+        led_color_hsv_span_to_grb(s_bench_hues, BENCH_COLOR_PIXELS, 100, 100, s_bench_grb);
+        uint64_t span = bench_now_ns() - start;
+
+        best_single = single < best_single ? single : best_single;
+        best_span = span < best_span ? span : best_span;
+    }
+    printf("BENCH {\"name\": \"hsv_to_grb\", \"ns_per_pixel\": %.2f}\n", (double)best_single / BENCH_COLOR_PIXELS);
+    printf("BENCH {\"name\": \"hsv_span_to_grb\", \"ns_per_pixel\": %.2f}\n", (double)best_span / BENCH_COLOR_PIXELS);
+}
+
+/**
+ * @brief Render time of every registered effect, frames 60 fps apart
+ */
+static void bench_effects(void)
+{
+    led_effect_engine_t engine;
+    led_framebuffer_t frame;
+    ESP_ERROR_CHECK(led_effect_engine_init(&engine, BENCH_EFFECT_PIXELS, LED_COLOR_ORDER_GRB));
+    ESP_ERROR_CHECK(led_framebuffer_init(&frame, BENCH_EFFECT_PIXELS));
+    for (size_t e = 0; e < led_effects_count(); e++) {
+        ESP_ERROR_CHECK(led_effect_engine_select(&engine, e));
+        uint64_t total = 0;
+        uint64_t best = UINT64_MAX;
+        for (int f = 0; f < s_rounds; f++) {
+            led_scheduler_frame_t info = { .frame = f, .time_us = (int64_t)f * 16667 };
+            uint64_t start = bench_now_ns();
+            led_effect_engine_render(&engine, &frame, &info);
+            uint64_t elapsed = bench_now_ns() - start;
+            total += elapsed;
+            best = elapsed < best ? elapsed : best;
+        }
+        printf("BENCH {\"name\": \"effect\", \"effect\": \"%s\", \"pixels\": %u, \"ns_per_pixel\": %.2f, "
+               "\"best_ns_per_pixel\": %.2f}\n", led_effects_get(e)->name, BENCH_EFFECT_PIXELS,
+               (double)total / ((double)s_rounds * BENCH_EFFECT_PIXELS), (double)best / BENCH_EFFECT_PIXELS);
+    }
+    led_framebuffer_deinit(&frame);
+    led_effect_engine_deinit(&engine);
+}
+
+/**
+ * @brief Encode s_rounds frames through the mock channel and report what each cost
+ *
+ * The strip encoder's own counters give the time in the refill callback,
+ * the channel's the whole encode calls; with_cache sends precomputed
+ * symbols through the copy encoder instead, like a symbol cache hit.
+ */
+static esp_err_t bench_frames(size_t pixel_count, bool with_dma, bool with_cache)
+{
+    led_strip_encoder_config_t encoder_config = {
+        .resolution = BENCH_RESOLUTION_HZ,
+        .chip = LED_STRIP_CHIP_WS2812,
+    };
+    led_mock_rmt_config_t channel_config = {
+        .resolution_hz = BENCH_RESOLUTION_HZ,
+        // the demo's non-DMA block, or one fill the size of a DMA buffer
+        .mem_block_symbols = with_dma ? 1024 : 64,
+    };
+    rmt_encoder_handle_t encoder;
+    rmt_channel_handle_t channel;
+    uint8_t *pixels = malloc(pixel_count * 3);
+    rmt_symbol_word_t *symbols = malloc(LED_STRIP_FRAME_SYMBOLS(pixel_count, 3) * sizeof(rmt_symbol_word_t));
+    if (!pixels || !symbols) {
+        free(pixels);
+        free(symbols);
+        return ESP_ERR_NO_MEM;
+    }
+    for (size_t i = 0; i < pixel_count * 3; i++) {
+        pixels[i] = i * 37;
+    }
+    size_t symbol_count;
+    ESP_ERROR_CHECK(led_strip_encode_symbols(&encoder_config, pixels, pixel_count, symbols, &symbol_count));
+    if (with_cache) {
+        rmt_copy_encoder_config_t copy_config = {};
+        ESP_ERROR_CHECK(rmt_new_copy_encoder(&copy_config, &encoder));
+    } else {
+        ESP_ERROR_CHECK(rmt_new_led_strip_encoder(&encoder_config, &encoder));
+    }
+    ESP_ERROR_CHECK(led_mock_rmt_new_channel(&channel_config, &channel));
+
+    const void *data = with_cache ? (const void *)symbols : pixels;
+    size_t data_size = with_cache ? symbol_count * sizeof(rmt_symbol_word_t) : pixel_count * 3;
+    // warm up, then measure from clean counters
+    ESP_ERROR_CHECK(led_mock_rmt_transmit(channel, encoder, data, data_size));
+    led_mock_rmt_clear(channel);
+    uint32_t cycles_start = 0, calls_start = 0, cycles_end = 0, calls_end = 0;
+    if (!with_cache) {
+        rmt_led_strip_encoder_get_stats(encoder, &cycles_start, &calls_start);
+    }
+    for (int frame = 0; frame < s_rounds; frame++) {
+        ESP_ERROR_CHECK(led_mock_rmt_transmit(channel, encoder, data, data_size));
+    }
+    if (!with_cache) {
+        rmt_led_strip_encoder_get_stats(encoder, &cycles_end, &calls_end);
+    }
+    led_mock_rmt_stats_t stats;
+    led_mock_rmt_get_stats(channel, &stats);
+    // the host "cycle count" is nanoseconds, see shim/esp_cpu.h
+    printf("BENCH {\"name\": \"frame\", \"pixels\": %u, \"dma\": %s, \"cached\": %s, \"wire_us\": %" PRIu64
+           ", \"encode_ns_per_pixel\": %.2f, \"callback_ns_per_pixel\": %.2f, \"max_fill_ns\": %" PRIu64
+           ", \"refills_per_frame\": %.2f}\n",
+           (unsigned)pixel_count, with_dma ? "true" : "false", with_cache ? "true" : "false",
+           stats.wire_ns / stats.transmissions / 1000,
+           (double)stats.encode_ns / ((double)pixel_count * s_rounds),
+           (double)(cycles_end - cycles_start) / ((double)pixel_count * s_rounds), stats.max_fill_ns,
+           (double)stats.fills / s_rounds);
+
+    led_mock_rmt_del_channel(channel);
+    rmt_del_encoder(encoder);
+    free(symbols);
+    free(pixels);
+    return ESP_OK;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) {
+        s_rounds = atoi(argv[1]);
+        if (s_rounds < 1) {
+            fprintf(stderr, "usage: %s [rounds]\n", argv[0]);
+            return 2;
+        }
+    }
+    bench_color();
+    bench_effects();
+    for (size_t i = 0; i < sizeof(s_bench_lengths) / sizeof(s_bench_lengths[0]); i++) {
+        ESP_ERROR_CHECK(bench_frames(s_bench_lengths[i], false, false));
+        ESP_ERROR_CHECK(bench_frames(s_bench_lengths[i], true, false));
+        ESP_ERROR_CHECK(bench_frames(s_bench_lengths[i], false, true));
+    }
+    printf("BENCH_DONE\n");
+    return 0;
+}
@@ -0,0 +1,70 @@
+/**
+ * @file rmt_encoder.h
+ * @brief RMT encoder interface for the host build
+ *
+ * Same interface as the IDF driver, so encoders written against it build
+ * unchanged. The simple and copy encoders are implemented by the mock
+ * channel in led_mock_rmt.c.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "driver/rmt_types.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief How far an encode call got
+ */
+typedef enum {
+    RMT_ENCODING_RESET = 0,         /*!< Nothing encoded yet */
+    RMT_ENCODING_COMPLETE = (1 << 0), /*!< All data is in channel memory */
+    RMT_ENCODING_MEM_FULL = (1 << 1), /*!< Channel memory is full, call again after a refill */
+} rmt_encode_state_t;
+
+typedef struct rmt_encoder_t rmt_encoder_t;
+
+/**
+ * @brief Encoder interface
+ */
+struct rmt_encoder_t {
+    size_t (*encode)(rmt_encoder_t *encoder, rmt_channel_handle_t tx_channel, const void *primary_data,
+                     size_t data_size, rmt_encode_state_t *ret_state); /*!< Encode into channel memory, returns symbols written */
+    esp_err_t (*reset)(rmt_encoder_t *encoder); /*!< Start over with the next transmission */
+    esp_err_t (*del)(rmt_encoder_t *encoder);   /*!< Free the encoder */
+};
+
+/**
+ * @brief Copy encoder configuration, the data is already symbols
+ */
+typedef struct {
+} rmt_copy_encoder_config_t;
+
+/**
+ * @brief Simple encoder callback, see the IDF documentation
+ */
+typedef size_t (*rmt_encode_simple_cb_t)(const void *data, size_t data_size, size_t symbols_written,
+                                         size_t symbols_free, rmt_symbol_word_t *symbols, bool *done, void *arg);
+
+/**
+ * @brief Simple encoder configuration
+ */
+typedef struct {
+    rmt_encode_simple_cb_t callback; /*!< Called with the free channel memory */
+    void *arg;                  /*!< Passed to callback */
+    size_t min_chunk_size;      /*!< Smallest free space the callback always makes progress with */
+} rmt_simple_encoder_config_t;
+
+esp_err_t rmt_new_copy_encoder(const rmt_copy_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder);
+esp_err_t rmt_new_simple_encoder(const rmt_simple_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder);
+esp_err_t rmt_del_encoder(rmt_encoder_handle_t encoder);
+esp_err_t rmt_encoder_reset(rmt_encoder_handle_t encoder);
+
+#ifdef __cplusplus
+}
+#endif
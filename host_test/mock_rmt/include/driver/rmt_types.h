@@ -0,0 +1,34 @@
+/**
+ * @file rmt_types.h
+ * @brief RMT types for the host build, layout identical to the IDF ones
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct rmt_channel_t *rmt_channel_handle_t;     /*!< A mock channel, see led_mock_rmt.h */
+typedef struct rmt_encoder_t *rmt_encoder_handle_t;
+
+/**
+ * @brief One RMT symbol, two level/duration pairs
+ */
+typedef union {
+    struct {
+        uint16_t duration0 : 15; /*!< Duration of level0, in ticks */
+        uint16_t level0 : 1;     /*!< Level of the first part */
+        uint16_t duration1 : 15; /*!< Duration of level1, in ticks */
+        uint16_t level1 : 1;     /*!< Level of the second part */
+    };
+    uint32_t val;               /*!< Equivalent unsigned value */
+} rmt_symbol_word_t;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,97 @@
+/**
+ * @file led_mock_rmt.h
+ * @brief Recording stand-in for an RMT TX channel, for the host build
+ *
+ * A mock channel drives an encoder the way the TX driver does: the first
+ * fill gets the whole channel memory, then every time the encoder reports
+ * RMT_ENCODING_MEM_FULL the "hardware" plays half of it and the encoder
+ * is called again with that half, ping-pong style, until it reports
+ * RMT_ENCODING_COMPLETE. Everything the encoder writes is appended to a
+ * capture, in wire order, and the durations are summed into wire time.
+ *
+ * So an encoder that runs out of room in the middle of a byte, gets its
+ * refill bookkeeping wrong or doesn't latch the frame shows up as a wrong
+ * symbol stream here, without a strip or a logic analyzer. Nothing is
+ * timed against real hardware: the encoder is called back to back, the
+ * fill times only say how the host build compares to itself.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "driver/rmt_encoder.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LED_MOCK_RMT_MEM_BLOCK_SYMBOLS 48 /*!< One ESP32-S3 TX memory block */
+
+/**
+ * @brief Mock channel configuration
+ */
+typedef struct {
+    uint32_t resolution_hz;     /*!< Tick rate, only used to turn ticks into wire time */
+    size_t mem_block_symbols;   /*!< Channel memory, even, 0 for LED_MOCK_RMT_MEM_BLOCK_SYMBOLS */
+    bool capture;               /*!< Record the symbols, off to time encoders without the copy */
+} led_mock_rmt_config_t;
+
+/**
+ * @brief What went through a channel since it was created or last cleared
+ */
+typedef struct {
+    uint32_t transmissions;     /*!< Completed led_mock_rmt_transmit() calls */
+    size_t symbols;             /*!< Symbols written by the encoder, captured or not */
+    uint32_t fills;             /*!< Encoder calls, one initial fill per transmission plus the refills */
+    uint64_t wire_ns;           /*!< Time the symbols take on the wire */
+    uint64_t encode_ns;         /*!< Host time spent in the encoder */
+    uint64_t max_fill_ns;       /*!< Longest single encoder call */
+} led_mock_rmt_stats_t;
+
+/**
+ * @brief Create a mock channel
+ *
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NO_MEM out of memory
+ *      - ESP_OK if the channel is ready
+ */
+esp_err_t led_mock_rmt_new_channel(const led_mock_rmt_config_t *config, rmt_channel_handle_t *ret_channel);
+
+/**
+ * @brief Free a mock channel and its capture
+ */
+esp_err_t led_mock_rmt_del_channel(rmt_channel_handle_t channel);
+
+/**
+ * @brief Run one transmission to completion, like rmt_transmit() followed by waiting for it
+ *
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NO_MEM out of memory for the capture
+ *      - ESP_FAIL the encoder stopped making progress
+ *      - ESP_OK if the encoder completed
+ */
+esp_err_t led_mock_rmt_transmit(rmt_channel_handle_t channel, rmt_encoder_handle_t encoder, const void *data,
+                                size_t data_size);
+
+/**
+ * @brief Symbols captured so far, valid until the next transmit or clear
+ */
+const rmt_symbol_word_t *led_mock_rmt_capture(rmt_channel_handle_t channel, size_t *ret_count);
+
+/**
+ * @brief Totals since the channel was created or last cleared
+ */
+void led_mock_rmt_get_stats(rmt_channel_handle_t channel, led_mock_rmt_stats_t *ret_stats);
+
+/**
+ * @brief Drop the capture and zero the totals
+ */
+void led_mock_rmt_clear(rmt_channel_handle_t channel);
+
+#ifdef __cplusplus
+}
+#endif
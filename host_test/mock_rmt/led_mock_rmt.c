@@ -0,0 +1,357 @@
+/**
+ * @file led_mock_rmt.c
+ * @brief Mock RMT channel and the simple and copy encoders that write into it
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_attr.h"
+#include "esp_check.h"
+#include "led_mock_rmt.h"
+
+static const char *TAG = "led_mock_rmt";
+
+#define LED_MOCK_RMT_MAX_FILLS 1000000 // per transmission, anything beyond is an encoder that never finishes
+
+struct rmt_channel_t {
+    uint32_t resolution_hz;
+    bool capture;
+    size_t mem_symbols;         // channel memory, a ring
+    rmt_symbol_word_t *mem;
+    size_t write_pos;           // next symbol the encoder writes
+    size_t mem_free;            // symbols the hardware has played and the encoder may overwrite
+    rmt_symbol_word_t *captured;
+    size_t captured_count;
+    size_t captured_capacity;
+    bool capture_failed;        // ran out of memory growing the capture
+    uint64_t ticks;
+    led_mock_rmt_stats_t stats;
+};
+
+typedef struct {
+    rmt_encoder_t base;
+    rmt_encode_simple_cb_t callback;
+    void *arg;
+    size_t min_chunk_size;
+    size_t symbols_written;     // what the callback produced for this transmission, passed back to it
+    bool done;                  // the callback said so, whatever is left in ovf still has to go out
+    rmt_symbol_word_t *ovf;     // min_chunk_size symbols for when the free space is smaller than that
+    size_t ovf_count;
+    size_t ovf_pos;
+} led_mock_rmt_simple_encoder_t;
+
+typedef struct {
+    rmt_encoder_t base;
+    size_t pos;                 // symbols of the data already copied
+} led_mock_rmt_copy_encoder_t;
+
+static uint64_t led_mock_rmt_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/**
+ * @brief Contiguous free channel memory, what an encoder may write next
+ */
+static size_t led_mock_rmt_space(rmt_channel_handle_t channel, rmt_symbol_word_t **ret_symbols)
+{
+    size_t to_end = channel->mem_symbols - channel->write_pos;
+    *ret_symbols = &channel->mem[channel->write_pos];
+    return channel->mem_free < to_end ? channel->mem_free : to_end;
+}
+
+/**
+ * @brief The encoder wrote count symbols at the write position, record them
+ */
+static void led_mock_rmt_commit(rmt_channel_handle_t channel, size_t count)
+{
+    const rmt_symbol_word_t *symbols = &channel->mem[channel->write_pos];
+    for (size_t i = 0; i < count; i++) {
+        channel->ticks += symbols[i].duration0 + symbols[i].duration1;
+    }
+    if (channel->capture && !channel->capture_failed) {
+        if (channel->captured_count + count > channel->captured_capacity) {
+            size_t capacity = channel->captured_capacity ? channel->captured_capacity * 2 : 1024;
+            while (capacity < channel->captured_count + count) {
+                capacity *= 2;
+            }
+            rmt_symbol_word_t *captured = realloc(channel->captured, capacity * sizeof(rmt_symbol_word_t));
+            if (!captured) {
+                channel->capture_failed = true;
+                return;
+            }
+            channel->captured = captured;
+            channel->captured_capacity = capacity;
+        }
+        memcpy(&channel->captured[channel->captured_count], symbols, count * sizeof(rmt_symbol_word_t));
+        channel->captured_count += count;
+    }
+    channel->stats.symbols += count;
+    channel->mem_free -= count;
+    channel->write_pos = (channel->write_pos + count) % channel->mem_symbols;
+}
+
+esp_err_t led_mock_rmt_new_channel(const led_mock_rmt_config_t *config, rmt_channel_handle_t *ret_channel)
+{
+    ESP_RETURN_ON_FALSE(config && ret_channel && config->resolution_hz, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    size_t mem_symbols = config->mem_block_symbols ? config->mem_block_symbols : LED_MOCK_RMT_MEM_BLOCK_SYMBOLS;
+    ESP_RETURN_ON_FALSE(mem_symbols >= 2 && !(mem_symbols & 1), ESP_ERR_INVALID_ARG, TAG,
+                        "channel memory must be even, got %u", (unsigned)mem_symbols);
+    rmt_channel_handle_t channel = calloc(1, sizeof(*channel));
+    ESP_RETURN_ON_FALSE(channel, ESP_ERR_NO_MEM, TAG, "no mem for channel");
+    channel->mem = calloc(mem_symbols, sizeof(rmt_symbol_word_t));
+    if (!channel->mem) {
+        free(channel);
+        return ESP_ERR_NO_MEM;
+    }
+    channel->resolution_hz = config->resolution_hz;
+    channel->capture = config->capture;
+    channel->mem_symbols = mem_symbols;
+    *ret_channel = channel;
+    return ESP_OK;
+}
+
+esp_err_t led_mock_rmt_del_channel(rmt_channel_handle_t channel)
+{
+    ESP_RETURN_ON_FALSE(channel, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    free(channel->captured);
+    free(channel->mem);
+    free(channel);
+    return ESP_OK;
+}
+
+esp_err_t led_mock_rmt_transmit(rmt_channel_handle_t channel, rmt_encoder_handle_t encoder, const void *data,
+                                size_t data_size)
+{
+    ESP_RETURN_ON_FALSE(channel && encoder && data, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    // the whole memory for the first fill, as the driver does before starting the channel
+    channel->write_pos = 0;
+    channel->mem_free = channel->mem_symbols;
+    for (uint32_t fills = 0; fills < LED_MOCK_RMT_MAX_FILLS; fills++) {
+        size_t free_before = channel->mem_free;
+        rmt_encode_state_t state = RMT_ENCODING_RESET;
+        uint64_t start = led_mock_rmt_now_ns();
+        encoder->encode(encoder, channel, data, data_size, &state);
+        uint64_t elapsed = led_mock_rmt_now_ns() - start;
+        channel->stats.fills++;
+        channel->stats.encode_ns += elapsed;
+        if (elapsed > channel->stats.max_fill_ns) {
+            channel->stats.max_fill_ns = elapsed;
+        }
+        ESP_RETURN_ON_FALSE(!channel->capture_failed, ESP_ERR_NO_MEM, TAG, "no mem for the capture");
+        if (state & RMT_ENCODING_COMPLETE) {
+            channel->stats.transmissions++;
+            return ESP_OK;
+        }
+        ESP_RETURN_ON_FALSE((state & RMT_ENCODING_MEM_FULL) && channel->mem_free < free_before, ESP_FAIL, TAG,
+                            "encoder made no progress with %u symbols free", (unsigned)free_before);
+        // the hardware plays the half that was filled first, the threshold interrupt hands it back
+        size_t played = channel->mem_symbols / 2;
+        channel->mem_free = channel->mem_free + played < channel->mem_symbols ? channel->mem_free + played
+                            : channel->mem_symbols;
+    }
+    ESP_LOGE(TAG, "encoder still not done after %d fills", LED_MOCK_RMT_MAX_FILLS);
+    return ESP_FAIL;
+}
+
+const rmt_symbol_word_t *led_mock_rmt_capture(rmt_channel_handle_t channel, size_t *ret_count)
+{
+    *ret_count = channel->captured_count;
+    return channel->captured;
+}
+
+void led_mock_rmt_get_stats(rmt_channel_handle_t channel, led_mock_rmt_stats_t *ret_stats)
+{
+    *ret_stats = channel->stats;
+    ret_stats->wire_ns = channel->ticks * 1000000000u / channel->resolution_hz;
+}
+
+void led_mock_rmt_clear(rmt_channel_handle_t channel)
+{
+    channel->captured_count = 0;
+    channel->capture_failed = false;
+    channel->ticks = 0;
+    memset(&channel->stats, 0, sizeof(channel->stats));
+}
+
+/**
+ * @brief Move what is left in the overflow buffer into channel memory
+ *
+ * @return true if it is empty now
+ */
+static bool led_mock_rmt_flush_ovf(led_mock_rmt_simple_encoder_t *simple, rmt_channel_handle_t channel)
+{
+    while (simple->ovf_pos < simple->ovf_count) {
+        rmt_symbol_word_t *mem;
+        size_t space = led_mock_rmt_space(channel, &mem);
+        if (!space) {
+            return false;
+        }
+        size_t count = simple->ovf_count - simple->ovf_pos;
+        count = count < space ? count : space;
+        memcpy(mem, &simple->ovf[simple->ovf_pos], count * sizeof(rmt_symbol_word_t));
+        led_mock_rmt_commit(channel, count);
+        simple->ovf_pos += count;
+    }
+    return true;
+}
+
+/**
+ * @brief Same contract as the IDF simple encoder
+ *
+ * The callback gets the free channel memory, or a min_chunk_size overflow
+ * buffer when less than that is free, which is then drained into channel
+ * memory over as many fills as it takes.
+ */
+static size_t led_mock_rmt_simple_encode(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *data,
+                                         size_t data_size, rmt_encode_state_t *ret_state)
+{
+    led_mock_rmt_simple_encoder_t *simple = __containerof(encoder, led_mock_rmt_simple_encoder_t, base);
+    size_t free_before = channel->mem_free;
+    rmt_encode_state_t state = RMT_ENCODING_RESET;
+    while (1) {
+        if (!led_mock_rmt_flush_ovf(simple, channel)) {
+            state = RMT_ENCODING_MEM_FULL;
+            break;
+        }
+        if (simple->done) {
+            state = RMT_ENCODING_COMPLETE;
+            simple->done = false;
+            simple->symbols_written = 0;
+            break;
+        }
+        rmt_symbol_word_t *mem;
+        size_t space = led_mock_rmt_space(channel, &mem);
+        if (!space) {
+            state = RMT_ENCODING_MEM_FULL;
+            break;
+        }
+        bool use_ovf = space < simple->min_chunk_size;
+        size_t room = use_ovf ? simple->min_chunk_size : space;
+        size_t count = simple->callback(data, data_size, simple->symbols_written, room, use_ovf ? simple->ovf : mem,
+                                        &simple->done, simple->arg);
+        if (count > room) {
+            ESP_LOGE(TAG, "callback wrote %u symbols into %u", (unsigned)count, (unsigned)room);
+            count = room;
+        }
+        if (!count && !simple->done) {
+            // the real driver gives up on such an encoder as well
+            ESP_LOGE(TAG, "callback wrote nothing into %u symbols", (unsigned)room);
+            state = RMT_ENCODING_COMPLETE;
+            simple->symbols_written = 0;
+            break;
+        }
+        simple->symbols_written += count;
+        if (use_ovf) {
+            simple->ovf_count = count;
+            simple->ovf_pos = 0;
+        } else {
+            led_mock_rmt_commit(channel, count);
+        }
+    }
+    *ret_state = state;
+    return free_before - channel->mem_free;
+}
+
+static esp_err_t led_mock_rmt_simple_reset(rmt_encoder_t *encoder)
+{
+    led_mock_rmt_simple_encoder_t *simple = __containerof(encoder, led_mock_rmt_simple_encoder_t, base);
+    simple->symbols_written = 0;
+    simple->done = false;
+    simple->ovf_count = 0;
+    simple->ovf_pos = 0;
+    return ESP_OK;
+}
+
+static esp_err_t led_mock_rmt_simple_del(rmt_encoder_t *encoder)
+{
+    led_mock_rmt_simple_encoder_t *simple = __containerof(encoder, led_mock_rmt_simple_encoder_t, base);
+    free(simple->ovf);
+    free(simple);
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_simple_encoder(const rmt_simple_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
+{
+    ESP_RETURN_ON_FALSE(config && config->callback && ret_encoder, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    led_mock_rmt_simple_encoder_t *simple = calloc(1, sizeof(*simple));
+    ESP_RETURN_ON_FALSE(simple, ESP_ERR_NO_MEM, TAG, "no mem for simple encoder");
+    // the driver's default is 64 when none is given
+    simple->min_chunk_size = config->min_chunk_size ? config->min_chunk_size : 64;
+    simple->ovf = calloc(simple->min_chunk_size, sizeof(rmt_symbol_word_t));
+    if (!simple->ovf) {
+        free(simple);
+        return ESP_ERR_NO_MEM;
+    }
+    simple->base.encode = led_mock_rmt_simple_encode;
+    simple->base.reset = led_mock_rmt_simple_reset;
+    simple->base.del = led_mock_rmt_simple_del;
+    simple->callback = config->callback;
+    simple->arg = config->arg;
+    *ret_encoder = &simple->base;
+    return ESP_OK;
+}
+
+static size_t led_mock_rmt_copy_encode(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *data,
+                                       size_t data_size, rmt_encode_state_t *ret_state)
+{
+    led_mock_rmt_copy_encoder_t *copy = __containerof(encoder, led_mock_rmt_copy_encoder_t, base);
+    const rmt_symbol_word_t *symbols = data;
+    size_t total = data_size / sizeof(rmt_symbol_word_t);
+    size_t encoded = 0;
+    while (copy->pos < total) {
+        rmt_symbol_word_t *mem;
+        size_t space = led_mock_rmt_space(channel, &mem);
+        if (!space) {
+            *ret_state = RMT_ENCODING_MEM_FULL;
+            return encoded;
+        }
+        size_t count = total - copy->pos < space ? total - copy->pos : space;
+        memcpy(mem, &symbols[copy->pos], count * sizeof(rmt_symbol_word_t));
+        led_mock_rmt_commit(channel, count);
+        copy->pos += count;
+        encoded += count;
+    }
+    copy->pos = 0;
+    *ret_state = RMT_ENCODING_COMPLETE;
+    return encoded;
+}
+
+static esp_err_t led_mock_rmt_copy_reset(rmt_encoder_t *encoder)
+{
+    __containerof(encoder, led_mock_rmt_copy_encoder_t, base)->pos = 0;
+    return ESP_OK;
+}
+
+static esp_err_t led_mock_rmt_copy_del(rmt_encoder_t *encoder)
+{
+    free(__containerof(encoder, led_mock_rmt_copy_encoder_t, base));
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_copy_encoder(const rmt_copy_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
+{
+    ESP_RETURN_ON_FALSE(config && ret_encoder, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    led_mock_rmt_copy_encoder_t *copy = calloc(1, sizeof(*copy));
+    ESP_RETURN_ON_FALSE(copy, ESP_ERR_NO_MEM, TAG, "no mem for copy encoder");
+    copy->base.encode = led_mock_rmt_copy_encode;
+    copy->base.reset = led_mock_rmt_copy_reset;
+    copy->base.del = led_mock_rmt_copy_del;
+    *ret_encoder = &copy->base;
+    return ESP_OK;
+}
+
+esp_err_t rmt_del_encoder(rmt_encoder_handle_t encoder)
+{
+    ESP_RETURN_ON_FALSE(encoder, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    return encoder->del(encoder);
+}
+
+esp_err_t rmt_encoder_reset(rmt_encoder_handle_t encoder)
+{
+    ESP_RETURN_ON_FALSE(encoder, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    return encoder->reset(encoder);
+}
@@ -0,0 +1,17 @@
+/**
+ * @file esp_attr.h
+ * @brief Host build stand-in for the IDF header, placement attributes are no-ops
+ */
+#pragma once
+
+#include <stddef.h>
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+#define FORCE_INLINE_ATTR static inline __attribute__((always_inline))
+
+// newlib's sys/cdefs.h provides this on the target, glibc doesn't
+#ifndef __containerof
+#define __containerof(ptr, type, member) ((type *)((char *)(ptr) - offsetof(type, member)))
+#endif
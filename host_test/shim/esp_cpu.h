@@ -0,0 +1,20 @@
+/**
+ * @file esp_cpu.h
+ * @brief Host build stand-in for the IDF header
+ *
+ * The "cycle count" is a nanosecond clock on the host, so every cycle
+ * figure the modules report (encoder stats) reads as nanoseconds.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+typedef uint32_t esp_cpu_cycle_count_t;
+
+static inline esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (esp_cpu_cycle_count_t)((uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec);
+}
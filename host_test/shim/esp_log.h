@@ -0,0 +1,24 @@
+/**
+ * @file esp_log.h
+ * @brief Host build stand-in for the IDF header, everything goes to stderr
+ */
+#pragma once
+
+#include <stdio.h>
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+#define LED_HOST_LOG(letter, tag, format, ...) fprintf(stderr, letter " %s: " format "\n", tag, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, format, ...) LED_HOST_LOG("E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) LED_HOST_LOG("W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) LED_HOST_LOG("I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) do { (void)(tag); } while (0)
+#define ESP_LOGV(tag, format, ...) do { (void)(tag); } while (0)
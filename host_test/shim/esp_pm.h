@@ -0,0 +1,7 @@
+/**
+ * @file esp_pm.h
+ * @brief Host build stand-in for the IDF header, types only
+ */
+#pragma once
+
+typedef struct esp_pm_lock *esp_pm_lock_handle_t;
@@ -0,0 +1,17 @@
+/**
+ * @file esp_timer.h
+ * @brief Host build stand-in for the IDF header, the clock only
+ */
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+typedef struct esp_timer *esp_timer_handle_t;
+
+static inline int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
@@ -0,0 +1,9 @@
+/**
+ * @file task.h
+ * @brief Host build stand-in, types only
+ */
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct tskTaskControlBlock *TaskHandle_t;
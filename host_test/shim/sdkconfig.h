@@ -0,0 +1,11 @@
+/**
+ * @file sdkconfig.h
+ * @brief Host build configuration
+ *
+ * No CONFIG_IDF_TARGET_* is set, so the portable C kernels are built
+ * instead of the PIE assembly, and the arena, IRAM-safe and other
+ * optional modes are off.
+ */
+#pragma once
+
+#define CONFIG_LOG_MAXIMUM_LEVEL 3
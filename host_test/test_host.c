@@ -0,0 +1,479 @@
+/**
+ * @file test_host.c
+ * @brief Host tests of the color, effect and encoder modules against the mock RMT
+ *
+ * Run with --update-golden to rewrite the captures in golden/ after an
+ * intended change of what goes on the wire, and review the diff.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_rom_crc.h"
+#include "led_color.h"
+#include "led_effects.h"
+#include "led_framebuffer.h"
+#include "led_mock_rmt.h"
+#include "led_strip_encoder.h"
+#include "led_symbol_cache.h"
+
+#define RESOLUTION_HZ 10000000 // what the demo runs the channels at
+
+static int s_failures;
+static bool s_update_golden;
+
+#define CHECK(cond) do {                                                            \
+        if (!(cond)) {                                                              \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            s_failures++;                                                           \
+        }                                                                           \
+    } while (0)
+
+static uint32_t s_rng = 0x12345678;
+
+static uint8_t random_byte(void)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng >> 24;
+}
+
+static void random_pixels(uint8_t *pixels, size_t pixel_count)
+{
+    for (size_t i = 0; i < pixel_count * 3; i++) {
+        pixels[i] = random_byte();
+    }
+}
+
+/**
+ * @brief Send pixels through the strip encoder on a mock channel and keep the capture
+ */
+static size_t send_pixels(const led_strip_encoder_config_t *config, size_t mem_block_symbols, const uint8_t *pixels,
+                          size_t pixel_count, rmt_symbol_word_t *out, size_t out_symbols)
+{
+    rmt_encoder_handle_t encoder = NULL;
+    rmt_channel_handle_t channel = NULL;
+    led_mock_rmt_config_t channel_config = {
+        .resolution_hz = config->resolution,
+        .mem_block_symbols = mem_block_symbols,
+        .capture = true,
+    };
+    ESP_ERROR_CHECK(rmt_new_led_strip_encoder(config, &encoder));
+    ESP_ERROR_CHECK(led_mock_rmt_new_channel(&channel_config, &channel));
+    // twice, the second one shows the encoder starts over cleanly
+    size_t count = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        led_mock_rmt_clear(channel);
+        CHECK(led_mock_rmt_transmit(channel, encoder, pixels, pixel_count * 3) == ESP_OK);
+        const rmt_symbol_word_t *captured = led_mock_rmt_capture(channel, &count);
+        CHECK(count <= out_symbols);
+        if (count > out_symbols) {
+            count = out_symbols;
+        }
+        if (pass) {
+            CHECK(memcmp(out, captured, count * sizeof(rmt_symbol_word_t)) == 0);
+        } else {
+            memcpy(out, captured, count * sizeof(rmt_symbol_word_t));
+        }
+    }
+    led_mock_rmt_del_channel(channel);
+    rmt_del_encoder(encoder);
+    return count;
+}
+
+/**
+ * @brief Turn a captured stream back into bytes the way the chip samples it
+ *
+ * @return Bytes decoded, or -1 if the stream isn't well formed
+ */
+static int decode_symbols(const led_strip_timing_t *timing, const rmt_symbol_word_t *symbols, size_t count,
+                          uint8_t *out)
+{
+    uint32_t threshold = (uint64_t)RESOLUTION_HZ * (timing->t0h_ns + timing->t1h_ns) / 2 / 1000000000;
+    uint32_t reset_ticks = (uint64_t)RESOLUTION_HZ * timing->reset_us / 1000000;
+    if (!count || (count - 1) % 8) {
+        return -1;
+    }
+    for (size_t i = 0; i + 1 < count; i++) {
+        if (symbols[i].level0 != 1 || symbols[i].level1 != 0 || !symbols[i].duration1) {
+            return -1;
+        }
+        if (!(i % 8)) {
+            out[i / 8] = 0;
+        }
+        out[i / 8] = (out[i / 8] << 1) | (symbols[i].duration0 > threshold);
+    }
+    const rmt_symbol_word_t *reset = &symbols[count - 1];
+    if (reset->level0 || reset->level1 || reset->duration0 + reset->duration1 < reset_ticks) {
+        return -1;
+    }
+    return (count - 1) / 8;
+}
+
+static void test_hsv(void)
+{
+    static const struct {
+        uint16_t h;
+        uint8_t s, v;
+        uint8_t grb[3];
+    } cases[] = {
+        { 0, 100, 100, { 0, 255, 0 } },
+        { 60, 100, 100, { 255, 255, 0 } },
+        { 120, 100, 100, { 255, 0, 0 } },
+        { 180, 100, 100, { 255, 0, 255 } },
+        { 240, 100, 100, { 0, 0, 255 } },
+        { 300, 100, 100, { 0, 255, 255 } },
+        { 360, 100, 100, { 0, 255, 0 } },
+        { 200, 0, 100, { 255, 255, 255 } },
+        { 200, 100, 0, { 0, 0, 0 } },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        uint8_t grb[3];
+        led_color_hsv_to_grb(cases[i].h, cases[i].s, cases[i].v, grb);
+        if (memcmp(grb, cases[i].grb, 3)) {
+            fprintf(stderr, "hsv(%u, %u, %u) = %u %u %u\n", cases[i].h, cases[i].s, cases[i].v, grb[0], grb[1], grb[2]);
+        }
+        CHECK(memcmp(grb, cases[i].grb, 3) == 0);
+    }
+
+    // the span version has to be the scalar one, batched
+    uint16_t hues[720];
+    uint8_t span[720 * 3];
+    for (size_t i = 0; i < 720; i++) {
+        hues[i] = i;
+    }
+    for (uint8_t s = 0; s <= 100; s += 25) {
+        for (uint8_t v = 0; v <= 100; v += 10) {
+            led_color_hsv_span_to_grb(hues, 720, s, v, span);
+            for (size_t i = 0; i < 720; i++) {
+                uint8_t grb[3];
+                led_color_hsv_to_grb(hues[i], s, v, grb);
+                CHECK(memcmp(grb, &span[i * 3], 3) == 0);
+            }
+        }
+    }
+}
+
+static void test_encoder_round_trip(void)
+{
+    enum { PIXELS = 37 };
+    uint8_t pixels[PIXELS * 3];
+    uint8_t lut[256];
+    random_pixels(pixels, PIXELS);
+    for (int i = 0; i < 256; i++) {
+        lut[i] = 255 - i;
+    }
+    static rmt_symbol_word_t symbols[LED_STRIP_FRAME_SYMBOLS(PIXELS, 4)];
+    uint8_t decoded[PIXELS * 4];
+    // 2 forces the simple encoder's overflow path on every fill, 1024 is one fill like DMA
+    static const size_t mem_blocks[] = { 2, 24, 48, 1024 };
+    for (led_strip_chip_t chip = 0; chip < LED_STRIP_CHIP_MAX; chip++) {
+        const led_strip_timing_t *timing = led_strip_get_timing(chip);
+        for (int with_lut = 0; with_lut < 2; with_lut++) {
+            led_strip_encoder_config_t config = {
+                .resolution = RESOLUTION_HZ,
+                .lut = with_lut ? lut : NULL,
+                .chip = chip,
+            };
+            uint8_t expected[PIXELS * 4];
+            for (size_t i = 0; i < PIXELS; i++) {
+                const uint8_t *in = &pixels[i * 3];
+                uint8_t *out = &expected[i * timing->bytes_per_pixel];
+                uint8_t w = 0;
+                if (timing->bytes_per_pixel == 4) {
+                    w = in[0] < in[1] ? in[0] : in[1];
+                    w = w < in[2] ? w : in[2];
+                    out[3] = w;
+                }
+                for (int c = 0; c < 3; c++) {
+                    out[c] = in[c] - w;
+                }
+            }
+            size_t expected_bytes = PIXELS * timing->bytes_per_pixel;
+            for (size_t i = 0; with_lut && i < expected_bytes; i++) {
+                expected[i] = lut[expected[i]];
+            }
+
+            size_t precomputed_count;
+            static rmt_symbol_word_t precomputed[LED_STRIP_FRAME_SYMBOLS(PIXELS, 4)];
+            CHECK(led_strip_encode_symbols(&config, pixels, PIXELS, precomputed, &precomputed_count) == ESP_OK);
+            CHECK(precomputed_count == (size_t)LED_STRIP_FRAME_SYMBOLS(PIXELS, timing->bytes_per_pixel));
+            for (size_t m = 0; m < sizeof(mem_blocks) / sizeof(mem_blocks[0]); m++) {
+                size_t count = send_pixels(&config, mem_blocks[m], pixels, PIXELS, symbols,
+                                           sizeof(symbols) / sizeof(symbols[0]));
+                CHECK(count == precomputed_count);
+                CHECK(decode_symbols(timing, symbols, count, decoded) == (int)expected_bytes);
+                CHECK(memcmp(decoded, expected, expected_bytes) == 0);
+                // what the symbol cache sends has to be what the ISR would have
+                CHECK(memcmp(symbols, precomputed, count * sizeof(rmt_symbol_word_t)) == 0);
+            }
+        }
+    }
+}
+
+static void test_encoder_lut(void)
+{
+    enum { PIXELS = 16 };
+    uint8_t pixels[PIXELS * 3];
+    uint8_t lut[256];
+    random_pixels(pixels, PIXELS);
+    for (int i = 0; i < 256; i++) {
+        lut[i] = i / 2;
+    }
+    led_strip_encoder_config_t config = {
+        .resolution = RESOLUTION_HZ,
+        .chip = LED_STRIP_CHIP_WS2812,
+    };
+    rmt_encoder_handle_t encoder;
+    rmt_channel_handle_t channel;
+    led_mock_rmt_config_t channel_config = {
+        .resolution_hz = RESOLUTION_HZ,
+        .capture = true,
+    };
+    ESP_ERROR_CHECK(rmt_new_led_strip_encoder(&config, &encoder));
+    ESP_ERROR_CHECK(led_mock_rmt_new_channel(&channel_config, &channel));
+    // loading the LUT later must give what configuring it up front does
+    CHECK(rmt_led_strip_encoder_set_lut(encoder, lut) == ESP_OK);
+    CHECK(led_mock_rmt_transmit(channel, encoder, pixels, sizeof(pixels)) == ESP_OK);
+    size_t count;
+    const rmt_symbol_word_t *captured = led_mock_rmt_capture(channel, &count);
+    config.lut = lut;
+    rmt_symbol_word_t expected[LED_STRIP_FRAME_SYMBOLS(PIXELS, 3)];
+    size_t expected_count;
+    CHECK(led_strip_encode_symbols(&config, pixels, PIXELS, expected, &expected_count) == ESP_OK);
+    CHECK(count == expected_count);
+    CHECK(memcmp(captured, expected, expected_count * sizeof(rmt_symbol_word_t)) == 0);
+
+    led_mock_rmt_stats_t stats;
+    led_mock_rmt_get_stats(channel, &stats);
+    CHECK(stats.transmissions == 1);
+    CHECK(stats.symbols == expected_count);
+    // one initial fill of 48, then refills of 24: 385 symbols take 16
+    CHECK(stats.fills == 1 + (expected_count - LED_MOCK_RMT_MEM_BLOCK_SYMBOLS + 23) / 24);
+    // 1.2 us per bit plus the 50 us reset
+    CHECK(stats.wire_ns == PIXELS * 24 * 1200 + 50000);
+    uint32_t cycles, calls;
+    CHECK(rmt_led_strip_encoder_get_stats(encoder, &cycles, &calls) == ESP_OK);
+    CHECK(calls >= PIXELS * 3 * 8 / LED_MOCK_RMT_MEM_BLOCK_SYMBOLS);
+
+    led_mock_rmt_del_channel(channel);
+    rmt_del_encoder(encoder);
+}
+
+static void test_symbol_cache(void)
+{
+    enum { PIXELS = 20 };
+    uint8_t frames[2][PIXELS * 3];
+    random_pixels(frames[0], PIXELS);
+    random_pixels(frames[1], PIXELS);
+    led_symbol_cache_config_t config = {
+        .budget_bytes = 64 * 1024,
+        .encoder = { .resolution = RESOLUTION_HZ, .chip = LED_STRIP_CHIP_WS2812 },
+        .segment_count = 2,
+        .segment_pixels = { 12, 8 },
+    };
+    led_symbol_cache_t cache;
+    CHECK(led_symbol_cache_init(&cache, &config) == ESP_OK);
+    uint32_t crc = esp_rom_crc32_le(0, frames[0], sizeof(frames[0]));
+    // admitted on the second sighting, a hit from then on
+    CHECK(led_symbol_cache_get(&cache, frames[0], crc) == NULL);
+    const rmt_symbol_word_t *symbols = led_symbol_cache_get(&cache, frames[0], crc);
+    CHECK(symbols != NULL);
+    CHECK(led_symbol_cache_get(&cache, frames[0], crc) == symbols);
+    CHECK(cache.hits == 1 && cache.inserts == 1);
+    // a different frame under the same CRC must not hit
+    CHECK(led_symbol_cache_get(&cache, frames[1], crc) != symbols);
+
+    // each segment goes out through the copy encoder exactly as the strip encoder would send it
+    rmt_encoder_handle_t copy;
+    rmt_copy_encoder_config_t copy_config = {};
+    rmt_channel_handle_t channel;
+    led_mock_rmt_config_t channel_config = { .resolution_hz = RESOLUTION_HZ, .capture = true };
+    ESP_ERROR_CHECK(rmt_new_copy_encoder(&copy_config, &copy));
+    ESP_ERROR_CHECK(led_mock_rmt_new_channel(&channel_config, &channel));
+    const uint8_t *segment_pixels = frames[0];
+    for (size_t i = 0; symbols && i < config.segment_count; i++) {
+        size_t segment_count;
+        const rmt_symbol_word_t *segment = led_symbol_cache_segment(&cache, symbols, i, &segment_count);
+        led_mock_rmt_clear(channel);
+        CHECK(led_mock_rmt_transmit(channel, copy, segment, segment_count * sizeof(rmt_symbol_word_t)) == ESP_OK);
+        size_t captured_count;
+        const rmt_symbol_word_t *captured = led_mock_rmt_capture(channel, &captured_count);
+        rmt_symbol_word_t expected[LED_STRIP_FRAME_SYMBOLS(PIXELS, 3)];
+        size_t expected_count = send_pixels(&config.encoder, 0, segment_pixels, config.segment_pixels[i], expected,
+                                            sizeof(expected) / sizeof(expected[0]));
+        CHECK(captured_count == expected_count);
+        CHECK(memcmp(captured, expected, expected_count * sizeof(rmt_symbol_word_t)) == 0);
+        segment_pixels += config.segment_pixels[i] * 3;
+    }
+    led_mock_rmt_del_channel(channel);
+    rmt_del_encoder(copy);
+    led_symbol_cache_deinit(&cache);
+}
+
+static void test_framebuffer_dirty(void)
+{
+    enum { PIXELS = 16 };
+    static const uint8_t grb[3] = { 1, 2, 3 };
+    static const uint8_t tail[4 * 3];
+    led_framebuffer_t frame;
+    CHECK(led_framebuffer_init(&frame, PIXELS) == ESP_OK);
+    CHECK(frame.dirty_start == 0 && frame.dirty_end == PIXELS);
+
+    led_framebuffer_clear_dirty(&frame);
+    CHECK(!led_framebuffer_is_dirty(&frame));
+    // out of range writes are dropped and leave the buffer clean
+    led_framebuffer_set_pixel(&frame, PIXELS, grb);
+    led_framebuffer_fill(&frame, PIXELS, 4, grb);
+    CHECK(!led_framebuffer_is_dirty(&frame));
+
+    led_framebuffer_set_pixel(&frame, 5, grb);
+    CHECK(frame.dirty_start == 5 && frame.dirty_end == 6);
+    led_framebuffer_fill(&frame, 2, 2, grb);
+    // clipped to the last two pixels
+    led_framebuffer_blit(&frame, 14, tail, 4);
+    CHECK(frame.dirty_start == 2 && frame.dirty_end == PIXELS);
+    led_framebuffer_deinit(&frame);
+}
+
+static void test_effects(void)
+{
+    enum { PIXELS = 61, GUARD = 16 };
+    led_effect_engine_t engine;
+    led_framebuffer_t frame = { .pixel_count = PIXELS };
+    static uint8_t buffer[PIXELS * 3 + GUARD];
+    frame.pixels = buffer;
+    CHECK(led_effect_engine_init(&engine, PIXELS, LED_COLOR_ORDER_GRB) == ESP_OK);
+    for (size_t e = 0; e < led_effects_count(); e++) {
+        CHECK(led_effect_engine_select(&engine, e) == ESP_OK);
+        memset(buffer, 0xA5, sizeof(buffer));
+        for (uint32_t f = 0; f < 100; f++) {
+            led_scheduler_frame_t info = { .frame = f, .time_us = (int64_t)f * 16667 };
+            uint32_t duty = led_effect_engine_render(&engine, &frame, &info);
+            // the identity duty curve makes the sum the plain channel sum
+            uint32_t sum = 0;
+            for (size_t i = 0; i < PIXELS * 3; i++) {
+                sum += buffer[i];
+            }
+            CHECK(duty == sum);
+        }
+        // a kernel that writes one pixel too many shows up here
+        for (size_t i = PIXELS * 3; i < sizeof(buffer); i++) {
+            CHECK(buffer[i] == 0xA5);
+        }
+    }
+    led_effect_engine_deinit(&engine);
+}
+
+/**
+ * @brief Compare a capture with golden/<name>.txt, or rewrite it with --update-golden
+ *
+ * One symbol per line, "level0 duration0 level1 duration1", # starts a comment.
+ */
+static void check_golden(const char *name, const char *comment, const rmt_symbol_word_t *symbols, size_t count)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s.txt", LED_HOST_GOLDEN_DIR, name);
+    if (s_update_golden) {
+        FILE *f = fopen(path, "w");
+        CHECK(f != NULL);
+        if (f) {
+            fprintf(f, "# %s\n# %u symbols, level0 duration0 level1 duration1, ticks of %u Hz\n", comment,
+                    (unsigned)count, RESOLUTION_HZ);
+            for (size_t i = 0; i < count; i++) {
+                fprintf(f, "%u %u %u %u\n", symbols[i].level0, symbols[i].duration0, symbols[i].level1,
+                        symbols[i].duration1);
+            }
+            fclose(f);
+            printf("updated %s\n", path);
+        }
+        return;
+    }
+    FILE *f = fopen(path, "r");
+    CHECK(f != NULL);
+    if (!f) {
+        fprintf(stderr, "no %s, run with --update-golden to create it\n", path);
+        return;
+    }
+    char line[128];
+    size_t i = 0;
+    size_t first_diff = SIZE_MAX;
+    while (fgets(line, sizeof(line), f)) {
+        unsigned l0, d0, l1, d1;
+        if (line[0] == '#' || sscanf(line, "%u %u %u %u", &l0, &d0, &l1, &d1) != 4) {
+            continue;
+        }
+        if (first_diff == SIZE_MAX && (i >= count || symbols[i].level0 != l0 || symbols[i].duration0 != d0 ||
+                                       symbols[i].level1 != l1 || symbols[i].duration1 != d1)) {
+            first_diff = i;
+        }
+        i++;
+    }
+    fclose(f);
+    if (first_diff == SIZE_MAX && i != count) {
+        first_diff = i < count ? i : count;
+    }
+    if (first_diff != SIZE_MAX) {
+        fprintf(stderr, "%s: %u symbols captured, %u golden, first difference at symbol %u\n", name, (unsigned)count,
+                (unsigned)i, (unsigned)first_diff);
+    }
+    CHECK(first_diff == SIZE_MAX);
+}
+
+static void test_golden_rainbow(void)
+{
+    enum { PIXELS = 8 };
+    led_effect_engine_t engine;
+    led_framebuffer_t frame;
+    CHECK(led_effect_engine_init(&engine, PIXELS, LED_COLOR_ORDER_GRB) == ESP_OK);
+    CHECK(led_framebuffer_init(&frame, PIXELS) == ESP_OK);
+    int rainbow = led_effects_find("rainbow");
+    CHECK(rainbow >= 0);
+    CHECK(led_effect_engine_select(&engine, rainbow) == ESP_OK);
+    led_scheduler_frame_t info = { .frame = 30, .time_us = 500000 };
+    led_effect_engine_render(&engine, &frame, &info);
+
+    led_strip_encoder_config_t config = {
+        .resolution = RESOLUTION_HZ,
+        .chip = LED_STRIP_CHIP_WS2812,
+    };
+    rmt_symbol_word_t symbols[LED_STRIP_FRAME_SYMBOLS(PIXELS, 3)];
+    size_t count = send_pixels(&config, 0, frame.pixels, PIXELS, symbols, sizeof(symbols) / sizeof(symbols[0]));
+    check_golden("rainbow_8px", "rainbow, default params, 8 pixels at t = 500 ms, WS2812", symbols, count);
+
+    led_framebuffer_deinit(&frame);
+    led_effect_engine_deinit(&engine);
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--update-golden")) {
+            s_update_golden = true;
+        } else {
+            fprintf(stderr, "usage: %s [--update-golden]\n", argv[0]);
+            return 2;
+        }
+    }
+    static const struct {
+        const char *name;
+        void (*run)(void);
+    } tests[] = {
+        { "hsv", test_hsv },
+        { "encoder_round_trip", test_encoder_round_trip },
+        { "encoder_lut", test_encoder_lut },
+        { "symbol_cache", test_symbol_cache },
+        { "framebuffer_dirty", test_framebuffer_dirty },
+        { "effects", test_effects },
+        { "golden_rainbow", test_golden_rainbow },
+    };
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        int before = s_failures;
+        tests[i].run();
+        printf("%s %s\n", s_failures == before ? "PASS" : "FAIL", tests[i].name);
+    }
+    printf("%d failed checks\n", s_failures);
+    return s_failures ? 1 : 0;
+}
@@ -1,25 +1,52 @@
 /**
  * @file esp32s3_onboard_LED.c
- * @brief Single-file driver for ESP32-S3 onboard NeoPixel LED
+ * @brief Rainbow demo for the ESP32-S3 onboard NeoPixel LED
  * 
- * This file contains everything needed to drive the onboard LED.
- * It's organized in sections: config, types, and functions.
- * For a project this size, single file is fine and might be
- * easier to understand than multiple files.
+ * This file holds the demo itself: config and the animation
+ * loop. Effects are in led_effects.c, driving the strip (RMT
+ * channel, encoder and the front/back framebuffers) lives in
+ * led_controller.c, frame pacing in led_scheduler.c and the
+ * render/transmit tasks in led_pipeline.c. With
+ * CONFIG_LED_NET_INPUT the frames come from the network instead
+ * (led_net.c), with CONFIG_LED_SCENE_PLAYBACK from a scene
+ * partition in flash (led_scene.c).
  */
 
  #define _POSIX_C_SOURCE 200809L
  #define _GNU_SOURCE
  
- #include <math.h>
  #include <stdio.h>
  #include <stdlib.h>
  #include <stdint.h>
+ #include <string.h>
+ #include <inttypes.h>
  #include "freertos/FreeRTOS.h"
  #include "freertos/task.h"
- #include "driver/rmt_tx.h"
- #include "led_strip_encoder.h"
+ #include "led_pipeline.h"
+ #include "led_effects.h"
+ #include "led_telemetry.h"
+ #include "led_mem.h"
+ #include "led_bench.h"
+ #include "led_command.h"
+ #include "led_pixel_ops.h"
+ #include "led_power.h"
+ #include "led_boot.h"
+ #include "esp_pm.h"
+ #include "esp_heap_caps.h"
+ #include "esp_timer.h"
  #include "esp_log.h"
+ #include "sdkconfig.h"
+ #if CONFIG_LED_NET_INPUT
+ #include "esp_event.h"
+ #include "esp_netif.h"
+ #include "esp_wifi.h"
+ #include "nvs_flash.h"
+ #include "protocol_examples_common.h"
+ #include "led_net.h"
+ #endif
+ #if CONFIG_LED_SCENE_PLAYBACK
+ #include "led_scene.h"
+ #endif
  
  /*********************************************
   * Configuration
@@ -27,163 +54,445 @@
  
  // Hardware settings
  #define LED_GPIO            48      // Onboard NeoPixel GPIO pin
- #define LED_COUNT           1       // Single onboard NeoPixel
+ #define LED_COUNT           1       // Pixels on the strip (1 = onboard NeoPixel only)
+ #define LED_CHIP            LED_STRIP_CHIP_WS2812 // Bit timing profile (see led_strip_encoder.h)
  
  // Animation settings
- #define RAINBOW_SPEED       20      // Animation speed (ms per step)
- #define HUE_STEP           2       // Hue increment per step (degrees)
+ #define TARGET_FPS         50      // Frames per second, not limited to RTOS tick multiples
+ #define EFFECT_NAME        "rainbow" // Effect to start with (see led_effects.c for the list)
+ #define RAINBOW_SPEED      100     // Animation speed (degrees of hue per second)
+ #define LED_COLOR_ORDER    LED_COLOR_ORDER_GRB // Byte order the strip expects
+ #define STATS_REPORT_MS    5000    // Log frame timing this often (0 = off)
+ #define EFFECT_CYCLE_MS    10000   // Post a switch to the next effect this often (0 = stay on EFFECT_NAME)
+ #define BOOT_GRB           { 24, 32, 12 } // Shown on every pixel right after power-on (CONFIG_LED_FAST_BOOT), GRB
+ #define COMMAND_QUEUE_SIZE 32      // Commands other tasks can have in flight (power of two)
+ 
+ // Pipeline settings (render and transmit run on different cores)
+ #define RENDER_CORE        1       // APP CPU draws the frames
+ #define TX_CORE            0       // PRO CPU feeds the RMT, its interrupt lands here too
+ #define PIPELINE_FRAMES    3       // Framebuffers in flight (2-4), more lets rendering run further ahead
+ 
+ // Output correction, applied while encoding (the framebuffer stays linear)
+ #define LED_GAMMA          2.2f    // Gamma curve exponent (1.0 = off)
+ #define LED_BRIGHTNESS     255     // Global brightness limit (0-255)
+ #define LED_DITHER         1       // Temporal dithering, smooths fades near black (gamma kept at 16 bits)
+ #define DITHER_FPS         400     // Dithered refresh rate, at most ~33000 / LED_COUNT (0 = as fast as the wire)
+ 
+ // Power limit, frames that would draw more are dimmed as a whole (see led_power.h)
+ #define POWER_BUDGET_MA    400     // Current the supply can spare for the LEDs (0 = no limit)
+ 
+ // Skip frames that didn't change (e.g. a paused or static effect)
+ #define SKIP_UNCHANGED     1       // Don't resend a frame identical to the last one
+ #define REFRESH_MS         1000    // Resend it anyway this often, in case the strip glitched (0 = never)
+ #define HOLD_UNCHANGED     1       // Let the RMT loop an unchanged frame in hardware instead (short strips only)
+ #define SPARSE_UPDATES     0       // Send only up to the last changed pixel, for long strips that change near the head
+
+ // Power management (CONFIG_LED_POWER_SAVE), full speed only while a frame is rendered and sent
+ #define PM_MIN_FREQ_MHZ    40      // CPU clock between frames (XTAL), the maximum is the default CPU frequency
  
  // RMT settings (for LED timing)
  #define RMT_RESOLUTION_HZ  10000000 // 10MHz for precise timing
- #define RMT_MEM_BLOCKS     64      // Memory blocks for RMT peripheral
+ #define RMT_WITH_DMA       0       // Set to 1 for long strips, fewer interrupts per frame
+ #define RMT_MEM_BLOCKS     (RMT_WITH_DMA ? 0 : 64) // Memory blocks for RMT peripheral (0 = sized for DMA)
+ #define SYMBOL_CACHE_BYTES 16384   // Keep repeating frames encoded, sent without refill work (0 = off)
  
- static const char *TAG = "NeoPixel";
+ // Network input settings (CONFIG_LED_NET_INPUT, Wi-Fi credentials are under "Example Connection Configuration")
+ #define NET_FRAMES         4       // Framebuffers for received frames (3-8)
+ #define NET_PLAYOUT_DELAY_MS 50    // Jitter buffer depth, frames go out this long after they arrived
+ #define NET_E131_UNIVERSE  1       // E1.31 universe of the first pixel, 170 pixels per universe
  
- /*********************************************
-  * Types
-  *********************************************/
+ // Scene playback settings (CONFIG_LED_SCENE_PLAYBACK, build the partition with tools/led_scene_pack.py)
+ #define SCENE_NAME         "intro" // Scene to play, the first one if there is none by that name
+ 
+ static const char *TAG = "NeoPixel";
  
  /**
-  * @brief Everything needed to control the LED
+  * @brief What the render task works with
+  * 
+  * Other tasks never touch this directly, they post commands
+  * which the render task applies at the start of each frame.
   */
  typedef struct {
-     rmt_channel_handle_t channel;   // RMT channel for LED control
-     rmt_encoder_handle_t encoder;   // LED strip encoder
-     uint8_t grb_data[3];           // Current LED color in GRB format
-     uint16_t current_hue;          // Current hue value (0-359 degrees)
- } led_controller_t;
+     led_effect_engine_t engine;   // Current effect
+     led_command_queue_t commands; // Posted by other tasks and ISRs
+     uint8_t brightness;           // Frame scale from LED_COMMAND_SET_BRIGHTNESS (255 = full)
+     uint8_t *overlay;             // Pixels painted by commands, GRB
+     uint8_t *overlay_mask;        // 1 where the overlay covers the effect
+     led_power_t power;            // Keeps each frame within POWER_BUDGET_MA
+ } render_ctx_t;
  
  /*********************************************
   * Function Declarations
   *********************************************/
  
- static void hsv_to_grb(uint16_t h, uint8_t s, uint8_t v, uint8_t *grb);
- static led_controller_t initialize_led_controller(void);
- static void update_led_color(led_controller_t *controller);
+ static led_controller_config_t controller_config(void);
+ static void initialize_render(render_ctx_t *ctx);
+ static void initialize_led_pipeline(led_pipeline_t *pipeline, render_ctx_t *ctx);
+ static void apply_commands(render_ctx_t *ctx);
+ static void render_effect(led_framebuffer_t *frame, const led_scheduler_frame_t *info, void *user_ctx);
+ static void cycle_effect(void *arg);
+ #if CONFIG_LED_NET_INPUT
+ static void initialize_network_input(led_controller_t *controller, led_net_t *net);
+ #endif
+ #if CONFIG_LED_SCENE_PLAYBACK
+ static void initialize_scene_playback(led_controller_t *controller, led_scene_library_t *library, led_scene_player_t *player);
+ static void play_scene(led_controller_t *controller, led_scene_player_t *player);
+ #endif
  
  /*********************************************
   * Function Implementations
   *********************************************/
  
  /**
-  * @brief Converts HSV color to GRB format for NeoPixel
+  * @brief Strip settings, shared by the pipeline and the network input
+  */
+ static led_controller_config_t controller_config(void) {
+     led_controller_config_t config = {
+         .gpio_nums = { LED_GPIO },
+         .output_count = 1,
+         .pixel_count = LED_COUNT,
+         .resolution_hz = RMT_RESOLUTION_HZ,
+         .chip = LED_CHIP,
+         .mem_block_symbols = RMT_MEM_BLOCKS,
+         .trans_queue_depth = 4,
+         .with_dma = RMT_WITH_DMA,
+         .skip_unchanged = SKIP_UNCHANGED,
+         .refresh_ms = REFRESH_MS,
+         .hold_unchanged = HOLD_UNCHANGED,
+         .sparse = SPARSE_UPDATES,
+         .dither = LED_DITHER,
+         .gamma = LED_GAMMA,
+         .brightness = LED_BRIGHTNESS,
+         .symbol_cache_bytes = SYMBOL_CACHE_BYTES,
+     };
+ #if CONFIG_LED_POWER_SAVE
+     config.power_save = true;
+ #endif
+     return config;
+ }
+ 
+ /**
+  * @brief Sets up the effect engine with the starting effect and the command queue
   * 
-  * Pretty standard HSV->RGB conversion, but outputs in GRB
-  * order because that's what WS2812 LEDs expect.
+  * Effects can be switched later with led_effect_engine_select()
+  * without touching the RMT channel, other tasks do it by posting
+  * LED_COMMAND_SELECT_EFFECT into ctx->commands.
   */
- static void hsv_to_grb(uint16_t h, uint8_t s, uint8_t v, uint8_t *grb) {
-     h %= 360;
-     float S = s / 100.0f;
-     float V = v / 100.0f;
-     float C = V * S;
-     float X = C * (1 - fabs(fmod(h / 60.0f, 2) - 1));
-     float m = V - C;
+ static void initialize_render(render_ctx_t *ctx) {
+     led_effect_engine_t *engine = &ctx->engine;
+     ESP_ERROR_CHECK(led_effect_engine_init(engine, LED_COUNT, LED_COLOR_ORDER));
+     led_effect_params_t params = LED_EFFECT_DEFAULT_PARAMS();
+     params.speed = RAINBOW_SPEED;
+     led_effect_engine_set_params(engine, &params);
+     int effect = led_effects_find(EFFECT_NAME);
+     if (effect < 0) {
+         ESP_LOGW(TAG, "No effect called %s, using %s", EFFECT_NAME, led_effects_get(0)->name);
+         effect = 0;
+     }
+     ESP_ERROR_CHECK(led_effect_engine_select(engine, effect));
+     // The limiter needs what the strip draws, i.e. the values after the output correction
+     led_effect_engine_set_duty_curve(engine, LED_GAMMA, LED_BRIGHTNESS);
+     led_power_config_t power_config = LED_POWER_DEFAULT_CONFIG(POWER_BUDGET_MA);
+     power_config.gamma = LED_GAMMA;
+     led_power_init(&ctx->power, &power_config);
      
-     float r, g, b;
+     ESP_ERROR_CHECK(led_command_queue_init(&ctx->commands, COMMAND_QUEUE_SIZE));
+     ctx->brightness = 255;
+     ctx->overlay = led_mem_calloc(LED_COUNT, 3, 4, MALLOC_CAP_8BIT);
+     ctx->overlay_mask = led_mem_calloc(LED_COUNT, 1, 4, MALLOC_CAP_8BIT);
+     ESP_ERROR_CHECK(ctx->overlay && ctx->overlay_mask ? ESP_OK : ESP_ERR_NO_MEM);
      
-     // Convert hue to RGB
-     if (h < 60) {
-         r = C; g = X; b = 0;
-     } else if (h < 120) {
-         r = X; g = C; b = 0;
-     } else if (h < 180) {
-         r = 0; g = C; b = X;
-     } else if (h < 240) {
-         r = 0; g = X; b = C;
-     } else if (h < 300) {
-         r = X; g = 0; b = C;
-     } else {
-         r = C; g = 0; b = X;
+     // Stand-in for a button or network task: asks for the next effect every EFFECT_CYCLE_MS
+     if (EFFECT_CYCLE_MS) {
+         esp_timer_create_args_t timer_args = {
+             .callback = cycle_effect,
+             .arg = ctx,
+             .name = "cycle_effect",
+         };
+         esp_timer_handle_t timer;
+         ESP_ERROR_CHECK(esp_timer_create(&timer_args, &timer));
+         ESP_ERROR_CHECK(esp_timer_start_periodic(timer, EFFECT_CYCLE_MS * 1000ULL));
      }
-     
-     // Convert to GRB (WS2812 expects GRB, not RGB)
-     grb[0] = (g + m) * 255;
-     grb[1] = (r + m) * 255;
-     grb[2] = (b + m) * 255;
+ }
+ 
+ /**
+  * @brief Posts a switch to the next effect, runs in the esp_timer task
+  */
+ static void cycle_effect(void *arg) {
+     render_ctx_t *ctx = (render_ctx_t *)arg;
+     static size_t next = 0;
+     next = (next + 1) % led_effects_count();
+     led_command_t command = {
+         .type = LED_COMMAND_SELECT_EFFECT,
+         .effect = next,
+     };
+     led_command_post(&ctx->commands, &command);
  }
  
  /**
   * @brief Sets up everything needed to control the LED
   * 
   * Creates and configures the RMT peripheral which we need
-  * because WS2812 LEDs have very strict timing requirements.
+  * because WS2812 LEDs have very strict timing requirements,
+  * and starts the render and transmit tasks around it.
   */
- static led_controller_t initialize_led_controller(void) {
-     led_controller_t controller = {0};
-     
-     // Set up RMT channel
-     rmt_tx_channel_config_t tx_chan_config = {
-         .clk_src = RMT_CLK_SRC_DEFAULT,
-         .gpio_num = LED_GPIO,
-         .mem_block_symbols = RMT_MEM_BLOCKS,
-         .resolution_hz = RMT_RESOLUTION_HZ,
-         .trans_queue_depth = 4,
+ static void initialize_led_pipeline(led_pipeline_t *pipeline, render_ctx_t *ctx) {
+     led_pipeline_config_t config = {
+         .controller = controller_config(),
+         .render_cb = render_effect,
+         .user_ctx = ctx,
+         .target_fps = TARGET_FPS,
+         .frame_count = PIPELINE_FRAMES,
+         .render_core = RENDER_CORE,
+         .tx_core = TX_CORE,
+         .render_priority = 5,
+         .tx_priority = 6,
+         .dither_fps = DITHER_FPS,
      };
-     ESP_ERROR_CHECK(rmt_new_tx_channel(&tx_chan_config, &controller.channel));
+     ESP_ERROR_CHECK(led_pipeline_init(&config, pipeline));
+     led_controller_t *controller = led_pipeline_controller(pipeline);
+     ESP_ERROR_CHECK(led_controller_report_stats(controller, STATS_REPORT_MS));
+ }
  
-     // Set up LED encoder
-     led_strip_encoder_config_t encoder_config = {
-         .resolution = RMT_RESOLUTION_HZ,
-     };
-     ESP_ERROR_CHECK(rmt_new_led_strip_encoder(&encoder_config, &controller.encoder));
-     
-     // Turn it on
-     ESP_ERROR_CHECK(rmt_enable(controller.channel));
-     
-     return controller;
+ /**
+  * @brief Applies everything other tasks posted since the last frame
+  */
+ static void apply_commands(render_ctx_t *ctx) {
+     led_command_t command;
+     while (led_command_pop(&ctx->commands, &command)) {
+         switch (command.type) {
+         case LED_COMMAND_FILL:
+             for (size_t i = command.fill.start; i < LED_COUNT && i - command.fill.start < command.fill.count; i++) {
+                 memcpy(&ctx->overlay[i * 3], command.fill.grb, 3);
+                 ctx->overlay_mask[i] = 1;
+             }
+             break;
+         case LED_COMMAND_BLIT:
+             for (size_t i = command.blit.start; i < LED_COUNT && i - command.blit.start < command.blit.count; i++) {
+                 memcpy(&ctx->overlay[i * 3], &command.blit.pixels[(i - command.blit.start) * 3], 3);
+                 ctx->overlay_mask[i] = 1;
+             }
+             if (command.blit.done) {
+                 command.blit.done(command.blit.ctx);
+             }
+             break;
+         case LED_COMMAND_CLEAR:
+             for (size_t i = command.clear.start; i < LED_COUNT && i - command.clear.start < command.clear.count; i++) {
+                 ctx->overlay_mask[i] = 0;
+             }
+             break;
+         case LED_COMMAND_SELECT_EFFECT:
+             if (led_effect_engine_select(&ctx->engine, command.effect) == ESP_OK) {
+                 led_telemetry_push(TAG, "Effect: %" PRIu32, (uint32_t)command.effect, 0, 0, 0);
+             }
+             break;
+         case LED_COMMAND_SET_PARAMS:
+             led_effect_engine_set_params(&ctx->engine, &command.params);
+             break;
+         case LED_COMMAND_SET_BRIGHTNESS:
+             ctx->brightness = command.brightness;
+             break;
+         }
+     }
+     uint32_t dropped = led_command_take_dropped(&ctx->commands);
+     if (dropped) {
+         led_telemetry_push(TAG, "%" PRIu32 " commands dropped, queue full", dropped, 0, 0, 0);
+     }
  }
  
  /**
-  * @brief Updates LED color and handles debug output
+  * @brief Renders one frame, runs in the render task
   * 
   * This function:
-  * 1. Converts current hue to LED color values
-  * 2. Sends color to LED
-  * 3. Prints debug info (every 10 steps)
-  * 4. Updates hue for next time
+  * 1. Applies posted commands
+  * 2. Lets the current effect draw straight into the frame
+  * 3. Paints the command overlay
+  * 4. Scales brightness, further down if the frame would go over the power budget
+  * 5. Queues debug info (every 5 frames)
+  * 
+  * The transmit task sends the frame afterwards.
+  */
+ static void render_effect(led_framebuffer_t *frame, const led_scheduler_frame_t *info, void *user_ctx) {
+     render_ctx_t *ctx = (render_ctx_t *)user_ctx;
+     apply_commands(ctx);
+     uint32_t duty = led_effect_engine_render(&ctx->engine, frame, info);
+     for (size_t i = 0; i < LED_COUNT; i++) {
+         if (ctx->overlay_mask[i]) {
+             duty -= led_effect_engine_pixel_duty(&ctx->engine, &frame->pixels[i * 3]);
+             memcpy(&frame->pixels[i * 3], &ctx->overlay[i * 3], 3);
+             duty += led_effect_engine_pixel_duty(&ctx->engine, &frame->pixels[i * 3]);
+         }
+     }
+     uint8_t scale = led_power_limit(&ctx->power, duty, LED_COUNT, ctx->brightness);
+     if (scale != 255) {
+         led_pixel_scale(frame->pixels, led_framebuffer_size(frame), scale);
+     }
+     
+     // Debug output every 5 frames, queued for the telemetry task so the frame loop never waits on the UART
+     if (info->frame % 5 == 0) {
+         const uint8_t *grb = frame->pixels;
+         led_telemetry_push(TAG, "Frame: %" PRIu32 " | GRB: [%3" PRIu32 ", %3" PRIu32 ", %3" PRIu32 "]", 
+                 info->frame,
+                 grb[0], grb[1], grb[2]);
+         if (scale < ctx->brightness) {
+             led_telemetry_push(TAG, "Power: %" PRIu32 " mA asked for, dimmed to %" PRIu32 "/255 (%" PRIu32 " frames so far)",
+                     ctx->power.estimate_ma, scale, ctx->power.limited_frames, 0);
+         }
+     }
+ }
+ 
+ #if CONFIG_LED_NET_INPUT
+ /**
+  * @brief Joins Wi-Fi and shows whatever the show controller sends
+  * 
+  * The controller is created here on TX_CORE (app_main runs on
+  * the PRO CPU), the network input's transmit task is pinned
+  * there as well.
   */
- static void update_led_color(led_controller_t *controller) {
-     // Convert hue to LED color
-     hsv_to_grb(controller->current_hue, 100, 100, controller->grb_data);
+ static void initialize_network_input(led_controller_t *controller, led_net_t *net) {
+     esp_err_t ret = nvs_flash_init();
+     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+         ESP_ERROR_CHECK(nvs_flash_erase());
+         ret = nvs_flash_init();
+     }
+     ESP_ERROR_CHECK(ret);
+     ESP_ERROR_CHECK(esp_netif_init());
+     ESP_ERROR_CHECK(esp_event_loop_create_default());
+     ESP_ERROR_CHECK(example_connect());
+     // Modem sleep holds packets back for up to a beacon interval, far too bursty for 40+ fps
+     ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_NONE));
+     
+     led_controller_config_t config = controller_config();
+     config.dither = false; // frames go out one for one as they arrive
+     ESP_ERROR_CHECK(led_controller_init(&config, controller));
+     ESP_ERROR_CHECK(led_controller_report_stats(controller, STATS_REPORT_MS));
      
-     // Send to LED
-     rmt_transmit_config_t tx_config = {
-         .loop_count = 0
+     led_net_config_t net_config = {
+         .protocols = LED_NET_PROTOCOL_DDP | LED_NET_PROTOCOL_E131,
+         .order = LED_COLOR_ORDER,
+         .frame_count = NET_FRAMES,
+         .playout_delay_ms = NET_PLAYOUT_DELAY_MS,
+         .e131_universe = NET_E131_UNIVERSE,
+         .e131_multicast = true,
+         .tx_core = TX_CORE,
+         .tx_priority = 6,
      };
-     ESP_ERROR_CHECK(rmt_transmit(
-         controller->channel, 
-         controller->encoder,
-         controller->grb_data, 
-         sizeof(controller->grb_data),
-         &tx_config
-     ));
+     ESP_ERROR_CHECK(led_net_init(&net_config, controller, net));
+ }
+ #endif
+ 
+ #if CONFIG_LED_SCENE_PLAYBACK
+ /**
+  * @brief Maps the scene partition and gets SCENE_NAME ready
+  * 
+  * Nothing is rendered, the frames are in flash in wire order
+  * already. Only scenes with RLE or delta frames need RAM, for
+  * two decoded frames.
+  */
+ static void initialize_scene_playback(led_controller_t *controller, led_scene_library_t *library, led_scene_player_t *player) {
+     led_controller_config_t config = controller_config();
+     config.dither = false; // frames go out one for one, straight from flash
+     ESP_ERROR_CHECK(led_controller_init(&config, controller));
+     ESP_ERROR_CHECK(led_controller_report_stats(controller, STATS_REPORT_MS));
      
-     // Debug output every 10 steps
-     if (controller->current_hue % 10 == 0) {
-         ESP_LOGI(TAG, "Hue: %d° | GRB: [%3d, %3d, %3d]", 
-                 controller->current_hue,
-                 controller->grb_data[0],
-                 controller->grb_data[1],
-                 controller->grb_data[2]);
+     ESP_ERROR_CHECK(led_scene_library_open(NULL, library));
+     int scene = led_scene_find(library, SCENE_NAME);
+     if (scene < 0) {
+         ESP_LOGW(TAG, "No scene called %s, playing the first one", SCENE_NAME);
+         scene = 0;
+     }
+     ESP_ERROR_CHECK(led_scene_player_init(player, library, scene, LED_COUNT));
+ }
+ 
+ /**
+  * @brief Sends the scene at its own frame rate, forever
+  * 
+  * Each frame goes from the mapped flash to the encoder while
+  * the next one is looked up (or decoded).
+  */
+ static void play_scene(led_controller_t *controller, led_scene_player_t *player) {
+     led_scheduler_config_t scheduler_config = {
+         .target_fps = led_scene_player_fps(player),
+         .power_save = controller->power_save,
+     };
+     static led_scheduler_t scheduler;
+     ESP_ERROR_CHECK(led_scheduler_init(&scheduler_config, &scheduler));
+     while (1) {
+         led_scheduler_frame_t info;
+         led_scheduler_wait_frame(&scheduler, &info);
+         led_framebuffer_t *frame;
+         if (led_scene_player_next(player, &frame) == ESP_OK) {
+             led_controller_transmit_buffer(controller, frame, -1);
+         }
+         led_controller_idle(controller, -1);
      }
-     
-     // Move to next hue
-     controller->current_hue = (controller->current_hue + HUE_STEP) % 360;
  }
+ #endif
  
  /**
   * @brief Main program entry
   * 
-  * Sets up LED control and runs the animation forever.
+  * Sets up LED control, the animation then runs forever in
+  * the pipeline tasks.
   */
  void app_main(void) {
+ #if CONFIG_LED_BENCHMARK
+     // Benchmark build: measure, print the results and stop
+     ESP_ERROR_CHECK(led_bench_run(LED_GPIO));
+     return;
+ #endif
+ #if CONFIG_LED_FAST_BOOT
+     // Light up before anything else, the pipeline takes over from this frame
+     led_boot_config_t boot_config = {
+         .gpio_num = LED_GPIO,
+         .chip = LED_CHIP,
+         .resolution_hz = RMT_RESOLUTION_HZ,
+         .pixel_count = LED_COUNT,
+         .grb = BOOT_GRB,
+     };
+     esp_err_t boot_ret = led_boot_show(&boot_config);
+ #endif
      ESP_LOGI(TAG, "Starting Rainbow Demo");
+ #if CONFIG_LED_POWER_SAVE
+     // Slow down and light-sleep whenever no frame is being worked on, the LED tasks hold full speed meanwhile
+     esp_pm_config_t pm_config = {
+         .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+         .min_freq_mhz = PM_MIN_FREQ_MHZ,
+         .light_sleep_enable = true,
+     };
+     ESP_ERROR_CHECK(esp_pm_configure(&pm_config));
+     ESP_LOGI(TAG, "Power save: %d-%d MHz, light sleep between frames", PM_MIN_FREQ_MHZ, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+ #endif
+ #if CONFIG_LED_FAST_BOOT
+     if (boot_ret == ESP_OK) {
+         ESP_LOGI(TAG, "Boot to first frame: %" PRId64 " us", led_boot_first_frame_us());
+     }
+ #endif
      
-     led_controller_t controller = initialize_led_controller();
+     // Debug lines from the frame loop are printed by a low-priority task
+     led_telemetry_config_t telemetry_config = LED_TELEMETRY_DEFAULT_CONFIG();
+     ESP_ERROR_CHECK(led_telemetry_init(&telemetry_config));
      
-     // Just keep updating colors forever
-     while (1) {
-         update_led_color(&controller);
-         vTaskDelay(pdMS_TO_TICKS(RAINBOW_SPEED));
-     }
+     // static: the tasks and the TX-done ISR keep pointers into these
+ #if CONFIG_LED_NET_INPUT
+     static led_controller_t controller;
+     static led_net_t net;
+     initialize_network_input(&controller, &net);
+ #elif CONFIG_LED_SCENE_PLAYBACK
+     static led_controller_t controller;
+     static led_scene_library_t library;
+     static led_scene_player_t player;
+     initialize_scene_playback(&controller, &library, &player);
+ #else
+     static render_ctx_t render_ctx;
+     initialize_render(&render_ctx);
+     static led_pipeline_t pipeline;
+     initialize_led_pipeline(&pipeline, &render_ctx);
+ #endif
+     led_mem_report();
+     
+ #if CONFIG_LED_SCENE_PLAYBACK
+     play_scene(&controller, &player);
+ #endif
+     // Rendering and sending run in their own tasks from here on
  }
\ No newline at end of file
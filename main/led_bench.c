@@ -0,0 +1,170 @@
+/**
+ * @file led_bench.c
+ * @brief Color conversion, symbol expansion and frame timing benchmarks
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "esp_check.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "soc/soc_caps.h"
+#include "led_bench.h"
+#include "led_color.h"
+#include "led_controller.h"
+#include "led_strip_encoder.h"
+
+static const char *TAG = "led_bench";
+
+#define LED_BENCH_COLOR_PIXELS  1000     // Pixels converted per color round
+#define LED_BENCH_COLOR_ROUNDS  10       // Color rounds, the fastest one is reported
+#define LED_BENCH_WARMUP_FRAMES 2        // Frames sent before measuring, first ones pay for cold caches
+#define LED_BENCH_FRAMES        20       // Frames measured per strip
+#define LED_BENCH_RESOLUTION_HZ 10000000 // Same as the demo
+
+static const size_t s_bench_lengths[] = { 1, 60, 300, 1000 };
+
+static uint16_t s_bench_hues[LED_BENCH_COLOR_PIXELS];
+static uint8_t s_bench_grb[LED_BENCH_COLOR_PIXELS * 3];
+
+/**
+ * @brief Cycles per pixel of both HSV converters, best of LED_BENCH_COLOR_ROUNDS
+ */
+static void led_bench_color(void)
+{
+    for (size_t i = 0; i < LED_BENCH_COLOR_PIXELS; i++) {
+        s_bench_hues[i] = (i * 7) % 360;
+    }
+    uint32_t best_single = UINT32_MAX;
+    uint32_t best_span = UINT32_MAX;
+    for (int round = 0; round < LED_BENCH_COLOR_ROUNDS; round++) {
+        esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+        for (size_t i = 0; i < LED_BENCH_COLOR_PIXELS; i++) {
+            led_color_hsv_to_grb(s_bench_hues[i], 100, 100, &s_bench_grb[i * 3]);
+        }
+        uint32_t single = esp_cpu_get_cycle_count() - start;
+
+        start = esp_cpu_get_cycle_count();
+        led_color_hsv_span_to_grb(s_bench_hues, LED_BENCH_COLOR_PIXELS, 100, 100, s_bench_grb);
+        uint32_t span = esp_cpu_get_cycle_count() - start;
+
+        best_single = single < best_single ? single : best_single;
+        best_span = span < best_span ? span : best_span;
+    }
+    printf("BENCH {\"name\": \"hsv_to_grb\", \"cycles_per_pixel\": %.2f}\n", (double)best_single / LED_BENCH_COLOR_PIXELS);
+    printf("BENCH {\"name\": \"hsv_span_to_grb\", \"cycles_per_pixel\": %.2f}\n", (double)best_span / LED_BENCH_COLOR_PIXELS);
+}
+
+/**
+ * @brief Controller for one strip, DMA buffers sized automatically
+ */
+static led_controller_config_t led_bench_config(int gpio_num, size_t pixel_count, bool with_dma)
+{
+    return (led_controller_config_t) {
+        .gpio_nums = { gpio_num },
+        .output_count = 1,
+        .pixel_count = pixel_count,
+        .resolution_hz = LED_BENCH_RESOLUTION_HZ,
+        .chip = LED_STRIP_CHIP_WS2812,
+        .mem_block_symbols = with_dma ? 0 : 64,
+        .trans_queue_depth = 4,
+        .with_dma = with_dma,
+    };
+}
+
+#if SOC_RMT_SUPPORT_DMA
+/**
+ * @brief Bring up a DMA channel for every benchmarked length before measuring anything
+ *
+ * The automatic buffer size has to be one the driver accepts at both
+ * ends of the range, a single pixel included. Every length is tried and
+ * reported, so one failure doesn't hide the others.
+ */
+static esp_err_t led_bench_check_dma(int gpio_num)
+{
+    esp_err_t ret = ESP_OK;
+    static led_controller_t controller;
+    for (size_t i = 0; i < sizeof(s_bench_lengths) / sizeof(s_bench_lengths[0]); i++) {
+        led_controller_config_t config = led_bench_config(gpio_num, s_bench_lengths[i], true);
+        esp_err_t err = led_controller_init(&config, &controller);
+        printf("BENCH {\"name\": \"dma_channel\", \"pixels\": %u, \"ok\": %s}\n", (unsigned)s_bench_lengths[i],
+               err == ESP_OK ? "true" : "false");
+        if (err == ESP_OK) {
+            led_controller_deinit(&controller);
+        } else {
+            ESP_LOGE(TAG, "no DMA channel for %u pixels: %s", (unsigned)s_bench_lengths[i], esp_err_to_name(err));
+            ret = err;
+        }
+    }
+    return ret;
+}
+#endif
+
+/**
+ * @brief Send LED_BENCH_FRAMES frames one at a time and report what each cost
+ *
+ * Each frame is waited for before the next one goes out, so tx_us is the
+ * full submit-to-latched time of a single frame. Refills are callback
+ * invocations of the encoder, one per ping-pong (or DMA half-buffer)
+ * interrupt plus the first fill when the transaction starts.
+ */
+static esp_err_t led_bench_frames(int gpio_num, size_t pixel_count, bool with_dma)
+{
+    esp_err_t ret = ESP_OK;
+    // static: the TX-done ISR points at it
+    static led_controller_t controller;
+    led_controller_config_t config = led_bench_config(gpio_num, pixel_count, with_dma);
+    ESP_RETURN_ON_ERROR(led_controller_init(&config, &controller), TAG, "init for %u pixels failed", (unsigned)pixel_count);
+
+    uint32_t cycles_start = 0;
+    uint32_t calls_start = 0;
+    int64_t tx_total_us = 0;
+    int64_t tx_min_us = INT64_MAX;
+    for (int frame = -LED_BENCH_WARMUP_FRAMES; frame < LED_BENCH_FRAMES; frame++) {
+        led_framebuffer_t *fb = led_controller_back_buffer(&controller);
+        uint8_t grb[3] = { (uint8_t)frame, (uint8_t)(frame * 7), (uint8_t)(frame * 13) };
+        led_framebuffer_fill(fb, 0, pixel_count, grb);
+        if (frame == 0) {
+            rmt_led_strip_encoder_get_stats(controller.outputs[0].encoder, &cycles_start, &calls_start);
+        }
+        int64_t start_us = esp_timer_get_time();
+        ESP_GOTO_ON_ERROR(led_controller_swap_buffers(&controller, -1), out, TAG, "swap failed");
+        ESP_GOTO_ON_ERROR(led_controller_wait_done(&controller, -1), out, TAG, "wait failed");
+        int64_t tx_us = esp_timer_get_time() - start_us;
+        if (frame >= 0) {
+            tx_total_us += tx_us;
+            tx_min_us = tx_us < tx_min_us ? tx_us : tx_min_us;
+        }
+    }
+    uint32_t cycles_end, calls_end;
+    rmt_led_strip_encoder_get_stats(controller.outputs[0].encoder, &cycles_end, &calls_end);
+
+    const led_strip_timing_t *timing = led_strip_get_timing(config.chip);
+    uint32_t bit_ns = (timing->t0h_ns + timing->t0l_ns + timing->t1h_ns + timing->t1l_ns) / 2;
+    uint32_t wire_us = pixel_count * timing->bytes_per_pixel * 8 * bit_ns / 1000 + timing->reset_us;
+    printf("BENCH {\"name\": \"frame\", \"pixels\": %u, \"dma\": %s, \"tx_us\": %" PRId64 ", \"tx_min_us\": %" PRId64
+           ", \"wire_us\": %" PRIu32 ", \"encode_cycles_per_pixel\": %.2f, \"refills_per_frame\": %.2f}\n",
+           (unsigned)pixel_count, with_dma ? "true" : "false", tx_total_us / LED_BENCH_FRAMES, tx_min_us, wire_us,
+           (double)(cycles_end - cycles_start) / ((double)pixel_count * LED_BENCH_FRAMES),
+           (double)(calls_end - calls_start) / LED_BENCH_FRAMES);
+out:
+    led_controller_deinit(&controller);
+    return ret;
+}
+
+esp_err_t led_bench_run(int gpio_num)
+{
+    ESP_LOGI(TAG, "running benchmarks on GPIO %d", gpio_num);
+#if SOC_RMT_SUPPORT_DMA
+    ESP_RETURN_ON_ERROR(led_bench_check_dma(gpio_num), TAG, "DMA channel check failed");
+#endif
+    led_bench_color();
+    for (size_t i = 0; i < sizeof(s_bench_lengths) / sizeof(s_bench_lengths[0]); i++) {
+        ESP_RETURN_ON_ERROR(led_bench_frames(gpio_num, s_bench_lengths[i], false), TAG, "frame benchmark failed");
+#if SOC_RMT_SUPPORT_DMA
+        ESP_RETURN_ON_ERROR(led_bench_frames(gpio_num, s_bench_lengths[i], true), TAG, "frame benchmark failed");
+#endif
+    }
+    printf("BENCH_DONE\n");
+    return ESP_OK;
+}
@@ -0,0 +1,37 @@
+/**
+ * @file led_bench.h
+ * @brief On-device microbenchmarks for the color and output paths
+ *
+ * Built in place of the demo with CONFIG_LED_BENCHMARK. Every result is
+ * printed as one line
+ *
+ *     BENCH {"name": ..., ...}
+ *
+ * with a JSON object, followed by a final "BENCH_DONE" line, so a test
+ * runner can collect the numbers and compare them against a baseline.
+ */
+#pragma once
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Run every benchmark and print the results
+ *
+ * Drives the strip on gpio_num while it runs. Output interrupts land on
+ * the calling core.
+ *
+ * @param[in] gpio_num Data GPIO the frames are sent on
+ * @return
+ *      - ESP_ERR_NO_MEM out of memory for a strip under test
+ *      - Whatever the controller returned if a strip could not be driven
+ *      - ESP_OK if every benchmark ran
+ */
+esp_err_t led_bench_run(int gpio_num);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,117 @@
+/**
+ * @file led_boot.c
+ * @brief Boot frame with a copy encoder and a throwaway RMT channel
+ */
+
+#include "driver/rmt_tx.h"
+#include "esp_attr.h"
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "esp_private/esp_clk.h"
+#include "esp_timer.h"
+#include "led_boot.h"
+#include "soc/soc_caps.h"
+
+static const char *TAG = "led_boot";
+
+#define LED_BOOT_TIMEOUT_MS 1000
+
+static int64_t s_led_boot_done_us;          // esp_timer time the last transaction finished, set from the ISR
+static int64_t s_led_boot_first_frame_us = -1;
+
+static bool IRAM_ATTR led_boot_on_tx_done(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t *edata, void *user_ctx)
+{
+    s_led_boot_done_us = esp_timer_get_time();
+    return false;
+}
+
+esp_err_t led_boot_show(const led_boot_config_t *config)
+{
+    esp_err_t ret = ESP_OK;
+    rmt_channel_handle_t channel = NULL;
+    rmt_encoder_handle_t encoder = NULL;
+    rmt_symbol_word_t *frame_symbols = NULL;
+    bool enabled = false;
+    ESP_RETURN_ON_FALSE(config && config->pixel_count, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    const led_strip_timing_t *timing = config->timing ? config->timing : led_strip_get_timing(config->chip);
+    ESP_RETURN_ON_FALSE(timing, ESP_ERR_INVALID_ARG, TAG, "invalid chip");
+    led_strip_encoder_config_t encoder_config = {
+        .resolution = config->resolution_hz,
+        .lut = config->lut,
+        .chip = config->chip,
+        .timing = config->timing,
+    };
+
+    // one pixel of symbols plus the reset code, used as is when every pixel is the same
+    rmt_symbol_word_t pixel_symbols[LED_STRIP_FRAME_SYMBOLS(1, 4)];
+    const rmt_symbol_word_t *symbols;
+    size_t symbol_count;
+    rmt_transmit_config_t tx_config = {};
+    if (config->pixels) {
+        // temporary, straight from the heap so it doesn't stay in the arena
+        frame_symbols = heap_caps_malloc(LED_STRIP_FRAME_SYMBOLS(config->pixel_count, timing->bytes_per_pixel) *
+                                         sizeof(rmt_symbol_word_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        ESP_RETURN_ON_FALSE(frame_symbols, ESP_ERR_NO_MEM, TAG, "no mem for %u pixels", (unsigned)config->pixel_count);
+        ESP_GOTO_ON_ERROR(led_strip_encode_symbols(&encoder_config, config->pixels, config->pixel_count, frame_symbols,
+                                                   &symbol_count), err, TAG, "encode frame failed");
+        symbols = frame_symbols;
+    } else {
+        ESP_GOTO_ON_ERROR(led_strip_encode_symbols(&encoder_config, config->grb, 1, pixel_symbols, &symbol_count),
+                          err, TAG, "encode pixel failed");
+        symbols = pixel_symbols;
+    }
+    // the encoder puts the reset code after the pixel data
+    rmt_symbol_word_t reset_code = symbols[symbol_count - 1];
+    if (!config->pixels && config->pixel_count > 1) {
+        // the hardware sends the pixel pixel_count times back to back, without the reset code in between;
+        // the line idling low once the loop ends latches the frame
+        symbol_count--;
+        tx_config.loop_count = config->pixel_count;
+    }
+
+    rmt_tx_channel_config_t tx_chan_config = {
+        .clk_src = RMT_CLK_SRC_DEFAULT,
+        .gpio_num = config->gpio_num,
+        .mem_block_symbols = SOC_RMT_MEM_WORDS_PER_CHANNEL,
+        .resolution_hz = config->resolution_hz,
+        .trans_queue_depth = 2,
+    };
+    ESP_GOTO_ON_ERROR(rmt_new_tx_channel(&tx_chan_config, &channel), err, TAG, "create RMT TX channel failed");
+    rmt_copy_encoder_config_t copy_config = {};
+    ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_config, &encoder), err, TAG, "create copy encoder failed");
+    rmt_tx_event_callbacks_t cbs = {
+        .on_trans_done = led_boot_on_tx_done,
+    };
+    ESP_GOTO_ON_ERROR(rmt_tx_register_event_callbacks(channel, &cbs, NULL), err, TAG, "register tx callbacks failed");
+    ESP_GOTO_ON_ERROR(rmt_enable(channel), err, TAG, "enable RMT channel failed");
+    enabled = true;
+
+    // the line floated until now, a reset first so the strip doesn't take that for the start of the frame
+    rmt_transmit_config_t reset_config = {};
+    ESP_GOTO_ON_ERROR(rmt_transmit(channel, encoder, &reset_code, sizeof(rmt_symbol_word_t), &reset_config), err, TAG,
+                      "transmit reset failed");
+    ESP_GOTO_ON_ERROR(rmt_transmit(channel, encoder, symbols, symbol_count * sizeof(rmt_symbol_word_t), &tx_config),
+                      err, TAG, "transmit frame failed");
+    ESP_GOTO_ON_ERROR(rmt_tx_wait_all_done(channel, LED_BOOT_TIMEOUT_MS), err, TAG, "boot frame timed out");
+    // both clocks read now give the offset from esp_timer to time since power-on
+    int64_t rtc_offset_us = (int64_t)esp_clk_rtc_time() - esp_timer_get_time();
+    s_led_boot_first_frame_us = s_led_boot_done_us + rtc_offset_us + timing->reset_us;
+
+err:
+    if (enabled) {
+        rmt_disable(channel);
+    }
+    if (channel) {
+        rmt_del_channel(channel);
+    }
+    if (encoder) {
+        rmt_del_encoder(encoder);
+    }
+    heap_caps_free(frame_symbols);
+    return ret;
+}
+
+int64_t led_boot_first_frame_us(void)
+{
+    return s_led_boot_first_frame_us;
+}
@@ -0,0 +1,67 @@
+/**
+ * @file led_boot.h
+ * @brief Light the strip as early as possible after power-up
+ *
+ * The full pipeline takes a while before its first frame: framebuffers,
+ * the 8 KB encoder table, tasks, the scheduler. led_boot_show() does the
+ * least that puts a frame on the wire: the symbols are expanded up front
+ * into a plain buffer (a single pixel, looped by the RMT hardware, when
+ * the whole strip shows one color), sent with the driver's copy encoder
+ * and the channel is released again. The LEDs hold that frame until the
+ * pipeline sends its first one, so there is no dark gap at the handover.
+ *
+ * Call it first thing in app_main(). The bootloader side (logging, image
+ * checks) is trimmed in sdkconfig.ci.fastboot.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "led_strip_encoder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief What to show and where
+ */
+typedef struct {
+    int gpio_num;               /*!< Data pin */
+    led_strip_chip_t chip;      /*!< Chip to take the timing from */
+    const led_strip_timing_t *timing; /*!< Custom timing used instead of the chip's, NULL for none */
+    uint32_t resolution_hz;     /*!< RMT resolution */
+    size_t pixel_count;         /*!< Strip length */
+    const uint8_t *pixels;      /*!< Frame to show, pixel_count * 3 bytes GRB, NULL to show grb on every pixel */
+    uint8_t grb[3];             /*!< Color for every pixel when pixels is NULL */
+    const uint8_t *lut;         /*!< 256-entry output correction, NULL to send the values as they are */
+} led_boot_config_t;
+
+/**
+ * @brief Send one frame and release the GPIO for the pipeline
+ *
+ * Blocks until the frame is latched, one wire time of the strip.
+ *
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NO_MEM out of memory for the frame's symbols
+ *      - ESP_ERR_TIMEOUT the frame didn't finish
+ *      - ESP_OK if the frame is on the strip
+ */
+esp_err_t led_boot_show(const led_boot_config_t *config);
+
+/**
+ * @brief When the boot frame latched, in microseconds since power-on
+ *
+ * Counted on the RTC timer, so it covers the ROM, the bootloader and the
+ * app startup. After a software reset the RTC timer keeps running and
+ * the number includes the time before the reset.
+ *
+ * @return Time to the first frame, -1 if led_boot_show() didn't succeed
+ */
+int64_t led_boot_first_frame_us(void);
+
+#ifdef __cplusplus
+}
+#endif
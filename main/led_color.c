@@ -0,0 +1,74 @@
+/**
+ * @file led_color.c
+ * @brief Table-driven HSV to GRB conversion
+ *
+ * The float version computed, per channel, (C or X or 0) + m with
+ * C = V * S, X = C * a / 60 and m = V - C, where a is how far the hue is
+ * into its 60 degree sector. Pulling the percentages out, every channel is
+ *
+ *     V * (S * a + 60 * (100 - S)) * 255 / (100 * 100 * 60)
+ *
+ * with a = 60 for the dominant channel, 0 for the off one and the ramp
+ * for the third. The hue table stores a for G, R and B for every degree,
+ * so the only per-pixel work left is that one expression.
+ */
+
+#include "esp_attr.h"
+#include "led_color.h"
+
+#define LED_HUE_SECTOR 60 // degrees per sector, also the full-scale table value
+
+// Ramp channel: rises in even sectors, falls in odd ones
+#define LED_HUE_X(s, r) (((s) & 1) ? LED_HUE_SECTOR - (r) : (r))
+#define LED_HUE_G(s, r) (((s) == 0 || (s) == 3) ? LED_HUE_X(s, r) : (s) <= 2 ? LED_HUE_SECTOR : 0)
+#define LED_HUE_R(s, r) (((s) == 1 || (s) == 4) ? LED_HUE_X(s, r) : ((s) == 0 || (s) == 5) ? LED_HUE_SECTOR : 0)
+#define LED_HUE_B(s, r) (((s) == 2 || (s) == 5) ? LED_HUE_X(s, r) : ((s) == 3 || (s) == 4) ? LED_HUE_SECTOR : 0)
+#define LED_HUE(s, r) { LED_HUE_G(s, r), LED_HUE_R(s, r), LED_HUE_B(s, r) }
+#define LED_HUE_10(s, r) LED_HUE(s, r), LED_HUE(s, r + 1), LED_HUE(s, r + 2), LED_HUE(s, r + 3), LED_HUE(s, r + 4), \
+                         LED_HUE(s, r + 5), LED_HUE(s, r + 6), LED_HUE(s, r + 7), LED_HUE(s, r + 8), LED_HUE(s, r + 9)
+#define LED_HUE_60(s) LED_HUE_10(s, 0), LED_HUE_10(s, 10), LED_HUE_10(s, 20), \
+                      LED_HUE_10(s, 30), LED_HUE_10(s, 40), LED_HUE_10(s, 50)
+
+// Per-degree sector position of G, R and B, 0-60. DRAM so it's usable from ISRs too
+DRAM_ATTR static const uint8_t s_hue_table[360][3] = {
+    LED_HUE_60(0), LED_HUE_60(1), LED_HUE_60(2), LED_HUE_60(3), LED_HUE_60(4), LED_HUE_60(5),
+};
+
+static inline uint8_t led_color_level(uint32_t a, uint32_t s, uint32_t v)
+{
+    // fits in 32 bits: at most 100 * 6000 * 255
+    return (uint8_t)(v * (s * a + LED_HUE_SECTOR * (100 - s)) * 255 / (100 * 100 * LED_HUE_SECTOR));
+}
+
+static inline uint8_t led_color_percent(uint8_t p)
+{
+    return p > 100 ? 100 : p;
+}
+
+void led_color_hsv_to_grb(uint16_t h, uint8_t s, uint8_t v, uint8_t grb[3])
+{
+    const uint8_t *a = s_hue_table[h % 360];
+    s = led_color_percent(s);
+    v = led_color_percent(v);
+    grb[0] = led_color_level(a[0], s, v);
+    grb[1] = led_color_level(a[1], s, v);
+    grb[2] = led_color_level(a[2], s, v);
+}
+
+void led_color_hsv_span_to_grb(const uint16_t *hues, size_t count, uint8_t s, uint8_t v, uint8_t *grb)
+{
+    uint8_t levels[LED_HUE_SECTOR + 1];
+    s = led_color_percent(s);
+    v = led_color_percent(v);
+    for (uint32_t a = 0; a <= LED_HUE_SECTOR; a++) {
+        levels[a] = led_color_level(a, s, v);
+    }
+    for (size_t i = 0; i < count; i++) {
+        uint16_t h = hues[i];
+        const uint8_t *a = s_hue_table[h < 360 ? h : h % 360];
+        grb[0] = levels[a[0]];
+        grb[1] = levels[a[1]];
+        grb[2] = levels[a[2]];
+        grb += 3;
+    }
+}
@@ -0,0 +1,47 @@
+/**
+ * @file led_color.h
+ * @brief Integer-only color conversion for the LED pipeline
+ *
+ * No floats in here: hue lookups come from a 360-entry table in DRAM and
+ * saturation/value scaling is integer math, so converting a whole strip
+ * every frame stays cheap even without an FPU-friendly build.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Converts HSV color to GRB format for NeoPixel
+ *
+ * Same output as the old float version to within 1 LSB (this one rounds
+ * down exactly, the float one sometimes lost a bit to rounding error).
+ *
+ * @param[in] h Hue in degrees, wraps at 360
+ * @param[in] s Saturation in percent, 0-100
+ * @param[in] v Value in percent, 0-100
+ * @param[out] grb Color in WS2812 byte order
+ */
+void led_color_hsv_to_grb(uint16_t h, uint8_t s, uint8_t v, uint8_t grb[3]);
+
+/**
+ * @brief Converts a span of hues sharing one saturation and value
+ *
+ * Scaling is precomputed once per call, after that every pixel costs three
+ * table lookups, so this is the one to use for whole strips.
+ *
+ * @param[in] hues Hue of each pixel in degrees, wraps at 360
+ * @param[in] count Number of pixels
+ * @param[in] s Saturation in percent, 0-100
+ * @param[in] v Value in percent, 0-100
+ * @param[out] grb count * 3 bytes in WS2812 byte order, e.g. a framebuffer range
+ */
+void led_color_hsv_span_to_grb(const uint16_t *hues, size_t count, uint8_t s, uint8_t v, uint8_t *grb);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,89 @@
+/**
+ * @file led_command.c
+ * @brief Bounded MPSC ring with per-slot sequence numbers
+ */
+
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "led_command.h"
+#include "led_mem.h"
+
+static const char *TAG = "led_command";
+
+esp_err_t led_command_queue_init(led_command_queue_t *queue, size_t capacity)
+{
+    ESP_RETURN_ON_FALSE(queue && capacity && !(capacity & (capacity - 1)) && capacity <= UINT32_MAX / 2,
+                        ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    memset(queue, 0, sizeof(*queue));
+    // internal RAM, ISRs post into it
+    led_command_slot_t *slots = led_mem_calloc(capacity, sizeof(led_command_slot_t), 4,
+                                               MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    ESP_RETURN_ON_FALSE(slots, ESP_ERR_NO_MEM, TAG, "no mem for %u commands", (unsigned)capacity);
+    for (size_t i = 0; i < capacity; i++) {
+        atomic_init(&slots[i].sequence, i);
+    }
+    queue->mask = capacity - 1;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->dropped, 0);
+    queue->slots = slots;
+    return ESP_OK;
+}
+
+void led_command_queue_deinit(led_command_queue_t *queue)
+{
+    if (!queue) {
+        return;
+    }
+    led_mem_free(queue->slots);
+    memset(queue, 0, sizeof(*queue));
+}
+
+bool IRAM_ATTR led_command_post(led_command_queue_t *queue, const led_command_t *command)
+{
+    unsigned pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    led_command_slot_t *slot;
+    while (1) {
+        slot = &queue->slots[pos & queue->mask];
+        unsigned sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        int diff = (int)(sequence - pos);
+        if (diff == 0) {
+            // slot is free for pos, claim it; on failure pos is reloaded and we try the next one
+            if (atomic_compare_exchange_weak_explicit(&queue->head, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // still holds the command from one lap ago, the consumer hasn't caught up
+            atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+            return false;
+        } else {
+            // another producer got this one first
+            pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+        }
+    }
+    slot->command = *command;
+    // publish: the consumer reads the payload only after seeing pos + 1
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+    return true;
+}
+
+bool led_command_pop(led_command_queue_t *queue, led_command_t *ret_command)
+{
+    led_command_slot_t *slot = &queue->slots[queue->tail & queue->mask];
+    unsigned sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    if (sequence != queue->tail + 1) {
+        return false;
+    }
+    *ret_command = slot->command;
+    // free for the producer one lap ahead
+    atomic_store_explicit(&slot->sequence, queue->tail + queue->mask + 1, memory_order_release);
+    queue->tail++;
+    return true;
+}
+
+uint32_t led_command_take_dropped(led_command_queue_t *queue)
+{
+    return atomic_exchange_explicit(&queue->dropped, 0, memory_order_relaxed);
+}
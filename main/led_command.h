@@ -0,0 +1,127 @@
+/**
+ * @file led_command.h
+ * @brief Lock-free command queue into the render task
+ *
+ * Any number of tasks and ISRs post small commands, the render task
+ * drains them once per frame and applies them between frames. Posting
+ * never blocks and takes no lock (a bounded ring where each slot carries
+ * a sequence number, so producers only race on one compare-and-swap), so
+ * a low-priority poster can't hold the render task up and a full queue
+ * just reports the command as dropped.
+ */
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "led_effects.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief What a command does, the consumer decides how exactly
+ */
+typedef enum {
+    LED_COMMAND_FILL,           /*!< Paint a pixel range with one color, on top of the effect */
+    LED_COMMAND_BLIT,           /*!< Paint a pixel range from a buffer, on top of the effect */
+    LED_COMMAND_CLEAR,          /*!< Hand a pixel range back to the effect */
+    LED_COMMAND_SELECT_EFFECT,  /*!< Switch to another registered effect */
+    LED_COMMAND_SET_PARAMS,     /*!< Change the effect parameters */
+    LED_COMMAND_SET_BRIGHTNESS, /*!< Scale the whole frame */
+} led_command_type_t;
+
+/**
+ * @brief One command, copied into the queue
+ */
+typedef struct {
+    led_command_type_t type;    /*!< Which member below is valid */
+    union {
+        struct {
+            size_t start;       /*!< First pixel */
+            size_t count;       /*!< Pixels, clipped at the end of the strip */
+            uint8_t grb[3];     /*!< Color in wire order */
+        } fill;                 /*!< LED_COMMAND_FILL */
+        struct {
+            size_t start;       /*!< First pixel */
+            size_t count;       /*!< Pixels, clipped at the end of the strip */
+            const uint8_t *pixels; /*!< count * 3 bytes in wire order, must stay valid until done is called */
+            void (*done)(void *ctx); /*!< Called from the render task once pixels was copied, may be NULL */
+            void *ctx;          /*!< Passed to done */
+        } blit;                 /*!< LED_COMMAND_BLIT */
+        struct {
+            size_t start;       /*!< First pixel */
+            size_t count;       /*!< Pixels, clipped at the end of the strip */
+        } clear;                /*!< LED_COMMAND_CLEAR */
+        size_t effect;          /*!< LED_COMMAND_SELECT_EFFECT: registry index */
+        led_effect_params_t params; /*!< LED_COMMAND_SET_PARAMS */
+        uint8_t brightness;     /*!< LED_COMMAND_SET_BRIGHTNESS: 255 is full scale */
+    };
+} led_command_t;
+
+/**
+ * @brief Queue slot, the sequence number says whose turn it is
+ */
+typedef struct {
+    atomic_uint sequence;       /*!< Position this slot is free for (== pos) or holds (== pos + 1) */
+    led_command_t command;      /*!< Payload */
+} led_command_slot_t;
+
+/**
+ * @brief Multi-producer, single-consumer command queue
+ */
+typedef struct {
+    led_command_slot_t *slots;  /*!< Ring, a power of two long */
+    uint32_t mask;              /*!< Capacity - 1 */
+    atomic_uint head;           /*!< Next position a producer claims */
+    uint32_t tail;              /*!< Next position the consumer reads, consumer only */
+    atomic_uint dropped;        /*!< Posts that found the queue full */
+} led_command_queue_t;
+
+/**
+ * @brief Allocate the ring
+ *
+ * @param[out] queue Queue to initialize
+ * @param[in] capacity Commands the queue holds, a power of two
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NO_MEM out of memory
+ *      - ESP_OK if the queue is ready
+ */
+esp_err_t led_command_queue_init(led_command_queue_t *queue, size_t capacity);
+
+/**
+ * @brief Free the ring, nothing may post anymore
+ */
+void led_command_queue_deinit(led_command_queue_t *queue);
+
+/**
+ * @brief Queue a command, from any task or ISR
+ *
+ * The command is copied. Never blocks.
+ *
+ * @return true if queued, false if the queue was full (counted as dropped)
+ */
+bool led_command_post(led_command_queue_t *queue, const led_command_t *command);
+
+/**
+ * @brief Take the oldest command, consumer only
+ *
+ * Commands come out in the order their posts claimed a slot, a post
+ * that is still copying holds back the ones after it until it is done.
+ *
+ * @return true if ret_command was filled, false if nothing is ready
+ */
+bool led_command_pop(led_command_queue_t *queue, led_command_t *ret_command);
+
+/**
+ * @brief Posts dropped because the queue was full, and reset the count
+ */
+uint32_t led_command_take_dropped(led_command_queue_t *queue);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,946 @@
+/**
+ * @file led_controller.c
+ * @brief Backend setup and double-buffered frame submission
+ */
+
+#include <math.h>
+#include <string.h>
+#include "esp_check.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_rom_crc.h"
+#include "esp_rom_sys.h"
+#include "esp_pm.h"
+#include "esp_heap_caps.h"
+#include "soc/soc_caps.h"
+#include "led_controller.h"
+#include "led_mem.h"
+#include "led_strip_encoder.h"
+
+static const char *TAG = "led_ctrl";
+
+static TickType_t led_controller_ticks(int timeout_ms)
+{
+    return timeout_ms < 0 ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+}
+
+/**
+ * @brief Symbol buffer size for a channel
+ *
+ * Without DMA the symbols are the channel's own memory and the caller's
+ * value is used as-is. With DMA, a buffer big enough for a whole frame
+ * plus the reset code means one refill per frame; longer strips are
+ * capped at LED_CONTROLLER_DMA_MAX_SYMBOLS. The driver takes nothing
+ * smaller than SOC_RMT_MEM_WORDS_PER_CHANNEL even with DMA, so short
+ * strips get that much.
+ */
+static size_t led_controller_mem_symbols(const led_controller_config_t *config, bool with_dma, size_t pixel_count)
+{
+    if (!with_dma || config->mem_block_symbols) {
+        return config->mem_block_symbols;
+    }
+    const led_strip_timing_t *timing = config->timing ? config->timing : led_strip_get_timing(config->chip);
+    size_t frame_symbols = pixel_count * timing->bytes_per_pixel * 8 + 1;
+    if (frame_symbols > LED_CONTROLLER_DMA_MAX_SYMBOLS) {
+        return LED_CONTROLLER_DMA_MAX_SYMBOLS;
+    }
+    if (frame_symbols < SOC_RMT_MEM_WORDS_PER_CHANNEL) {
+        frame_symbols = SOC_RMT_MEM_WORDS_PER_CHANNEL;
+    }
+    // the driver splits the buffer into two halves, keep it even
+    return (frame_symbols + 1) & ~(size_t)1;
+}
+
+/**
+ * @brief RMT TX-done ISR of every output, the last one to finish releases the front buffer
+ */
+static bool IRAM_ATTR led_controller_on_tx_done(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t *edata, void *user_ctx)
+{
+    led_controller_t *controller = (led_controller_t *)user_ctx;
+    BaseType_t task_woken = pdFALSE;
+    if (atomic_fetch_sub(&controller->pending_outputs, 1) == 1) {
+        controller->done_us = esp_timer_get_time();
+        if (controller->pm_lock) {
+            esp_pm_lock_release(controller->pm_lock);
+        }
+        xSemaphoreGiveFromISR(controller->tx_done, &task_woken);
+    }
+    return task_woken == pdTRUE;
+}
+
+/**
+ * @brief i80 frame-done ISR, same job as the RMT one for the single bus transaction
+ */
+static bool IRAM_ATTR led_controller_on_i80_done(void *user_ctx)
+{
+    return led_controller_on_tx_done(NULL, NULL, user_ctx);
+}
+
+/**
+ * @brief RMT clock, XTAL with power_save so the bit timing doesn't move with DFS
+ *
+ * An APB-clocked channel pins the APB at its maximum for as long as it is
+ * enabled, which rules out frequency scaling and light sleep altogether.
+ */
+static rmt_clock_source_t led_controller_clk_src(const led_controller_config_t *config)
+{
+#if SOC_RMT_SUPPORT_XTAL
+    if (config->power_save) {
+        return RMT_CLK_SRC_XTAL;
+    }
+#endif
+    return RMT_CLK_SRC_DEFAULT;
+}
+
+static esp_err_t led_controller_init_output(const led_controller_config_t *config, led_controller_t *controller, size_t index)
+{
+    led_controller_output_t *output = &controller->outputs[index];
+    output->first_pixel = led_framebuffer_slice_start(config->pixel_count, config->output_count, index);
+    output->pixel_count = led_framebuffer_slice_start(config->pixel_count, config->output_count, index + 1) - output->first_pixel;
+
+    bool with_dma = config->with_dma && index == 0;
+    rmt_tx_channel_config_t tx_chan_config = {
+        .clk_src = led_controller_clk_src(config),
+        .gpio_num = config->gpio_nums[index],
+        .mem_block_symbols = led_controller_mem_symbols(config, with_dma, output->pixel_count),
+        .resolution_hz = config->resolution_hz,
+        .trans_queue_depth = config->trans_queue_depth,
+        .flags.with_dma = with_dma,
+    };
+    ESP_RETURN_ON_ERROR(rmt_new_tx_channel(&tx_chan_config, &output->channel), TAG, "create RMT TX channel failed");
+    ESP_LOGI(TAG, "RMT TX on GPIO %d: pixels %u..%u, %u symbols%s", config->gpio_nums[index], (unsigned)output->first_pixel,
+             (unsigned)(output->first_pixel + output->pixel_count - 1), (unsigned)tx_chan_config.mem_block_symbols,
+             with_dma ? " (DMA)" : "");
+
+    led_strip_encoder_config_t encoder_config = {
+        .resolution = config->resolution_hz,
+        .chip = config->chip,
+        .timing = config->timing,
+    };
+    ESP_RETURN_ON_ERROR(rmt_new_led_strip_encoder(&encoder_config, &output->encoder), TAG, "create led strip encoder failed");
+    rmt_copy_encoder_config_t copy_config = {};
+    ESP_RETURN_ON_ERROR(rmt_new_copy_encoder(&copy_config, &output->copy_encoder), TAG, "create copy encoder failed");
+
+    // callbacks can only be registered while the channel is still disabled
+    rmt_tx_event_callbacks_t cbs = {
+        .on_trans_done = led_controller_on_tx_done,
+    };
+    ESP_RETURN_ON_ERROR(rmt_tx_register_event_callbacks(output->channel, &cbs, controller), TAG, "register tx callbacks failed");
+    ESP_RETURN_ON_ERROR(rmt_enable(output->channel), TAG, "enable RMT channel failed");
+    return ESP_OK;
+}
+
+static esp_err_t led_controller_init_i80(const led_controller_config_t *config, led_controller_t *controller)
+{
+    for (size_t i = 0; i < config->output_count; i++) {
+        led_controller_output_t *output = &controller->outputs[i];
+        output->first_pixel = led_framebuffer_slice_start(config->pixel_count, config->output_count, i);
+        output->pixel_count = led_framebuffer_slice_start(config->pixel_count, config->output_count, i + 1) - output->first_pixel;
+    }
+    led_i80_output_config_t i80_config = {
+        .data_gpio_nums = config->gpio_nums,
+        .lane_count = config->output_count,
+        .wr_gpio_num = config->i80.wr_gpio_num,
+        .dc_gpio_num = config->i80.dc_gpio_num,
+        .pixel_count = config->pixel_count,
+        .on_done = led_controller_on_i80_done,
+        .user_ctx = controller,
+    };
+    ESP_RETURN_ON_ERROR(led_i80_output_new(&i80_config, &controller->i80), TAG, "create i80 output failed");
+    controller->output_count = config->output_count;
+    return ESP_OK;
+}
+
+/**
+ * @brief Symbols of one output's held frame, 0 for none
+ */
+static size_t led_controller_hold_symbols(const led_controller_t *controller, size_t index)
+{
+    const led_strip_timing_t *timing = controller->hold_encoder.timing ? controller->hold_encoder.timing :
+                                       led_strip_get_timing(controller->hold_encoder.chip);
+    return LED_STRIP_FRAME_SYMBOLS(controller->outputs[index].pixel_count, timing->bytes_per_pixel);
+}
+
+/**
+ * @brief Set up held frames if every output's frame fits its channel memory
+ *
+ * Loops are replayed from channel memory, nothing refills it, so the
+ * whole frame and the driver's end marker have to be in there at once.
+ */
+static esp_err_t led_controller_init_hold(const led_controller_config_t *config, led_controller_t *controller)
+{
+#if SOC_RMT_SUPPORT_TX_LOOP_COUNT
+    controller->hold_encoder = (led_strip_encoder_config_t) {
+        .resolution = config->resolution_hz,
+        .chip = config->chip,
+        .timing = config->timing,
+    };
+    size_t total = 0;
+    size_t longest = 0;
+    for (size_t i = 0; i < controller->output_count; i++) {
+        size_t symbols = led_controller_hold_symbols(controller, i);
+        if ((config->with_dma && i == 0) || symbols >= config->mem_block_symbols) {
+            return ESP_OK;
+        }
+        total += symbols;
+        longest = symbols > longest ? symbols : longest;
+    }
+    const led_strip_timing_t *timing = config->timing ? config->timing : led_strip_get_timing(config->chip);
+    uint32_t bit_ns = timing->t0h_ns + timing->t0l_ns;
+    bit_ns = timing->t1h_ns + timing->t1l_ns > bit_ns ? timing->t1h_ns + timing->t1l_ns : bit_ns;
+    controller->hold_gap_us = timing->reset_us;
+    controller->hold_pass_us = (longest * bit_ns + 999) / 1000 + timing->reset_us;
+    controller->hold_symbols = led_mem_calloc(total, sizeof(rmt_symbol_word_t), 4, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    ESP_RETURN_ON_FALSE(controller->hold_symbols, ESP_ERR_NO_MEM, TAG, "no mem for held frame");
+#endif
+    return ESP_OK;
+}
+
+/**
+ * @brief Cut the hardware loop off, the tx_done token stays with the caller
+ */
+static void led_controller_stop_hold(led_controller_t *controller)
+{
+    // disabling aborts the endless transaction, the channel is ready again right after
+    for (size_t i = 0; i < controller->output_count; i++) {
+        rmt_disable(controller->outputs[i].channel);
+        rmt_enable(controller->outputs[i].channel);
+    }
+    // the pass may have stopped mid-frame, the line has to idle long enough to latch before the next one
+    esp_rom_delay_us(controller->hold_gap_us);
+    controller->holding = false;
+}
+
+static void led_controller_release(led_controller_t *controller)
+{
+    if (controller->report_timer) {
+        esp_timer_stop(controller->report_timer);
+        esp_timer_delete(controller->report_timer);
+    }
+    if (controller->sync_manager) {
+        rmt_del_sync_manager(controller->sync_manager);
+    }
+    if (controller->i80) {
+        led_i80_output_del(controller->i80);
+    }
+    for (size_t i = 0; i < LED_CONTROLLER_MAX_OUTPUTS; i++) {
+        led_controller_output_t *output = &controller->outputs[i];
+        if (output->encoder) {
+            rmt_del_encoder(output->encoder);
+        }
+        if (output->copy_encoder) {
+            rmt_del_encoder(output->copy_encoder);
+        }
+        if (output->channel) {
+            rmt_disable(output->channel);
+            rmt_del_channel(output->channel);
+        }
+    }
+    if (controller->tx_done) {
+        vSemaphoreDelete(controller->tx_done);
+    }
+    for (int i = 0; i < 2; i++) {
+        led_framebuffer_deinit(&controller->frames[i]);
+    }
+    led_dither_deinit(&controller->dither);
+    led_symbol_cache_deinit(&controller->symbol_cache);
+    led_mem_free(controller->hold_symbols);
+    led_mem_free(controller->shown);
+    if (controller->pm_lock) {
+        esp_pm_lock_delete(controller->pm_lock);
+    }
+    memset(controller, 0, sizeof(*controller));
+}
+
+/**
+ * @brief Load the configured correction, before any frame can go out uncorrected
+ */
+static esp_err_t led_controller_init_correction(const led_controller_config_t *config, led_controller_t *controller)
+{
+    if (config->gamma <= 0) {
+        return ESP_OK;
+    }
+    // nothing is on the wire yet, the token is free
+    return led_controller_set_correction(controller, config->gamma, config->brightness, 0);
+}
+
+esp_err_t led_controller_init(const led_controller_config_t *config, led_controller_t *controller)
+{
+    esp_err_t ret = ESP_OK;
+    ESP_RETURN_ON_FALSE(config && controller, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    size_t max_outputs = config->backend == LED_CONTROLLER_BACKEND_I80 ? LED_I80_MAX_LANES : LED_CONTROLLER_MAX_RMT_OUTPUTS;
+    ESP_RETURN_ON_FALSE(config->output_count && config->output_count <= max_outputs, ESP_ERR_INVALID_ARG,
+                        TAG, "invalid output count %u", (unsigned)config->output_count);
+    ESP_RETURN_ON_FALSE(config->pixel_count >= config->output_count, ESP_ERR_INVALID_ARG, TAG, "fewer pixels than outputs");
+    const led_strip_timing_t *timing = config->timing ? config->timing : led_strip_get_timing(config->chip);
+    ESP_RETURN_ON_FALSE(timing, ESP_ERR_INVALID_ARG, TAG, "invalid chip %d", (int)config->chip);
+    ESP_RETURN_ON_FALSE(config->backend != LED_CONTROLLER_BACKEND_I80 || (!config->timing && timing->bytes_per_pixel == 3),
+                        ESP_ERR_NOT_SUPPORTED, TAG, "i80 backend only drives 3-byte chips at its fixed timing");
+#if !SOC_RMT_SUPPORT_DMA
+    ESP_RETURN_ON_FALSE(!config->with_dma, ESP_ERR_NOT_SUPPORTED, TAG, "RMT DMA not supported on this target");
+#endif
+    memset(controller, 0, sizeof(*controller));
+
+    for (int i = 0; i < 2; i++) {
+        ESP_GOTO_ON_ERROR(led_framebuffer_init(&controller->frames[i], config->pixel_count), err, TAG, "create framebuffer failed");
+    }
+    if (config->dither) {
+        ESP_GOTO_ON_ERROR(led_dither_init(&controller->dither, config->pixel_count), err, TAG, "create dither frame failed");
+    }
+
+    // Binary semaphore doubles as the "nothing on the wire" token, start out with it available
+    controller->tx_done = xSemaphoreCreateBinaryStatic(&controller->tx_done_buffer);
+    xSemaphoreGive(controller->tx_done);
+
+    portMUX_INITIALIZE(&controller->stats_lock);
+    controller->window_start_us = esp_timer_get_time();
+    controller->skip_unchanged = config->skip_unchanged;
+    controller->refresh_us = (int64_t)config->refresh_ms * 1000;
+    controller->backend = config->backend;
+    if (config->backend == LED_CONTROLLER_BACKEND_I80) {
+        ESP_GOTO_ON_ERROR(led_controller_init_i80(config, controller), err, TAG, "init i80 output failed");
+        ESP_GOTO_ON_ERROR(led_controller_init_correction(config, controller), err, TAG, "load correction failed");
+        return ESP_OK;
+    }
+
+    controller->power_save = config->power_save;
+    if (config->power_save) {
+        // without CONFIG_PM_ENABLE there is nothing to hold, frames just go out without a lock
+        esp_err_t pm_ret = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "led_tx", &controller->pm_lock);
+        ESP_GOTO_ON_FALSE(pm_ret == ESP_OK || pm_ret == ESP_ERR_NOT_SUPPORTED, pm_ret, err, TAG, "create pm lock failed");
+    }
+    for (size_t i = 0; i < config->output_count; i++) {
+        ESP_GOTO_ON_ERROR(led_controller_init_output(config, controller, i), err, TAG, "init output %u failed", (unsigned)i);
+    }
+    controller->output_count = config->output_count;
+    if (config->symbol_cache_bytes) {
+        led_symbol_cache_config_t cache_config = {
+            .budget_bytes = config->symbol_cache_bytes,
+            .encoder = {
+                .resolution = config->resolution_hz,
+                .chip = config->chip,
+                .timing = config->timing,
+            },
+            .segment_count = config->output_count,
+        };
+        for (size_t i = 0; i < config->output_count; i++) {
+            cache_config.segment_pixels[i] = controller->outputs[i].pixel_count;
+        }
+        ESP_GOTO_ON_ERROR(led_symbol_cache_init(&controller->symbol_cache, &cache_config), err, TAG,
+                          "create symbol cache failed");
+    }
+    ESP_GOTO_ON_ERROR(led_controller_init_hold(config, controller), err, TAG, "init held frames failed");
+    if (config->sparse) {
+        controller->shown = led_mem_calloc(config->pixel_count, LED_FRAMEBUFFER_BYTES_PER_PIXEL, 4,
+                                           MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        ESP_GOTO_ON_FALSE(controller->shown, ESP_ERR_NO_MEM, err, TAG, "no mem for sparse updates");
+    }
+    controller->hold_unchanged = config->hold_unchanged && controller->hold_symbols;
+
+    if (controller->output_count > 1) {
+        // channels have to be enabled before they can join a sync manager
+        rmt_channel_handle_t channels[LED_CONTROLLER_MAX_OUTPUTS];
+        for (size_t i = 0; i < controller->output_count; i++) {
+            channels[i] = controller->outputs[i].channel;
+        }
+        rmt_sync_manager_config_t sync_config = {
+            .tx_channel_array = channels,
+            .array_size = controller->output_count,
+        };
+        ESP_GOTO_ON_ERROR(rmt_new_sync_manager(&sync_config, &controller->sync_manager), err, TAG, "create sync manager failed");
+    }
+    ESP_GOTO_ON_ERROR(led_controller_init_correction(config, controller), err, TAG, "load correction failed");
+    return ESP_OK;
+err:
+    led_controller_release(controller);
+    return ret;
+}
+
+esp_err_t led_controller_deinit(led_controller_t *controller)
+{
+    ESP_RETURN_ON_FALSE(controller && controller->output_count, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_ERROR(led_controller_wait_done(controller, -1), TAG, "wait for tx done failed");
+    if (controller->holding) {
+        led_controller_stop_hold(controller);
+    }
+    led_controller_release(controller);
+    return ESP_OK;
+}
+
+static inline void led_controller_record(uint32_t *last, uint32_t *max, int64_t value)
+{
+    *last = (uint32_t)value;
+    if (*last > *max) {
+        *max = *last;
+    }
+}
+
+/**
+ * @brief Wait until nothing is on the wire, then book the timing of the frame that just finished
+ */
+static esp_err_t led_controller_fence(led_controller_t *controller, int timeout_ms)
+{
+    led_controller_stats_t *stats = &controller->stats;
+    if (controller->holding) {
+        // a loop never finishes on its own, there is no frame timing to book
+        led_controller_stop_hold(controller);
+        return ESP_OK;
+    }
+    int64_t start_us = esp_timer_get_time();
+    if (xSemaphoreTake(controller->tx_done, 0) != pdTRUE) {
+        stats->late_frames++;
+        if (xSemaphoreTake(controller->tx_done, led_controller_ticks(timeout_ms)) != pdTRUE) {
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+    led_controller_record(&stats->wait_us, &stats->wait_max_us, esp_timer_get_time() - start_us);
+    if (controller->submit_us) {
+        led_controller_record(&stats->tx_latency_us, &stats->tx_latency_max_us, controller->done_us - controller->submit_us);
+    }
+    if (!controller->i80) {
+        uint32_t cycles_total = 0;
+        for (size_t i = 0; i < controller->output_count; i++) {
+            uint32_t cycles, calls;
+            rmt_led_strip_encoder_get_stats(controller->outputs[i].encoder, &cycles, &calls);
+            cycles_total += cycles;
+        }
+        stats->encode_cycles = cycles_total - controller->encode_cycles_seen;
+        controller->encode_cycles_seen = cycles_total;
+    }
+    if (controller->idle) {
+        // led_controller_idle() took the channels down, they take their PM locks again here
+        for (size_t i = 0; i < controller->output_count; i++) {
+            rmt_enable(controller->outputs[i].channel);
+        }
+        controller->idle = false;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Remember what the strip shows once frame is on its way, for sparse updates
+ *
+ * Pixels past an output's prefix weren't sent but matched already, so the
+ * whole frame is what the strip shows.
+ */
+static void led_controller_update_shown(led_controller_t *controller, const led_framebuffer_t *frame)
+{
+    if (controller->shown) {
+        memcpy(controller->shown, frame->pixels, led_framebuffer_size(frame));
+        controller->shown_valid = true;
+    }
+}
+
+/**
+ * @brief Pixels each output has to send, its whole slice unless sparse allows less
+ *
+ * An output only needs to go as far as its last pixel that differs from
+ * what it shows. Every output sends at least one pixel, the sync manager
+ * only starts once each of them has a transaction.
+ *
+ * @return Whether every output sends its whole slice
+ */
+static bool led_controller_prefix(const led_controller_t *controller, const led_framebuffer_t *frame, bool sparse,
+                                  size_t *counts)
+{
+    bool whole = true;
+    for (size_t i = 0; i < controller->output_count; i++) {
+        const led_controller_output_t *output = &controller->outputs[i];
+        size_t count = output->pixel_count;
+        if (sparse) {
+            const uint8_t *now = &frame->pixels[output->first_pixel * LED_FRAMEBUFFER_BYTES_PER_PIXEL];
+            const uint8_t *was = &controller->shown[output->first_pixel * LED_FRAMEBUFFER_BYTES_PER_PIXEL];
+            while (count > 1 && !memcmp(&now[(count - 1) * LED_FRAMEBUFFER_BYTES_PER_PIXEL],
+                                        &was[(count - 1) * LED_FRAMEBUFFER_BYTES_PER_PIXEL],
+                                        LED_FRAMEBUFFER_BYTES_PER_PIXEL)) {
+                count--;
+            }
+        }
+        counts[i] = count;
+        whole = whole && count == output->pixel_count;
+    }
+    return whole;
+}
+
+/**
+ * @brief CRC32 of frame, without reading it if nothing was written since it went out
+ */
+static uint32_t led_controller_frame_crc(const led_controller_t *controller, const led_framebuffer_t *frame)
+{
+    if (frame == controller->sent_frame && controller->sent_crc_valid && !led_framebuffer_is_dirty(frame)) {
+        return controller->sent_crc;
+    }
+    return esp_rom_crc32_le(0, frame->pixels, led_framebuffer_size(frame));
+}
+
+/**
+ * @brief Bookkeeping once frame is fully on its way
+ */
+static void led_controller_sent(led_controller_t *controller, led_framebuffer_t *frame, uint32_t crc)
+{
+    led_framebuffer_clear_dirty(frame);
+    led_controller_update_shown(controller, frame);
+    controller->sent_crc = crc;
+    controller->sent_frame = frame;
+    controller->sent_crc_valid = controller->skip_unchanged;
+    controller->sent_us = controller->submit_us;
+    controller->hold_released = false;
+}
+
+/**
+ * @brief Encode frame and loop it on every output, called holding the tx_done token
+ *
+ * Gives the token back on error, on success the loop keeps it until
+ * led_controller_stop_hold().
+ */
+static esp_err_t led_controller_start_hold(led_controller_t *controller, const led_framebuffer_t *frame, uint32_t crc)
+{
+    esp_err_t ret = ESP_OK;
+    size_t started = 0;
+    rmt_symbol_word_t *symbols = controller->hold_symbols;
+    size_t symbol_counts[LED_CONTROLLER_MAX_RMT_OUTPUTS];
+    for (size_t i = 0; i < controller->output_count; i++) {
+        const led_controller_output_t *output = &controller->outputs[i];
+        ESP_GOTO_ON_ERROR(led_strip_encode_symbols(&controller->hold_encoder,
+                                                   &frame->pixels[output->first_pixel * LED_FRAMEBUFFER_BYTES_PER_PIXEL],
+                                                   output->pixel_count, symbols, &symbol_counts[i]), err, TAG,
+                          "encode held frame failed");
+        symbols += symbol_counts[i];
+    }
+    if (controller->sync_manager) {
+        rmt_sync_reset(controller->sync_manager);
+    }
+    rmt_transmit_config_t tx_config = {
+        .loop_count = -1,
+    };
+    symbols = controller->hold_symbols;
+    for (; started < controller->output_count; started++) {
+        const led_controller_output_t *output = &controller->outputs[started];
+        ESP_GOTO_ON_ERROR(rmt_transmit(output->channel, output->copy_encoder, symbols,
+                                       symbol_counts[started] * sizeof(rmt_symbol_word_t), &tx_config),
+                          err, TAG, "start loop on output %u failed", (unsigned)started);
+        symbols += symbol_counts[started];
+    }
+    controller->holding = true;
+    controller->hold_released = false;
+    controller->hold_start_us = esp_timer_get_time();
+    // no TX-done will come for the loop, keep it out of the latency figures
+    controller->submit_us = 0;
+    controller->stats.held_frames++;
+    if (controller->symbol_cache.slot_count) {
+        led_symbol_cache_sending(&controller->symbol_cache, NULL);
+    }
+    controller->sent_crc = crc;
+    controller->sent_frame = frame;
+    controller->sent_crc_valid = controller->skip_unchanged;
+    controller->stats.sent_pixels = controller->frames[0].pixel_count;
+    led_controller_update_shown(controller, frame);
+    return ESP_OK;
+err:
+    if (started) {
+        controller->holding = true;
+        led_controller_stop_hold(controller);
+    }
+    xSemaphoreGive(controller->tx_done);
+    return ret;
+}
+
+/**
+ * @brief Fence, then put frame on every output
+ *
+ * started tells the caller whether any output is reading frame now, even
+ * on error: a partial start still needs the frame kept intact.
+ */
+static esp_err_t led_controller_submit(led_controller_t *controller, led_framebuffer_t *frame, int timeout_ms,
+                                       bool *started, bool *held)
+{
+    *started = false;
+    *held = false;
+    // hashed before the fence, while the previous frame is still going out
+    uint32_t crc = 0;
+    bool same = false;
+    bool unchanged = false;
+    led_symbol_cache_t *cache = controller->symbol_cache.slot_count ? &controller->symbol_cache : NULL;
+    if (controller->skip_unchanged || cache) {
+        crc = led_controller_frame_crc(controller, frame);
+        same = controller->skip_unchanged && controller->sent_crc_valid && crc == controller->sent_crc;
+        if (same && controller->holding) {
+            // the hardware keeps refreshing it, leave the loop alone
+            return ESP_OK;
+        }
+        // with hold_unchanged a repeat goes into the loop instead of being skipped, unless
+        // led_controller_idle() already latched it and let the loop go
+        bool holds = controller->hold_unchanged && !controller->hold_released;
+        unchanged = same && !holds &&
+                    (!controller->refresh_us || esp_timer_get_time() - controller->sent_us < controller->refresh_us);
+        *held = same && holds;
+    }
+    bool hold = *held;
+    size_t counts[LED_CONTROLLER_MAX_RMT_OUTPUTS];
+    bool whole = true;
+    if (!controller->i80 && !unchanged && !hold) {
+        // compared against what is going out right now, which is what the strip shows next;
+        // a keepalive resend (same frame, not skipped) is there to repair the strip and goes out whole
+        whole = led_controller_prefix(controller, frame, controller->shown_valid && !same, counts);
+    }
+    if (controller->i80 && !unchanged) {
+        // the transpose goes into the idle DMA buffer, so it can run before the fence
+        esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+        led_i80_output_prepare(controller->i80, frame->pixels);
+        controller->stats.encode_cycles = esp_cpu_get_cycle_count() - start;
+    }
+
+    // Fence: the frame sent last time may be handed back for rendering, so it must be off the wire first
+    esp_err_t fence_ret = led_controller_fence(controller, timeout_ms);
+    if (fence_ret != ESP_OK) {
+        return fence_ret;
+    }
+    if (unchanged) {
+        // the strip already shows this, hand the token straight back
+        xSemaphoreGive(controller->tx_done);
+        return ESP_OK;
+    }
+    if (hold) {
+        // second time in a row, let the hardware take over the refreshing
+        led_framebuffer_clear_dirty(frame);
+        return led_controller_start_hold(controller, frame, crc);
+    }
+    // under the token like led_symbol_cache_set_lut(), so a frame admitted now can't keep the old table's
+    // symbols; a hit is a compare, only admission (second sighting) encodes while the wire is idle
+    const rmt_symbol_word_t *symbols = NULL;
+    if (cache && whole) {
+        symbols = led_symbol_cache_get(cache, frame->pixels, crc);
+    }
+    if (controller->sync_manager) {
+        // every output finished the last round, re-arm the synchronized start
+        rmt_sync_reset(controller->sync_manager);
+    }
+    controller->submit_us = esp_timer_get_time();
+    // invalid until the frame is fully on its way, a partial send leaves the strip in an unknown state
+    controller->sent_crc_valid = false;
+    controller->shown_valid = false;
+
+    if (controller->i80) {
+        atomic_store(&controller->pending_outputs, 1);
+        esp_err_t ret = led_i80_output_start(controller->i80);
+        if (ret != ESP_OK) {
+            xSemaphoreGive(controller->tx_done);
+            return ret;
+        }
+        *started = true;
+        controller->stats.sent_pixels = frame->pixel_count;
+        led_controller_sent(controller, frame, crc);
+        return ESP_OK;
+    }
+
+    rmt_transmit_config_t tx_config = {
+        .loop_count = 0,
+    };
+    if (cache) {
+        led_symbol_cache_sending(cache, symbols);
+    }
+    if (controller->pm_lock) {
+        // full speed for the refill ISR until the last output is done, the TX-done ISR lets go
+        esp_pm_lock_acquire(controller->pm_lock);
+    }
+    atomic_store(&controller->pending_outputs, controller->output_count);
+    size_t sent_pixels = 0;
+    for (size_t i = 0; i < controller->output_count; i++) {
+        led_controller_output_t *output = &controller->outputs[i];
+        esp_err_t ret;
+        sent_pixels += counts[i];
+        if (symbols) {
+            size_t symbol_count;
+            const rmt_symbol_word_t *segment = led_symbol_cache_segment(cache, symbols, i, &symbol_count);
+            ret = rmt_transmit(output->channel, output->copy_encoder, segment, symbol_count * sizeof(rmt_symbol_word_t),
+                               &tx_config);
+        } else {
+            ret = rmt_transmit(output->channel, output->encoder,
+                               &frame->pixels[output->first_pixel * LED_FRAMEBUFFER_BYTES_PER_PIXEL],
+                               counts[i] * LED_FRAMEBUFFER_BYTES_PER_PIXEL, &tx_config);
+        }
+        if (ret != ESP_OK) {
+            // outputs from i on never started, account for them so the token comes back once the rest is done
+            unsigned missing = controller->output_count - i;
+            if (atomic_fetch_sub(&controller->pending_outputs, missing) == missing) {
+                if (controller->pm_lock) {
+                    esp_pm_lock_release(controller->pm_lock);
+                }
+                xSemaphoreGive(controller->tx_done);
+            }
+            *started = i > 0;
+            return ret;
+        }
+    }
+    *started = true;
+    if (symbols) {
+        controller->stats.cached_frames++;
+    }
+    controller->stats.sent_pixels = sent_pixels;
+    led_controller_sent(controller, frame, crc);
+    return ESP_OK;
+}
+
+/**
+ * @brief Hand the counters to led_controller_get_stats(), which runs in other tasks
+ */
+static void led_controller_publish_stats(led_controller_t *controller)
+{
+    if (atomic_exchange(&controller->stats_reset, false)) {
+        memset(&controller->stats, 0, sizeof(controller->stats));
+    }
+    portENTER_CRITICAL(&controller->stats_lock);
+    controller->published = controller->stats;
+    portEXIT_CRITICAL(&controller->stats_lock);
+}
+
+/**
+ * @brief submit() plus the per-frame counters
+ */
+static esp_err_t led_controller_present(led_controller_t *controller, led_framebuffer_t *frame, int timeout_ms, bool *started)
+{
+    led_controller_stats_t *stats = &controller->stats;
+    if (controller->render_start_us) {
+        led_controller_record(&stats->render_us, &stats->render_max_us, esp_timer_get_time() - controller->render_start_us);
+        controller->render_start_us = 0;
+    }
+    bool held;
+    esp_err_t ret = led_controller_submit(controller, frame, timeout_ms, started, &held);
+    if (ret != ESP_OK) {
+        stats->dropped_frames++;
+    } else if (held) {
+        // counted in held_frames by the loop
+    } else if (!*started) {
+        stats->skipped_frames++;
+    } else {
+        stats->frames++;
+        atomic_fetch_add(&controller->window_frames, 1);
+    }
+    led_controller_publish_stats(controller);
+    return ret;
+}
+
+esp_err_t led_controller_swap_buffers(led_controller_t *controller, int timeout_ms)
+{
+    ESP_RETURN_ON_FALSE(controller && controller->output_count, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    bool started;
+    esp_err_t ret = led_controller_present(controller, led_controller_back_buffer(controller), timeout_ms, &started);
+    if (started) {
+        // the back buffer is (at least partly) on the wire now, render into the other one
+        controller->back ^= 1;
+    }
+    return ret;
+}
+
+esp_err_t led_controller_transmit_buffer(led_controller_t *controller, led_framebuffer_t *frame, int timeout_ms)
+{
+    ESP_RETURN_ON_FALSE(controller && controller->output_count && frame, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(frame->pixel_count == controller->frames[0].pixel_count, ESP_ERR_INVALID_SIZE, TAG,
+                        "frame has %u pixels, strip has %u", (unsigned)frame->pixel_count,
+                        (unsigned)controller->frames[0].pixel_count);
+    bool started;
+    return led_controller_present(controller, frame, timeout_ms, &started);
+}
+
+esp_err_t led_controller_hold(led_controller_t *controller, const led_framebuffer_t *frame, int timeout_ms)
+{
+    ESP_RETURN_ON_FALSE(controller && controller->output_count && frame, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(controller->hold_symbols, ESP_ERR_NOT_SUPPORTED, TAG, "frame doesn't fit channel memory");
+    ESP_RETURN_ON_FALSE(frame->pixel_count == controller->frames[0].pixel_count, ESP_ERR_INVALID_SIZE, TAG,
+                        "frame has %u pixels, strip has %u", (unsigned)frame->pixel_count,
+                        (unsigned)controller->frames[0].pixel_count);
+    uint32_t crc = controller->skip_unchanged ? led_controller_frame_crc(controller, frame) : 0;
+    esp_err_t ret = led_controller_fence(controller, timeout_ms);
+    if (ret != ESP_OK) {
+        controller->stats.dropped_frames++;
+    } else {
+        ret = led_controller_start_hold(controller, frame, crc);
+    }
+    led_controller_publish_stats(controller);
+    return ret;
+}
+
+esp_err_t led_controller_wait_done(led_controller_t *controller, int timeout_ms)
+{
+    ESP_RETURN_ON_FALSE(controller && controller->output_count, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    if (controller->holding) {
+        // waiting on an endless loop would never return
+        return ESP_OK;
+    }
+    if (controller->i80) {
+        // the panel IO has no wait call, borrow the fence token instead
+        ESP_RETURN_ON_FALSE(xSemaphoreTake(controller->tx_done, led_controller_ticks(timeout_ms)) == pdTRUE,
+                            ESP_ERR_TIMEOUT, TAG, "wait for i80 output timed out");
+        xSemaphoreGive(controller->tx_done);
+        return ESP_OK;
+    }
+    for (size_t i = 0; i < controller->output_count; i++) {
+        ESP_RETURN_ON_ERROR(rmt_tx_wait_all_done(controller->outputs[i].channel, timeout_ms), TAG, "wait for output %u failed", (unsigned)i);
+    }
+    return ESP_OK;
+}
+
+esp_err_t led_controller_idle(led_controller_t *controller, int timeout_ms)
+{
+    ESP_RETURN_ON_FALSE(controller && controller->output_count, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    if (!controller->power_save || controller->idle) {
+        return ESP_OK;
+    }
+    if (controller->holding) {
+        // the pixels keep what they latched, once a whole pass is out the loop only keeps the chip awake;
+        // it owns the token, stopping it hands it over
+        int64_t left_us = controller->hold_start_us + controller->hold_pass_us - esp_timer_get_time();
+        if (left_us > 0) {
+            esp_rom_delay_us(left_us);
+        }
+        led_controller_stop_hold(controller);
+        controller->hold_released = true;
+    } else if (xSemaphoreTake(controller->tx_done, led_controller_ticks(timeout_ms)) != pdTRUE) {
+        // holding the token keeps a frame from starting while the channels go down
+        return ESP_ERR_TIMEOUT;
+    }
+    for (size_t i = 0; i < controller->output_count; i++) {
+        rmt_disable(controller->outputs[i].channel);
+    }
+    controller->idle = true;
+    xSemaphoreGive(controller->tx_done);
+    return ESP_OK;
+}
+
+esp_err_t led_controller_set_lut(led_controller_t *controller, const uint8_t *lut, int timeout_ms)
+{
+    ESP_RETURN_ON_FALSE(controller && controller->output_count, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    // the tables are read by the refill ISR, only rewrite them while nothing is on the wire
+    if (controller->holding) {
+        // the loop owns the token, stopping it hands it over
+        led_controller_stop_hold(controller);
+    } else if (xSemaphoreTake(controller->tx_done, led_controller_ticks(timeout_ms)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    if (controller->dither.work) {
+        // applied on the way into the working frame, the bytes sent are final
+        led_dither_set_lut(&controller->dither, lut);
+        lut = NULL;
+    }
+    if (controller->i80) {
+        led_i80_output_set_lut(controller->i80, lut);
+    }
+    // same pixels look different now, the next frame has to go out, and whole
+    controller->sent_crc_valid = false;
+    controller->shown_valid = false;
+    for (size_t i = 0; i < controller->output_count; i++) {
+        if (controller->outputs[i].encoder) {
+            rmt_led_strip_encoder_set_lut(controller->outputs[i].encoder, lut);
+        }
+    }
+    if (controller->symbol_cache.slot_count) {
+        // every cached frame was encoded with the old table
+        led_symbol_cache_set_lut(&controller->symbol_cache, lut);
+    }
+    if (lut) {
+        memcpy(controller->hold_lut, lut, sizeof(controller->hold_lut));
+    }
+    controller->hold_encoder.lut = lut ? controller->hold_lut : NULL;
+    xSemaphoreGive(controller->tx_done);
+    return ESP_OK;
+}
+
+esp_err_t led_controller_set_correction(led_controller_t *controller, float gamma, uint8_t brightness, int timeout_ms)
+{
+    ESP_RETURN_ON_FALSE(controller && gamma > 0, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    if (controller->dither.work) {
+        ESP_RETURN_ON_ERROR(led_controller_set_lut(controller, NULL, timeout_ms), TAG, "reset output tables failed");
+        led_dither_set_correction(&controller->dither, gamma, brightness);
+        return ESP_OK;
+    }
+    uint8_t lut[256];
+    for (int value = 0; value < 256; value++) {
+        lut[value] = (uint8_t)(powf(value / 255.0f, gamma) * brightness + 0.5f);
+    }
+    return led_controller_set_lut(controller, lut, timeout_ms);
+}
+
+esp_err_t led_controller_get_stats(led_controller_t *controller, led_controller_stats_t *ret_stats)
+{
+    ESP_RETURN_ON_FALSE(controller && ret_stats, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&controller->stats_lock);
+    *ret_stats = controller->published;
+    int64_t elapsed_us = now - controller->window_start_us;
+    controller->window_start_us = now;
+    portEXIT_CRITICAL(&controller->stats_lock);
+    // a frame counted after the exchange falls into the next window instead of being lost
+    unsigned window_frames = atomic_exchange(&controller->window_frames, 0);
+    ret_stats->fps = elapsed_us > 0 ? window_frames * 1000000.0f / elapsed_us : 0;
+    return ESP_OK;
+}
+
+esp_err_t led_controller_reset_stats(led_controller_t *controller)
+{
+    ESP_RETURN_ON_FALSE(controller, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    atomic_store(&controller->stats_reset, true);
+    portENTER_CRITICAL(&controller->stats_lock);
+    memset(&controller->published, 0, sizeof(controller->published));
+    controller->window_start_us = esp_timer_get_time();
+    portEXIT_CRITICAL(&controller->stats_lock);
+    atomic_store(&controller->window_frames, 0);
+    return ESP_OK;
+}
+
+static void led_controller_report_cb(void *arg)
+{
+    led_controller_t *controller = (led_controller_t *)arg;
+    led_controller_stats_t stats;
+    led_controller_get_stats(controller, &stats);
+    ESP_LOGI(TAG, "%.1f fps | frames %lu late %lu dropped %lu skipped %lu cached %lu held %lu | pixels %lu | render %lu/%lu us | wait %lu/%lu us | "
+             "tx %lu/%lu us | encode %lu cycles", stats.fps, (unsigned long)stats.frames, (unsigned long)stats.late_frames,
+             (unsigned long)stats.dropped_frames, (unsigned long)stats.skipped_frames, (unsigned long)stats.cached_frames, (unsigned long)stats.held_frames,
+             (unsigned long)stats.sent_pixels, (unsigned long)stats.render_us, (unsigned long)stats.render_max_us,
+             (unsigned long)stats.wait_us, (unsigned long)stats.wait_max_us, (unsigned long)stats.tx_latency_us,
+             (unsigned long)stats.tx_latency_max_us, (unsigned long)stats.encode_cycles);
+}
+
+esp_err_t led_controller_report_stats(led_controller_t *controller, uint32_t period_ms)
+{
+    ESP_RETURN_ON_FALSE(controller && controller->output_count, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    if (!controller->report_timer) {
+        if (!period_ms) {
+            return ESP_OK;
+        }
+        esp_timer_create_args_t timer_args = {
+            .callback = led_controller_report_cb,
+            .arg = controller,
+            .name = "led_stats",
+        };
+        ESP_RETURN_ON_ERROR(esp_timer_create(&timer_args, &controller->report_timer), TAG, "create report timer failed");
+    }
+    if (esp_timer_is_active(controller->report_timer)) {
+        ESP_RETURN_ON_ERROR(esp_timer_stop(controller->report_timer), TAG, "stop report timer failed");
+    }
+    if (period_ms) {
+        ESP_RETURN_ON_ERROR(esp_timer_start_periodic(controller->report_timer, (uint64_t)period_ms * 1000), TAG,
+                            "start report timer failed");
+    }
+    return ESP_OK;
+}
+
+esp_err_t led_controller_dither_load(led_controller_t *controller, const led_framebuffer_t *frame)
+{
+    ESP_RETURN_ON_FALSE(controller && frame, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(controller->dither.work, ESP_ERR_INVALID_STATE, TAG, "controller doesn't dither");
+    ESP_RETURN_ON_FALSE(frame->pixel_count == controller->dither.pixel_count, ESP_ERR_INVALID_SIZE, TAG,
+                        "frame has %u pixels, strip has %u", (unsigned)frame->pixel_count,
+                        (unsigned)controller->dither.pixel_count);
+    led_dither_load(&controller->dither, frame->pixels);
+    return ESP_OK;
+}
+
+esp_err_t led_controller_dither_refresh(led_controller_t *controller, int timeout_ms)
+{
+    ESP_RETURN_ON_FALSE(controller && controller->output_count, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(controller->dither.work, ESP_ERR_INVALID_STATE, TAG, "controller doesn't dither");
+    led_framebuffer_t *frame = led_controller_back_buffer(controller);
+    led_dither_emit(&controller->dither, frame->pixels);
+    led_framebuffer_mark_dirty(frame, 0, frame->pixel_count);
+    return led_controller_swap_buffers(controller, timeout_ms);
+}
@@ -0,0 +1,440 @@
+/**
+ * @file led_controller.h
+ * @brief Double-buffered LED strip output on top of the RMT TX driver
+ *
+ * The app renders into the back buffer while the front buffer is on the
+ * wire. led_controller_swap_buffers() waits for the RMT TX-done callback
+ * of the previous frame, flips the buffers and starts sending the new
+ * front buffer without blocking, so rendering the next frame overlaps
+ * with the transmission of the current one.
+ *
+ * The strip can be split across several outputs (one RMT TX channel and
+ * GPIO each). Every output sends its own slice of the same framebuffer and
+ * an RMT sync manager starts them on the same clock edge, so frame time
+ * shrinks with the number of outputs.
+ *
+ * A frame short enough to fit the RMT channel memory can also be held:
+ * the peripheral then repeats it in a hardware loop, refreshing the strip
+ * with no CPU work at all until the next frame replaces it (see
+ * led_controller_hold()).
+ *
+ * With sparse, each output only sends its chain up to the last pixel that
+ * differs from what the strip shows; WS2812-style pixels further down
+ * keep what they latched. Strips that mostly change near the head then
+ * spend only that much time on the wire.
+ *
+ * For more strips than there are RMT channels, the i80 backend sends the
+ * same framebuffer over 8 or 16 lanes of the LCD_CAM bus instead (see
+ * led_i80_output.h). The API is identical for both backends.
+ */
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "driver/rmt_tx.h"
+#include "soc/soc_caps.h"
+#include "led_framebuffer.h"
+#include "led_strip_encoder.h"
+#include "led_i80_output.h"
+#include "led_dither.h"
+#include "led_symbol_cache.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Upper bound for the automatically sized DMA symbol buffer
+ *
+ * 4096 symbols is 16 KB of internal RAM and refills in 2048-symbol halves,
+ * so a 1000-pixel frame (24000 symbols) takes about a dozen interrupts.
+ */
+#define LED_CONTROLLER_DMA_MAX_SYMBOLS 4096
+
+/**
+ * @brief Most RMT outputs one controller can drive, one per TX-capable RMT channel
+ */
+#define LED_CONTROLLER_MAX_RMT_OUTPUTS SOC_RMT_TX_CANDIDATES_PER_GROUP
+
+/**
+ * @brief Most outputs of any backend, the i80 bus has up to 16 lanes
+ */
+#define LED_CONTROLLER_MAX_OUTPUTS LED_I80_MAX_LANES
+
+/**
+ * @brief Peripheral that puts the frames on the wire
+ */
+typedef enum {
+    LED_CONTROLLER_BACKEND_RMT = 0, /*!< One RMT TX channel per output, up to LED_CONTROLLER_MAX_RMT_OUTPUTS */
+    LED_CONTROLLER_BACKEND_I80,     /*!< LCD_CAM i80 bus, exactly 8 or 16 outputs */
+} led_controller_backend_t;
+
+/**
+ * @brief LED controller configuration
+ */
+typedef struct {
+    led_controller_backend_t backend; /*!< Output peripheral */
+    int gpio_nums[LED_CONTROLLER_MAX_OUTPUTS]; /*!< Data GPIO of each output */
+    size_t output_count;        /*!< Outputs in use, the pixels are split evenly across them in order */
+    size_t pixel_count;         /*!< Number of pixels over all outputs */
+    uint32_t resolution_hz;     /*!< RMT tick resolution, in Hz */
+    led_strip_chip_t chip;      /*!< LED chip, picks the bit timing and bytes per pixel. The i80 backend has its own
+                                     fixed bit timing and only takes 3-byte chips */
+    const led_strip_timing_t *timing; /*!< RMT only: custom timing used instead of the chip's, NULL for none */
+    size_t mem_block_symbols;   /*!< RMT channel memory per output, in symbols. With several outputs keep it at
+                                     SOC_RMT_MEM_WORDS_PER_CHANNEL so every channel fits. With DMA this is the
+                                     size of the DMA symbol buffer, 0 picks one that fits the strip (at least
+                                     SOC_RMT_MEM_WORDS_PER_CHANNEL, the driver takes nothing smaller) */
+    size_t trans_queue_depth;   /*!< RMT transaction queue depth */
+    bool with_dma;              /*!< Feed the first output from DMA instead of ping-pong ISR refills of channel
+                                     memory (there is only one DMA-capable TX channel) */
+    bool skip_unchanged;        /*!< Don't resend a frame identical to the last one sent (compared by CRC32) */
+    uint32_t refresh_ms;        /*!< With skip_unchanged, resend an unchanged frame anyway once it is this old, 0 for never */
+    bool dither;                /*!< Keep a 16-bit working frame and send temporally dithered 8-bit frames of it,
+                                     see led_controller_dither_refresh(). Correction moves into the dither stage */
+    bool hold_unchanged;        /*!< With skip_unchanged, hold an unchanged frame in a hardware loop instead of
+                                     resending it every refresh_ms, if it fits (see led_controller_hold()). The
+                                     loop keeps its channels enabled and the chip out of light sleep, with
+                                     power_save led_controller_idle() stops it once the frame latched */
+    bool power_save;            /*!< RMT only: clock the channels from XTAL, hold a CPU_FREQ_MAX PM lock only while
+                                     a frame is on the wire and let led_controller_idle() disable the channels */
+    bool sparse;                /*!< RMT only: send every output only up to its last changed pixel, compared
+                                     against a copy of what the strip shows. refresh_ms resends are whole */
+    float gamma;                /*!< Output correction loaded before the first frame, see
+                                     led_controller_set_correction(). 0 for none */
+    uint8_t brightness;         /*!< With gamma, output for full-scale input */
+    size_t symbol_cache_bytes;  /*!< RMT only: keep frames that repeat fully encoded in this much internal RAM and
+                                     send them with a copy encoder, see led_symbol_cache.h. 0 for no cache */
+    struct {
+        int wr_gpio_num;        /*!< Bus write clock, must be a free GPIO */
+        int dc_gpio_num;        /*!< Bus D/C line, must be a free GPIO */
+    } i80;                      /*!< Only used by LED_CONTROLLER_BACKEND_I80, the RMT fields above are ignored there */
+} led_controller_config_t;
+
+/**
+ * @brief One output and the slice of the framebuffer it sends
+ */
+typedef struct {
+    rmt_channel_handle_t channel;   /*!< RMT TX channel, NULL with the i80 backend */
+    rmt_encoder_handle_t encoder;   /*!< LED strip encoder, encoders keep state so each channel has its own */
+    rmt_encoder_handle_t copy_encoder; /*!< Sends pre-encoded symbols (symbol cache, hold), NULL with the i80 backend */
+    size_t first_pixel;             /*!< Index of the first pixel of this output in the framebuffer */
+    size_t pixel_count;             /*!< Pixels driven by this output */
+} led_controller_output_t;
+
+/**
+ * @brief Frame timing counters
+ *
+ * Timestamps come from esp_timer, encode cost from the CPU cycle counter.
+ * Values marked "last" describe the most recent frame, the max fields the
+ * worst one since led_controller_reset_stats().
+ */
+typedef struct {
+    uint32_t frames;            /*!< Frames put on the wire */
+    uint32_t late_frames;       /*!< Swaps that found the previous frame still on the wire and had to wait for it */
+    uint32_t dropped_frames;    /*!< Swaps that timed out or failed, those frames never went out */
+    uint32_t skipped_frames;    /*!< Swaps not sent because nothing changed, see skip_unchanged */
+    uint32_t cached_frames;     /*!< Frames sent from the symbol cache, they cost no encode cycles */
+    uint32_t held_frames;       /*!< Frames handed to the hardware loop */
+    uint32_t sent_pixels;       /*!< Pixels the last frame put on the wire over all outputs, fewer than the strip
+                                     with sparse */
+    uint32_t render_us;         /*!< Last led_controller_begin_frame() to swap time, 0 if begin_frame isn't used */
+    uint32_t render_max_us;     /*!< Worst render_us */
+    uint32_t wait_us;           /*!< Last time a swap spent blocked on the previous frame */
+    uint32_t wait_max_us;       /*!< Worst wait_us */
+    uint32_t tx_latency_us;     /*!< Submit to TX-done of the last finished frame */
+    uint32_t tx_latency_max_us; /*!< Worst tx_latency_us */
+    uint32_t encode_cycles;     /*!< CPU cycles spent encoding the last frame (RMT refills, or the i80 transpose) */
+    float fps;                  /*!< Frames per second since the previous led_controller_get_stats() call */
+} led_controller_stats_t;
+
+/**
+ * @brief Everything needed to drive one strip
+ */
+typedef struct {
+    led_controller_backend_t backend; /*!< Output peripheral */
+    led_controller_output_t outputs[LED_CONTROLLER_MAX_OUTPUTS]; /*!< Outputs in use */
+    size_t output_count;            /*!< Number of entries in outputs */
+    rmt_sync_manager_handle_t sync_manager; /*!< Starts all RMT outputs together, NULL with a single output */
+    led_i80_output_handle_t i80;    /*!< i80 bus output, NULL with the RMT backend */
+    led_framebuffer_t frames[2];    /*!< Front and back buffer */
+    uint8_t back;                   /*!< Index of the buffer the app renders into */
+    atomic_uint pending_outputs;    /*!< Outputs still sending the current frame */
+    SemaphoreHandle_t tx_done;      /*!< Given once every output is done, held while a frame is on the wire */
+    StaticSemaphore_t tx_done_buffer; /*!< Storage for tx_done, keeps it off the heap */
+    led_controller_stats_t stats;   /*!< Timing counters, only the submitting task touches them */
+    led_controller_stats_t published; /*!< Copy of stats as of the last swap, what led_controller_get_stats() reads */
+    portMUX_TYPE stats_lock;        /*!< Guards published and window_start_us */
+    atomic_bool stats_reset;        /*!< Set by led_controller_reset_stats(), the next swap zeroes stats */
+    int64_t render_start_us;        /*!< Set by led_controller_begin_frame() */
+    int64_t submit_us;              /*!< When the frame on the wire was submitted, 0 before the first one */
+    volatile int64_t done_us;       /*!< When the last output finished it, written by the TX-done ISR */
+    uint32_t encode_cycles_seen;    /*!< Encoder cycle total at the previous swap */
+    int64_t window_start_us;        /*!< Start of the current fps window */
+    atomic_uint window_frames;      /*!< Frames since window_start_us */
+    esp_timer_handle_t report_timer; /*!< Periodic stats logger, NULL until requested */
+    bool skip_unchanged;            /*!< Copy of the config flag */
+    int64_t refresh_us;             /*!< Keepalive period for unchanged frames, 0 for none */
+    bool sent_crc_valid;            /*!< sent_crc describes what the strip is showing */
+    uint32_t sent_crc;              /*!< CRC32 of the last frame sent */
+    const led_framebuffer_t *sent_frame; /*!< Buffer that frame came from, while it stays clean it still hashes to sent_crc */
+    int64_t sent_us;                /*!< When that frame was sent */
+    led_dither_t dither;            /*!< Working frame and carried error, work is NULL unless dithering */
+    led_symbol_cache_t symbol_cache; /*!< Encoded repeat frames, slot_count is 0 without a cache */
+    bool hold_unchanged;            /*!< Copy of the config flag */
+    bool holding;                   /*!< A hardware loop is on the wire, it owns the tx_done token */
+    rmt_symbol_word_t *hold_symbols; /*!< Every output's looped frame back to back, NULL if frames don't fit */
+    led_strip_encoder_config_t hold_encoder; /*!< Encodes held frames, lut points at hold_lut or is NULL */
+    uint8_t hold_lut[256];          /*!< Copy of the output correction for held frames */
+    uint32_t hold_gap_us;           /*!< Line idle after a loop is cut off, so the next frame latches cleanly */
+    uint32_t hold_pass_us;          /*!< One pass of the longest held output plus its latch */
+    int64_t hold_start_us;          /*!< When the current loop started */
+    bool hold_released;             /*!< led_controller_idle() cut the loop off after it latched, repeats are skipped */
+    bool power_save;                /*!< Copy of the config flag */
+    bool idle;                      /*!< Channels disabled by led_controller_idle(), the next fence enables them */
+    esp_pm_lock_handle_t pm_lock;   /*!< Held from submit to TX-done, NULL without power_save or CONFIG_PM_ENABLE */
+    uint8_t *shown;                 /*!< With sparse, the pixels the strip was last sent, NULL otherwise */
+    bool shown_valid;               /*!< shown matches the strip, false until a frame went out whole */
+} led_controller_t;
+
+/**
+ * @brief Create both framebuffers and the backend (RMT channels and encoders, or the i80 bus)
+ *
+ * The output interrupts are allocated on the calling core, so call this
+ * from the core that should take the TX-done and refill ISRs.
+ *
+ * @param[in] config Controller configuration
+ * @param[out] controller Controller to initialize, must stay at the same
+ *                        address while in use (the TX-done ISR points at it)
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NO_MEM out of memory
+ *      - ESP_OK if the controller is ready
+ */
+esp_err_t led_controller_init(const led_controller_config_t *config, led_controller_t *controller);
+
+/**
+ * @brief Wait for the last frame, then release everything led_controller_init() created
+ */
+esp_err_t led_controller_deinit(led_controller_t *controller);
+
+/**
+ * @brief Buffer to render the next frame into
+ *
+ * After a swap this holds the frame before last, not the one on the wire,
+ * so effects that don't redraw every pixel need to account for that.
+ */
+static inline led_framebuffer_t *led_controller_back_buffer(led_controller_t *controller)
+{
+    return &controller->frames[controller->back];
+}
+
+/**
+ * @brief Back buffer, and start the render timer for led_controller_stats_t::render_us
+ *
+ * Use this instead of led_controller_back_buffer() at the start of a frame
+ * when render time should be measured.
+ */
+static inline led_framebuffer_t *led_controller_begin_frame(led_controller_t *controller)
+{
+    controller->render_start_us = esp_timer_get_time();
+    return led_controller_back_buffer(controller);
+}
+
+/**
+ * @brief Present the back buffer
+ *
+ * Waits until the frame currently on the wire is done, swaps front and
+ * back and queues the new front buffer on every output. Returns as soon
+ * as the transmission has started.
+ *
+ * With skip_unchanged, a back buffer identical to the last frame sent is
+ * not sent and not swapped (it still waits for the wire to be idle).
+ *
+ * @param[in] controller Controller
+ * @param[in] timeout_ms How long to wait for the previous frame, -1 for forever
+ * @return
+ *      - ESP_ERR_TIMEOUT the previous frame did not finish in time, nothing was swapped
+ *      - ESP_OK if the new frame is on its way
+ */
+esp_err_t led_controller_swap_buffers(led_controller_t *controller, int timeout_ms);
+
+/**
+ * @brief Send a framebuffer the controller doesn't own
+ *
+ * Same as led_controller_swap_buffers() but for an external buffer, e.g.
+ * one slot of a render queue; the controller's own back buffer is left
+ * alone. The previous frame (whichever buffer it came from) is off the
+ * wire when this returns, frame stays in use until the next call.
+ *
+ * @param[in] controller Controller
+ * @param[in] frame Pixels to send, same pixel count as the strip
+ * @param[in] timeout_ms How long to wait for the previous frame, -1 for forever
+ * @return
+ *      - ESP_ERR_INVALID_SIZE frame doesn't match the strip
+ *      - ESP_ERR_TIMEOUT the previous frame did not finish in time, frame was not sent
+ *      - ESP_OK if frame is on its way
+ */
+esp_err_t led_controller_transmit_buffer(led_controller_t *controller, led_framebuffer_t *frame, int timeout_ms);
+
+/**
+ * @brief Send a frame and keep the RMT repeating it until the next one
+ *
+ * Encodes frame into the channel memory of every output and starts an
+ * endless hardware loop (loop_count -1), every pass ending in the reset
+ * code. The strip is refreshed continuously without interrupts or
+ * encoding. Any later swap, transmit, hold or LUT change stops the loop
+ * wherever it is (the strip just gets part of the same frame again),
+ * waits out the reset time and carries on.
+ * frame is not referenced once this returns.
+ *
+ * Only works if each output's frame plus the end marker fits its
+ * mem_block_symbols (24 symbols per 3-byte pixel, so a handful of pixels
+ * per channel), without DMA and with the RMT backend.
+ *
+ * @param[in] controller Controller
+ * @param[in] frame Pixels to hold, same pixel count as the strip
+ * @param[in] timeout_ms How long to wait for the previous frame, -1 for forever
+ * @return
+ *      - ESP_ERR_NOT_SUPPORTED frames don't fit the channel memory, or the backend can't loop
+ *      - ESP_ERR_INVALID_SIZE frame doesn't match the strip
+ *      - ESP_ERR_TIMEOUT the previous frame did not finish in time, frame was not sent
+ *      - ESP_OK if the loop is running
+ */
+esp_err_t led_controller_hold(led_controller_t *controller, const led_framebuffer_t *frame, int timeout_ms);
+
+/**
+ * @brief Block until every queued frame has gone out on the wire
+ *
+ * A held frame counts as gone out, its loop keeps running.
+ *
+ * @param[in] controller Controller
+ * @param[in] timeout_ms How long to wait, -1 for forever
+ */
+esp_err_t led_controller_wait_done(led_controller_t *controller, int timeout_ms);
+
+/**
+ * @brief Copy the timing counters and restart the fps window
+ *
+ * Safe to call from another task: the counters are the ones published at
+ * the end of the last swap, so a value may be one frame stale.
+ *
+ * @param[in] controller Controller
+ * @param[out] ret_stats Counters
+ */
+esp_err_t led_controller_get_stats(led_controller_t *controller, led_controller_stats_t *ret_stats);
+
+/**
+ * @brief Zero all counters and maxima
+ *
+ * Safe to call from another task, the submitting task zeroes its own
+ * counters at the next swap.
+ */
+esp_err_t led_controller_reset_stats(led_controller_t *controller);
+
+/**
+ * @brief Log the counters periodically from an esp_timer
+ *
+ * @param[in] controller Controller
+ * @param[in] period_ms Report interval, 0 stops reporting
+ */
+esp_err_t led_controller_report_stats(led_controller_t *controller, uint32_t period_ms);
+
+/**
+ * @brief Let the chip sleep until the next frame
+ *
+ * An enabled RMT channel keeps a PM lock of the driver that rules out
+ * light sleep. With power_save this waits for the frame on the wire and
+ * disables every channel, the next swap or transmit enables them again
+ * (a few microseconds). Call it when there is nothing to send until the
+ * next frame deadline. Does nothing without power_save. A held frame's
+ * loop is stopped once it has sent the frame whole, the pixels keep it
+ * latched, and repeats of it are skipped (refresh_ms still applies).
+ *
+ * @param[in] controller Controller
+ * @param[in] timeout_ms How long to wait for the current frame, -1 for forever
+ * @return
+ *      - ESP_ERR_TIMEOUT the current frame did not finish in time, the channels stay up
+ *      - ESP_OK if the channels are down (or don't need to be)
+ */
+esp_err_t led_controller_idle(led_controller_t *controller, int timeout_ms);
+
+/**
+ * @brief Load a 256-entry byte LUT applied to every pixel byte on its way out
+ *
+ * The framebuffers keep linear values; the LUT is folded into the encoder
+ * symbol tables (or the i80 transpose), so correction costs no extra pass
+ * over the pixels. Waits for the frame on the wire first, the new table
+ * applies from the next swap on. The symbol cache starts over empty.
+ *
+ * With dithering the table feeds the working frame instead and the
+ * encoders send bytes unchanged.
+ *
+ * @param[in] controller Controller
+ * @param[in] lut 256 entries, copied, NULL for no correction
+ * @param[in] timeout_ms How long to wait for the current frame, -1 for forever
+ * @return
+ *      - ESP_ERR_TIMEOUT the current frame did not finish in time, nothing changed
+ *      - ESP_OK if the LUT is loaded
+ */
+esp_err_t led_controller_set_lut(led_controller_t *controller, const uint8_t *lut, int timeout_ms);
+
+/**
+ * @brief Load a gamma curve with a global brightness limit
+ *
+ * out = 255 * (in / 255) ^ gamma * brightness / 255, rounded. With
+ * dithering the curve is kept at 8.8 precision instead of rounded.
+ *
+ * Set led_controller_config_t::gamma instead to have the curve in place
+ * from the first frame.
+ *
+ * @param[in] controller Controller
+ * @param[in] gamma Exponent, 1.0 is linear, around 2.2-2.8 looks even on WS2812
+ * @param[in] brightness Output for full-scale input, 0-255
+ * @param[in] timeout_ms How long to wait for the current frame, -1 for forever
+ */
+esp_err_t led_controller_set_correction(led_controller_t *controller, float gamma, uint8_t brightness, int timeout_ms);
+
+/**
+ * @brief Load a frame into the working frame of a dithering controller
+ *
+ * Goes through the correction curve into 8.8, frame itself is not kept
+ * and can be reused right away. Sources with more than 8 bits can write
+ * controller->dither.work directly instead.
+ *
+ * @param[in] controller Controller created with dither set
+ * @param[in] frame Linear pixels, same pixel count as the strip
+ * @return
+ *      - ESP_ERR_INVALID_STATE the controller doesn't dither
+ *      - ESP_ERR_INVALID_SIZE frame doesn't match the strip
+ *      - ESP_OK if the working frame was updated
+ */
+esp_err_t led_controller_dither_load(led_controller_t *controller, const led_framebuffer_t *frame);
+
+/**
+ * @brief Send the next dithered frame of the working frame
+ *
+ * Renders it into the back buffer and swaps, like
+ * led_controller_swap_buffers(). Call this as often as the wire allows,
+ * not just when the content changes: every refresh carries another step
+ * of the fraction.
+ *
+ * @param[in] controller Controller created with dither set
+ * @param[in] timeout_ms How long to wait for the previous frame, -1 for forever
+ * @return
+ *      - ESP_ERR_INVALID_STATE the controller doesn't dither
+ *      - ESP_ERR_TIMEOUT the previous frame did not finish in time, nothing was swapped
+ *      - ESP_OK if the frame is on its way
+ */
+esp_err_t led_controller_dither_refresh(led_controller_t *controller, int timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
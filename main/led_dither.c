@@ -0,0 +1,82 @@
+/**
+ * @file led_dither.c
+ * @brief Error-carrying 8.8 to 8-bit conversion
+ */
+
+#include <math.h>
+#include <string.h>
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "led_dither.h"
+#include "led_framebuffer.h"
+#include "led_mem.h"
+
+static const char *TAG = "led_dither";
+
+esp_err_t led_dither_init(led_dither_t *dither, size_t pixel_count)
+{
+    ESP_RETURN_ON_FALSE(dither && pixel_count, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    memset(dither, 0, sizeof(*dither));
+    size_t channels = pixel_count * LED_FRAMEBUFFER_BYTES_PER_PIXEL;
+    dither->work = led_mem_calloc(channels, sizeof(uint16_t), 4, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    dither->error = led_mem_calloc(channels, sizeof(uint8_t), 4, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!dither->work || !dither->error) {
+        led_dither_deinit(dither);
+        ESP_LOGE(TAG, "no mem for %u pixels", (unsigned)pixel_count);
+        return ESP_ERR_NO_MEM;
+    }
+    dither->pixel_count = pixel_count;
+    for (size_t i = 0; i < channels; i++) {
+        // golden-ratio steps spread the starting phases evenly over the byte
+        dither->error[i] = (uint8_t)(i * 159);
+    }
+    led_dither_set_lut(dither, NULL);
+    return ESP_OK;
+}
+
+void led_dither_deinit(led_dither_t *dither)
+{
+    if (!dither) {
+        return;
+    }
+    led_mem_free(dither->work);
+    led_mem_free(dither->error);
+    memset(dither, 0, sizeof(*dither));
+}
+
+void led_dither_set_correction(led_dither_t *dither, float gamma, uint8_t brightness)
+{
+    for (int value = 0; value < 256; value++) {
+        dither->lut[value] = (uint16_t)(powf(value / 255.0f, gamma) * brightness * 256.0f + 0.5f);
+    }
+}
+
+void led_dither_set_lut(led_dither_t *dither, const uint8_t *lut)
+{
+    for (int value = 0; value < 256; value++) {
+        dither->lut[value] = (uint16_t)((lut ? lut[value] : value) << 8);
+    }
+}
+
+void led_dither_load(led_dither_t *dither, const uint8_t *pixels)
+{
+    size_t channels = dither->pixel_count * LED_FRAMEBUFFER_BYTES_PER_PIXEL;
+    uint16_t *work = dither->work;
+    const uint16_t *lut = dither->lut;
+    for (size_t i = 0; i < channels; i++) {
+        work[i] = lut[pixels[i]];
+    }
+}
+
+void led_dither_emit(led_dither_t *dither, uint8_t *pixels)
+{
+    size_t channels = dither->pixel_count * LED_FRAMEBUFFER_BYTES_PER_PIXEL;
+    const uint16_t *work = dither->work;
+    uint8_t *error = dither->error;
+    for (size_t i = 0; i < channels; i++) {
+        // work tops out at 0xFF00, so the sum never leaves 16 bits
+        uint32_t sum = work[i] + error[i];
+        pixels[i] = sum >> 8;
+        error[i] = sum & 0xFF;
+    }
+}
@@ -0,0 +1,89 @@
+/**
+ * @file led_dither.h
+ * @brief Temporal dithering from a 16-bit working framebuffer down to 8-bit frames
+ *
+ * The working buffer holds every channel as 8.8 fixed point, already
+ * gamma corrected, in wire order. Each emitted frame adds the rounding
+ * error left over from the previous one before truncating to 8 bits, so
+ * over a few frames the strip averages out to the fractional level. A
+ * channel at 3.25 shows 3, 3, 3, 4, ... instead of sitting at 3, which
+ * is what makes slow fades near black smooth. The more often frames go
+ * out, the less that averaging flickers.
+ *
+ * All integer: loading an 8-bit frame is one table lookup per channel,
+ * emitting is an add, a shift and a mask.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LED_DITHER_MAX 0xFF00 /*!< Full scale of a working channel, 255.0 in 8.8 */
+
+/**
+ * @brief Dithering state
+ */
+typedef struct {
+    uint16_t *work;             /*!< Working framebuffer, pixel_count * 3 channels of 8.8, LED_DITHER_MAX tops */
+    uint8_t *error;             /*!< Fraction each channel still owes, carried into the next frame */
+    size_t pixel_count;         /*!< Pixels in both buffers */
+    uint16_t lut[256];          /*!< 8-bit linear input to 8.8 output, see led_dither_set_correction() */
+} led_dither_t;
+
+/**
+ * @brief Allocate the working buffer, all channels off and an identity curve
+ *
+ * The carried errors start out staggered between channels so pixels
+ * at the same level don't all step up in the same frame.
+ *
+ * @param[out] dither State to initialize
+ * @param[in] pixel_count Strip length
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NO_MEM out of memory
+ *      - ESP_OK if the buffers are ready
+ */
+esp_err_t led_dither_init(led_dither_t *dither, size_t pixel_count);
+
+/**
+ * @brief Free the buffers
+ */
+void led_dither_deinit(led_dither_t *dither);
+
+/**
+ * @brief Gamma curve with a brightness limit, computed at 16-bit precision
+ *
+ * out = 255 * (in / 255) ^ gamma * brightness / 255 like the 8-bit
+ * correction in led_controller, but the fraction is kept for dithering.
+ */
+void led_dither_set_correction(led_dither_t *dither, float gamma, uint8_t brightness);
+
+/**
+ * @brief Use an 8-bit table instead, NULL for the identity (no gain in precision)
+ */
+void led_dither_set_lut(led_dither_t *dither, const uint8_t *lut);
+
+/**
+ * @brief Load an 8-bit linear frame into the working buffer through the curve
+ *
+ * @param[in] dither State
+ * @param[in] pixels pixel_count * 3 bytes, wire order
+ */
+void led_dither_load(led_dither_t *dither, const uint8_t *pixels);
+
+/**
+ * @brief Truncate the working buffer plus the carried error into an 8-bit frame
+ *
+ * @param[in] dither State
+ * @param[out] pixels pixel_count * 3 bytes, wire order, ready to send
+ */
+void led_dither_emit(led_dither_t *dither, uint8_t *pixels);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,334 @@
+/**
+ * @file led_effects.c
+ * @brief Built-in effects and the engine
+ *
+ * Every effect body is a FORCE_INLINE_ATTR span function taking the color
+ * order as its last argument. LED_EFFECT_KERNELS() wraps it once per color
+ * order with a literal in that position, so each generated kernel is the
+ * body specialized for one order.
+ *
+ * Every pixel written also adds its three channels, looked up in the
+ * engine's duty curve, to the sum the kernel returns. That is what the
+ * power limiter estimates the frame's current from, so it comes for free
+ * while the pixels are still in registers instead of costing another pass.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "led_color.h"
+#include "led_effects.h"
+#include "led_mem.h"
+
+static const char *TAG = "led_effects";
+
+#if LED_EFFECTS_FIXED_PIXEL_COUNT
+#define LED_EFFECT_PIXELS(ctx) ((size_t)LED_EFFECTS_FIXED_PIXEL_COUNT)
+#else
+#define LED_EFFECT_PIXELS(ctx) ((ctx)->pixel_count)
+#endif
+
+#define LED_EFFECT_KERNEL(effect, order)                                                            \
+    static uint32_t effect##_##order(uint8_t *pixels, size_t first, size_t count, const led_effect_ctx_t *ctx) \
+    {                                                                                               \
+        return effect##_span(pixels, first, count, ctx, LED_COLOR_ORDER_##order);                   \
+    }
+
+#define LED_EFFECT_KERNELS(effect) \
+    LED_EFFECT_KERNEL(effect, GRB) \
+    LED_EFFECT_KERNEL(effect, RGB) \
+    LED_EFFECT_KERNEL(effect, BRG) \
+    LED_EFFECT_KERNEL(effect, RBG) \
+    LED_EFFECT_KERNEL(effect, GBR) \
+    LED_EFFECT_KERNEL(effect, BGR)
+
+#define LED_EFFECT_KERNEL_TABLE(effect) \
+    { effect##_GRB, effect##_RGB, effect##_BRG, effect##_RBG, effect##_GBR, effect##_BGR }
+
+// returns the pixel's duty, sum it up for the kernel's return value
+FORCE_INLINE_ATTR uint32_t led_effect_put(uint8_t *pixel, led_color_order_t order, const uint8_t *duty,
+                                          uint8_t r, uint8_t g, uint8_t b)
+{
+    switch (order) {
+    case LED_COLOR_ORDER_GRB: pixel[0] = g; pixel[1] = r; pixel[2] = b; break;
+    case LED_COLOR_ORDER_RGB: pixel[0] = r; pixel[1] = g; pixel[2] = b; break;
+    case LED_COLOR_ORDER_BRG: pixel[0] = b; pixel[1] = r; pixel[2] = g; break;
+    case LED_COLOR_ORDER_RBG: pixel[0] = r; pixel[1] = b; pixel[2] = g; break;
+    case LED_COLOR_ORDER_GBR: pixel[0] = g; pixel[1] = b; pixel[2] = r; break;
+    default:                  pixel[0] = b; pixel[1] = g; pixel[2] = r; break;
+    }
+    return duty[r] + duty[g] + duty[b];
+}
+
+// led_color works in GRB, pick the channels apart for led_effect_put()
+FORCE_INLINE_ATTR uint32_t led_effect_put_hsv(uint8_t *pixel, led_color_order_t order, const uint8_t *duty,
+                                              uint16_t h, uint8_t s, uint8_t v)
+{
+    uint8_t grb[3];
+    led_color_hsv_to_grb(h, s, v, grb);
+    return led_effect_put(pixel, order, duty, grb[1], grb[0], grb[2]);
+}
+
+static inline uint32_t led_effect_random(uint32_t *rng)
+{
+    uint32_t x = *rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *rng = x;
+    return x;
+}
+
+static inline uint32_t led_effect_travel(const led_effect_ctx_t *ctx)
+{
+    return (uint32_t)(ctx->time_us * ctx->params->speed / 1000000);
+}
+
+/*
+ * Gradient / rainbow: hue moves along the strip at `speed` degrees per
+ * second, `spread` degrees from one end to the other.
+ */
+FORCE_INLINE_ATTR uint32_t led_effect_hue_span(uint8_t *pixels, size_t first, size_t count, const led_effect_ctx_t *ctx,
+                                               led_color_order_t order, uint32_t spread)
+{
+    const led_effect_params_t *params = ctx->params;
+    size_t n = LED_EFFECT_PIXELS(ctx);
+    uint32_t base = params->hue + led_effect_travel(ctx);
+    uint32_t duty = 0;
+    for (size_t i = first; i < first + count; i++) {
+        uint32_t hue = base + spread * i / n;
+        duty += led_effect_put_hsv(&pixels[i * LED_FRAMEBUFFER_BYTES_PER_PIXEL], order, ctx->duty, hue % 360,
+                                   params->saturation, params->value);
+    }
+    return duty;
+}
+
+FORCE_INLINE_ATTR uint32_t rainbow_span(uint8_t *pixels, size_t first, size_t count, const led_effect_ctx_t *ctx, led_color_order_t order)
+{
+    return led_effect_hue_span(pixels, first, count, ctx, order, 360);
+}
+
+FORCE_INLINE_ATTR uint32_t gradient_span(uint8_t *pixels, size_t first, size_t count, const led_effect_ctx_t *ctx, led_color_order_t order)
+{
+    return led_effect_hue_span(pixels, first, count, ctx, order, ctx->params->spread);
+}
+
+/*
+ * Theater chase: every third pixel lit, moving `speed` pixels per second.
+ */
+FORCE_INLINE_ATTR uint32_t chase_span(uint8_t *pixels, size_t first, size_t count, const led_effect_ctx_t *ctx, led_color_order_t order)
+{
+    const led_effect_params_t *params = ctx->params;
+    uint8_t grb[3];
+    led_color_hsv_to_grb(params->hue, params->saturation, params->value, grb);
+    uint32_t offset = led_effect_travel(ctx) % 3;
+    uint32_t duty = 0;
+    for (size_t i = first; i < first + count; i++) {
+        uint8_t *pixel = &pixels[i * LED_FRAMEBUFFER_BYTES_PER_PIXEL];
+        if ((i + 3 - offset) % 3 == 0) {
+            duty += led_effect_put(pixel, order, ctx->duty, grb[1], grb[0], grb[2]);
+        } else {
+            duty += led_effect_put(pixel, order, ctx->duty, 0, 0, 0);
+        }
+    }
+    return duty;
+}
+
+/*
+ * Fire (after Mark Kriegsman's Fire2012): one heat byte per pixel, pixel 0
+ * is the bottom of the flame.
+ */
+static void fire_step(const led_effect_ctx_t *ctx)
+{
+    const led_effect_params_t *params = ctx->params;
+    uint8_t *heat = ctx->state;
+    size_t n = LED_EFFECT_PIXELS(ctx);
+    uint32_t max_cooling = params->cooling * 10 / n + 2;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t cooldown = led_effect_random(ctx->rng) % max_cooling;
+        heat[i] = heat[i] > cooldown ? heat[i] - cooldown : 0;
+    }
+    // heat drifts up and diffuses
+    for (size_t i = n - 1; i >= 2; i--) {
+        heat[i] = (heat[i - 1] + 2 * heat[i - 2]) / 3;
+    }
+    if ((led_effect_random(ctx->rng) & 0xFF) < params->density) {
+        size_t spark = led_effect_random(ctx->rng) % (n < 7 ? n : 7);
+        uint32_t value = heat[spark] + 160 + led_effect_random(ctx->rng) % 96;
+        heat[spark] = value > 255 ? 255 : value;
+    }
+}
+
+FORCE_INLINE_ATTR uint32_t fire_span(uint8_t *pixels, size_t first, size_t count, const led_effect_ctx_t *ctx, led_color_order_t order)
+{
+    const uint8_t *heat = ctx->state;
+    uint32_t value = ctx->params->value;
+    uint32_t duty = 0;
+    for (size_t i = first; i < first + count; i++) {
+        // black -> red -> yellow -> white over three thirds of the heat range
+        uint32_t t = heat[i] * 191 / 255;
+        uint8_t ramp = (t & 0x3F) << 2;
+        uint32_t r, g, b;
+        if (t & 0x80) {
+            r = 255, g = 255, b = ramp;
+        } else if (t & 0x40) {
+            r = 255, g = ramp, b = 0;
+        } else {
+            r = ramp, g = 0, b = 0;
+        }
+        duty += led_effect_put(&pixels[i * LED_FRAMEBUFFER_BYTES_PER_PIXEL], order, ctx->duty, r * value / 100,
+                               g * value / 100, b * value / 100);
+    }
+    return duty;
+}
+
+/*
+ * Twinkle: random pixels flare up and fade out, one level byte per pixel.
+ */
+static void twinkle_step(const led_effect_ctx_t *ctx)
+{
+    uint8_t *level = ctx->state;
+    size_t n = LED_EFFECT_PIXELS(ctx);
+    for (size_t i = 0; i < n; i++) {
+        // fade by 1/8 per frame, the -1 makes sure it actually reaches 0
+        level[i] = level[i] > 8 ? level[i] - (level[i] >> 3) - 1 : 0;
+    }
+    uint32_t sparkles = (ctx->params->density * n + (led_effect_random(ctx->rng) & 0xFF)) >> 8;
+    while (sparkles--) {
+        level[led_effect_random(ctx->rng) % n] = 255;
+    }
+}
+
+FORCE_INLINE_ATTR uint32_t twinkle_span(uint8_t *pixels, size_t first, size_t count, const led_effect_ctx_t *ctx, led_color_order_t order)
+{
+    const led_effect_params_t *params = ctx->params;
+    const uint8_t *level = ctx->state;
+    uint32_t duty = 0;
+    for (size_t i = first; i < first + count; i++) {
+        duty += led_effect_put_hsv(&pixels[i * LED_FRAMEBUFFER_BYTES_PER_PIXEL], order, ctx->duty, params->hue,
+                                   params->saturation, params->value * level[i] / 255);
+    }
+    return duty;
+}
+
+LED_EFFECT_KERNELS(rainbow)
+LED_EFFECT_KERNELS(gradient)
+LED_EFFECT_KERNELS(chase)
+LED_EFFECT_KERNELS(fire)
+LED_EFFECT_KERNELS(twinkle)
+
+static const led_effect_t s_effects[] = {
+    { .name = "rainbow", .kernels = LED_EFFECT_KERNEL_TABLE(rainbow) },
+    { .name = "gradient", .kernels = LED_EFFECT_KERNEL_TABLE(gradient) },
+    { .name = "chase", .kernels = LED_EFFECT_KERNEL_TABLE(chase) },
+    { .name = "fire", .state_per_pixel = 1, .step = fire_step, .kernels = LED_EFFECT_KERNEL_TABLE(fire) },
+    { .name = "twinkle", .state_per_pixel = 1, .step = twinkle_step, .kernels = LED_EFFECT_KERNEL_TABLE(twinkle) },
+};
+
+#define LED_EFFECTS_COUNT (sizeof(s_effects) / sizeof(s_effects[0]))
+
+size_t led_effects_count(void)
+{
+    return LED_EFFECTS_COUNT;
+}
+
+const led_effect_t *led_effects_get(size_t index)
+{
+    return index < LED_EFFECTS_COUNT ? &s_effects[index] : NULL;
+}
+
+int led_effects_find(const char *name)
+{
+    for (size_t i = 0; name && i < LED_EFFECTS_COUNT; i++) {
+        if (strcmp(s_effects[i].name, name) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static void led_effect_engine_switch(led_effect_engine_t *engine, size_t index)
+{
+    engine->effect = &s_effects[index];
+    memset(engine->state, 0, engine->state_size);
+}
+
+esp_err_t led_effect_engine_init(led_effect_engine_t *engine, size_t pixel_count, led_color_order_t order)
+{
+    ESP_RETURN_ON_FALSE(engine && pixel_count && order < LED_COLOR_ORDER_MAX, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(!LED_EFFECTS_FIXED_PIXEL_COUNT || pixel_count == LED_EFFECTS_FIXED_PIXEL_COUNT, ESP_ERR_INVALID_ARG,
+                        TAG, "built for %u pixels", (unsigned)LED_EFFECTS_FIXED_PIXEL_COUNT);
+    memset(engine, 0, sizeof(*engine));
+    size_t state_per_pixel = 0;
+    for (size_t i = 0; i < LED_EFFECTS_COUNT; i++) {
+        if (s_effects[i].state_per_pixel > state_per_pixel) {
+            state_per_pixel = s_effects[i].state_per_pixel;
+        }
+    }
+    // keep a valid pointer even when no effect has state
+    engine->state_size = state_per_pixel * pixel_count;
+    engine->state = led_mem_calloc(1, engine->state_size ? engine->state_size : 1, 4, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    ESP_RETURN_ON_FALSE(engine->state, ESP_ERR_NO_MEM, TAG, "no mem for effect state");
+    engine->order = order;
+    engine->pixel_count = pixel_count;
+    engine->params = (led_effect_params_t)LED_EFFECT_DEFAULT_PARAMS();
+    engine->rng = 0x2545F491; // any non-zero seed
+    atomic_store(&engine->pending, -1);
+    led_effect_engine_set_duty_curve(engine, 1.0f, 255);
+    led_effect_engine_switch(engine, 0);
+    return ESP_OK;
+}
+
+void led_effect_engine_deinit(led_effect_engine_t *engine)
+{
+    if (!engine) {
+        return;
+    }
+    led_mem_free(engine->state);
+    memset(engine, 0, sizeof(*engine));
+}
+
+esp_err_t led_effect_engine_select(led_effect_engine_t *engine, size_t index)
+{
+    ESP_RETURN_ON_FALSE(engine && engine->state, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(index < LED_EFFECTS_COUNT, ESP_ERR_NOT_FOUND, TAG, "no effect %u", (unsigned)index);
+    atomic_store(&engine->pending, (int)index);
+    return ESP_OK;
+}
+
+void led_effect_engine_set_params(led_effect_engine_t *engine, const led_effect_params_t *params)
+{
+    engine->params = *params;
+}
+
+void led_effect_engine_set_duty_curve(led_effect_engine_t *engine, float gamma, uint8_t brightness)
+{
+    for (int value = 0; value < 256; value++) {
+        engine->duty[value] = (uint8_t)(powf(value / 255.0f, gamma) * brightness + 0.5f);
+    }
+}
+
+uint32_t led_effect_engine_render(led_effect_engine_t *engine, led_framebuffer_t *frame, const led_scheduler_frame_t *info)
+{
+    int pending = atomic_exchange(&engine->pending, -1);
+    if (pending >= 0) {
+        led_effect_engine_switch(engine, pending);
+    }
+    led_effect_ctx_t ctx = {
+        .time_us = info->time_us,
+        .frame = info->frame,
+        .pixel_count = engine->pixel_count,
+        .params = &engine->params,
+        .state = engine->state,
+        .rng = &engine->rng,
+        .duty = engine->duty,
+    };
+    if (engine->effect->step) {
+        engine->effect->step(&ctx);
+    }
+    uint32_t duty = engine->effect->kernels[engine->order](frame->pixels, 0, engine->pixel_count, &ctx);
+    led_framebuffer_mark_dirty(frame, 0, engine->pixel_count);
+    return duty;
+}
@@ -0,0 +1,198 @@
+/**
+ * @file led_effects.h
+ * @brief Effect registry and the engine that renders the selected effect
+ *
+ * An effect is a set of span kernels, one per color order, plus an
+ * optional per-frame step for effects that simulate something (fire,
+ * twinkle). The kernels are generated from a single body per effect with
+ * the color order as a compile-time constant, so the byte shuffling folds
+ * away in every variant. Build with LED_EFFECTS_FIXED_PIXEL_COUNT defined
+ * to the strip length to make the pixel count a constant as well.
+ *
+ * Effects render straight into the framebuffer. Their state lives in one
+ * buffer sized for the hungriest effect when the engine is created, so
+ * neither rendering nor switching effects allocates.
+ */
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "led_framebuffer.h"
+#include "led_scheduler.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef LED_EFFECTS_FIXED_PIXEL_COUNT
+#define LED_EFFECTS_FIXED_PIXEL_COUNT 0 /*!< Strip length known at build time, 0 if it isn't */
+#endif
+
+/**
+ * @brief Byte order of a pixel on the wire
+ */
+typedef enum {
+    LED_COLOR_ORDER_GRB = 0,    /*!< WS2812 and most clones */
+    LED_COLOR_ORDER_RGB,
+    LED_COLOR_ORDER_BRG,
+    LED_COLOR_ORDER_RBG,
+    LED_COLOR_ORDER_GBR,
+    LED_COLOR_ORDER_BGR,
+    LED_COLOR_ORDER_MAX,
+} led_color_order_t;
+
+/**
+ * @brief Effect parameters, each effect uses the ones that make sense for it
+ */
+typedef struct {
+    uint32_t speed;             /*!< Degrees of hue per second (rainbow, gradient) or pixels per second (chase) */
+    uint16_t hue;               /*!< Base hue in degrees */
+    uint16_t spread;            /*!< Gradient: hue range across the strip, in degrees */
+    uint8_t saturation;         /*!< Saturation in percent */
+    uint8_t value;              /*!< Value in percent */
+    uint8_t density;            /*!< Twinkle: new sparkles per frame per 256 pixels. Fire: spark chance per frame, 0-255 */
+    uint8_t cooling;            /*!< Fire: how fast flames cool down, 20-100 looks good */
+} led_effect_params_t;
+
+#define LED_EFFECT_DEFAULT_PARAMS() { \
+    .speed = 100,                     \
+    .hue = 0,                         \
+    .spread = 120,                    \
+    .saturation = 100,                \
+    .value = 100,                     \
+    .density = 32,                    \
+    .cooling = 55,                    \
+}
+
+/**
+ * @brief What a kernel or step gets to see of the current frame
+ */
+typedef struct {
+    int64_t time_us;            /*!< Frame deadline since the start, see led_scheduler_frame_t */
+    uint32_t frame;             /*!< Frame index */
+    size_t pixel_count;         /*!< Pixels on the whole strip */
+    const led_effect_params_t *params; /*!< Current parameters */
+    uint8_t *state;             /*!< Effect state, state_per_pixel bytes per pixel, zeroed when the effect is selected */
+    uint32_t *rng;              /*!< xorshift32 state for effects that need noise */
+    const uint8_t *duty;        /*!< Duty curve the kernel sums written channels through, see led_effect_engine_set_duty_curve() */
+} led_effect_ctx_t;
+
+/**
+ * @brief Render pixels [first, first + count) of the strip into pixels
+ *
+ * pixels points at the start of the framebuffer, not at the span.
+ *
+ * @return Sum of ctx->duty[channel] over every channel written, 255 per channel fully on
+ */
+typedef uint32_t (*led_effect_kernel_t)(uint8_t *pixels, size_t first, size_t count, const led_effect_ctx_t *ctx);
+
+/**
+ * @brief One registry entry
+ */
+typedef struct {
+    const char *name;           /*!< Name to look it up by */
+    size_t state_per_pixel;     /*!< Bytes of state per pixel, 0 for stateless effects */
+    void (*step)(const led_effect_ctx_t *ctx); /*!< Advances the whole strip's state once per frame, NULL if stateless */
+    led_effect_kernel_t kernels[LED_COLOR_ORDER_MAX]; /*!< Span kernel for each color order */
+} led_effect_t;
+
+/**
+ * @brief Renders the selected effect
+ */
+typedef struct {
+    const led_effect_t *effect; /*!< Effect being rendered */
+    led_color_order_t order;    /*!< Strip color order */
+    size_t pixel_count;         /*!< Strip length */
+    led_effect_params_t params; /*!< Parameters passed to the effect */
+    uint8_t *state;             /*!< State buffer, big enough for every registered effect */
+    size_t state_size;          /*!< Size of state */
+    uint32_t rng;               /*!< Noise source state */
+    atomic_int pending;         /*!< Registry index asked for by led_effect_engine_select(), -1 for none */
+    uint8_t duty[256];          /*!< Framebuffer value to how long the LED is actually on, 255 = always */
+} led_effect_engine_t;
+
+/**
+ * @brief Number of registered effects
+ */
+size_t led_effects_count(void);
+
+/**
+ * @brief Registry entry by index, NULL if out of range
+ */
+const led_effect_t *led_effects_get(size_t index);
+
+/**
+ * @brief Registry index of the effect with this name, -1 if there is none
+ */
+int led_effects_find(const char *name);
+
+/**
+ * @brief Allocate the state buffer and select the first effect
+ *
+ * @param[out] engine Engine to initialize
+ * @param[in] pixel_count Strip length, must equal LED_EFFECTS_FIXED_PIXEL_COUNT if that is set
+ * @param[in] order Strip color order
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NO_MEM out of memory for the state buffer
+ *      - ESP_OK if the engine is ready
+ */
+esp_err_t led_effect_engine_init(led_effect_engine_t *engine, size_t pixel_count, led_color_order_t order);
+
+/**
+ * @brief Free the state buffer
+ */
+void led_effect_engine_deinit(led_effect_engine_t *engine);
+
+/**
+ * @brief Switch effects, safe to call from any task
+ *
+ * The switch happens at the start of the next led_effect_engine_render(),
+ * the outputs keep running untouched.
+ *
+ * @return
+ *      - ESP_ERR_NOT_FOUND no effect with that index
+ *      - ESP_OK if the switch is pending
+ */
+esp_err_t led_effect_engine_select(led_effect_engine_t *engine, size_t index);
+
+/**
+ * @brief Change the effect parameters, call between renders from the render task
+ */
+void led_effect_engine_set_params(led_effect_engine_t *engine, const led_effect_params_t *params);
+
+/**
+ * @brief Tell the engine what output correction the frames go through
+ *
+ * Same formula as led_controller_set_correction(), pass the same values
+ * so the duty sums match what the strip really shows (and draws). The
+ * default is the identity, gamma 1.0 and brightness 255.
+ */
+void led_effect_engine_set_duty_curve(led_effect_engine_t *engine, float gamma, uint8_t brightness);
+
+/**
+ * @brief Duty of one wire-order pixel through the engine's curve
+ *
+ * For whoever changes pixels after led_effect_engine_render() and wants
+ * to keep its return value up to date.
+ */
+static inline uint32_t led_effect_engine_pixel_duty(const led_effect_engine_t *engine, const uint8_t *pixel)
+{
+    return engine->duty[pixel[0]] + engine->duty[pixel[1]] + engine->duty[pixel[2]];
+}
+
+/**
+ * @brief Render the selected effect into the whole framebuffer and mark it dirty
+ *
+ * @param[in] engine Engine
+ * @param[out] frame Framebuffer, engine pixel_count pixels
+ * @param[in] info Frame to render, normally from led_scheduler_wait_frame()
+ * @return Duty sum of the frame, summed while rendering (see led_effect_kernel_t), for led_power_limit()
+ */
+uint32_t led_effect_engine_render(led_effect_engine_t *engine, led_framebuffer_t *frame, const led_scheduler_frame_t *info);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,81 @@
+/**
+ * @file led_framebuffer.c
+ * @brief Pixel framebuffer allocation and bulk write helpers
+ */
+
+#include <string.h>
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "led_framebuffer.h"
+#include "led_mem.h"
+
+static const char *TAG = "led_fb";
+
+// Internal + DMA so the same buffer works with RMT in DMA mode
+#define LED_FRAMEBUFFER_MEM_CAPS (MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA | MALLOC_CAP_8BIT)
+// 16 bytes lets led_pixel_ops run its SIMD path over the whole buffer
+#define LED_FRAMEBUFFER_ALIGN 16
+
+esp_err_t led_framebuffer_init(led_framebuffer_t *fb, size_t pixel_count)
+{
+    ESP_RETURN_ON_FALSE(fb && pixel_count, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    memset(fb, 0, sizeof(*fb));
+    fb->pixels = led_mem_calloc(pixel_count, LED_FRAMEBUFFER_BYTES_PER_PIXEL, LED_FRAMEBUFFER_ALIGN,
+                                LED_FRAMEBUFFER_MEM_CAPS);
+    ESP_RETURN_ON_FALSE(fb->pixels, ESP_ERR_NO_MEM, TAG, "no mem for %u pixels", (unsigned)pixel_count);
+    fb->pixel_count = pixel_count;
+    led_framebuffer_mark_dirty(fb, 0, pixel_count);
+    return ESP_OK;
+}
+
+void led_framebuffer_deinit(led_framebuffer_t *fb)
+{
+    if (!fb) {
+        return;
+    }
+    led_mem_free(fb->pixels);
+    memset(fb, 0, sizeof(*fb));
+}
+
+// Clip [start, start + count) to the strip, returns the usable count
+static size_t led_framebuffer_clip(const led_framebuffer_t *fb, size_t start, size_t count)
+{
+    if (start >= fb->pixel_count) {
+        return 0;
+    }
+    if (count > fb->pixel_count - start) {
+        count = fb->pixel_count - start;
+    }
+    return count;
+}
+
+void led_framebuffer_fill(led_framebuffer_t *fb, size_t start, size_t count, const uint8_t grb[3])
+{
+    count = led_framebuffer_clip(fb, start, count);
+    if (!count) {
+        return;
+    }
+    uint8_t *p = &fb->pixels[start * LED_FRAMEBUFFER_BYTES_PER_PIXEL];
+    if (grb[0] == grb[1] && grb[1] == grb[2]) {
+        // grey levels (including off) are a plain memset
+        memset(p, grb[0], count * LED_FRAMEBUFFER_BYTES_PER_PIXEL);
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            p[0] = grb[0];
+            p[1] = grb[1];
+            p[2] = grb[2];
+            p += LED_FRAMEBUFFER_BYTES_PER_PIXEL;
+        }
+    }
+    led_framebuffer_mark_dirty(fb, start, start + count);
+}
+
+void led_framebuffer_blit(led_framebuffer_t *fb, size_t start, const uint8_t *src, size_t count)
+{
+    count = led_framebuffer_clip(fb, start, count);
+    if (!count) {
+        return;
+    }
+    memcpy(&fb->pixels[start * LED_FRAMEBUFFER_BYTES_PER_PIXEL], src, count * LED_FRAMEBUFFER_BYTES_PER_PIXEL);
+    led_framebuffer_mark_dirty(fb, start, start + count);
+}
@@ -0,0 +1,146 @@
+/**
+ * @file led_framebuffer.h
+ * @brief Contiguous GRB pixel buffer for a whole LED strip
+ *
+ * The buffer is laid out exactly as the strip expects it on the wire
+ * (G, R, B per pixel), so a single rmt_transmit() of `pixels` pushes
+ * the whole strip. Writes go through the helpers below, which also keep
+ * track of the range of pixels touched since the last transmit.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LED_FRAMEBUFFER_BYTES_PER_PIXEL 3 /*!< G, R, B */
+
+/**
+ * @brief Pixel framebuffer
+ *
+ * Dirty range is half-open: pixels [dirty_start, dirty_end) were written
+ * since the last led_framebuffer_clear_dirty(). Clean when start == end.
+ * The controller trusts a clean buffer to still hold what it last sent
+ * and skips hashing it, so code writing pixels directly must call
+ * led_framebuffer_mark_dirty() too.
+ */
+typedef struct {
+    uint8_t *pixels;        /*!< GRB bytes, pixel_count * 3, DMA-capable */
+    size_t pixel_count;     /*!< Number of pixels in the buffer */
+    size_t dirty_start;     /*!< First written pixel */
+    size_t dirty_end;       /*!< One past the last written pixel */
+} led_framebuffer_t;
+
+/**
+ * @brief Allocate a framebuffer for `pixel_count` pixels
+ *
+ * Memory comes from internal, DMA-capable RAM and is zeroed (all pixels off).
+ * The whole buffer starts out dirty so the first transmit sends everything.
+ *
+ * @param[out] fb Framebuffer to initialize
+ * @param[in] pixel_count Number of pixels on the strip
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NO_MEM out of memory when allocating the pixel buffer
+ *      - ESP_OK if the framebuffer was allocated
+ */
+esp_err_t led_framebuffer_init(led_framebuffer_t *fb, size_t pixel_count);
+
+/**
+ * @brief Free the pixel memory of a framebuffer
+ */
+void led_framebuffer_deinit(led_framebuffer_t *fb);
+
+/**
+ * @brief Fill `count` pixels starting at `start` with one color
+ *
+ * Ranges running past the end of the strip are clipped.
+ */
+void led_framebuffer_fill(led_framebuffer_t *fb, size_t start, size_t count, const uint8_t grb[3]);
+
+/**
+ * @brief Copy `count` GRB pixels from `src` into the buffer at `start`
+ *
+ * Ranges running past the end of the strip are clipped.
+ */
+void led_framebuffer_blit(led_framebuffer_t *fb, size_t start, const uint8_t *src, size_t count);
+
+/**
+ * @brief Size of the pixel data in bytes (what gets handed to rmt_transmit)
+ */
+static inline size_t led_framebuffer_size(const led_framebuffer_t *fb)
+{
+    return fb->pixel_count * LED_FRAMEBUFFER_BYTES_PER_PIXEL;
+}
+
+/**
+ * @brief First pixel of slice `index` when `pixel_count` pixels are split evenly into `slices`
+ *
+ * Slice i covers [slice_start(i), slice_start(i + 1)), sizes differ by at most one pixel.
+ * Used to spread one framebuffer over several outputs.
+ */
+static inline size_t led_framebuffer_slice_start(size_t pixel_count, size_t slices, size_t index)
+{
+    return pixel_count * index / slices;
+}
+
+/**
+ * @brief Grow the dirty range to cover [start, end)
+ */
+static inline void led_framebuffer_mark_dirty(led_framebuffer_t *fb, size_t start, size_t end)
+{
+    if (fb->dirty_start == fb->dirty_end) {
+        fb->dirty_start = start;
+        fb->dirty_end = end;
+        return;
+    }
+    if (start < fb->dirty_start) {
+        fb->dirty_start = start;
+    }
+    if (end > fb->dirty_end) {
+        fb->dirty_end = end;
+    }
+}
+
+/**
+ * @brief Set a single pixel, out-of-range indices are ignored
+ *
+ * Inline since effects call this once per pixel per frame.
+ */
+static inline void led_framebuffer_set_pixel(led_framebuffer_t *fb, size_t index, const uint8_t grb[3])
+{
+    if (index >= fb->pixel_count) {
+        return;
+    }
+    uint8_t *p = &fb->pixels[index * LED_FRAMEBUFFER_BYTES_PER_PIXEL];
+    p[0] = grb[0];
+    p[1] = grb[1];
+    p[2] = grb[2];
+    led_framebuffer_mark_dirty(fb, index, index + 1);
+}
+
+/**
+ * @brief Whether any pixel was written since the last clear
+ */
+static inline bool led_framebuffer_is_dirty(const led_framebuffer_t *fb)
+{
+    return fb->dirty_start != fb->dirty_end;
+}
+
+/**
+ * @brief Forget the dirty range, call after the buffer went out on the wire
+ */
+static inline void led_framebuffer_clear_dirty(led_framebuffer_t *fb)
+{
+    fb->dirty_start = 0;
+    fb->dirty_end = 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,211 @@
+/**
+ * @file led_i80_output.c
+ * @brief Bit-plane transpose and DMA streaming over the i80 bus
+ *
+ * Buffer layout: for every pixel index and every byte of that pixel, 8 bits
+ * MSB first, each bit 3 bus words (all lanes high, one data bit per lane,
+ * all lanes low). A bus word is one byte on an 8 bit bus and two bytes
+ * (lanes 0-7 in the low byte) on a 16 bit bus. Lanes shorter than the
+ * longest one are padded with zeros, which the end of a chain ignores.
+ */
+
+#include <string.h>
+#include "esp_check.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "esp_lcd_panel_io.h"
+#include "led_framebuffer.h"
+#include "led_i80_output.h"
+#include "led_mem.h"
+
+static const char *TAG = "led_i80";
+
+#define LED_I80_PCLK_HZ         2400000 // 3 bus clocks per WS2812 bit at 800 kHz
+#define LED_I80_WORDS_PER_BIT   3
+#define LED_I80_RESET_WORDS     144     // 60 us low at 2.4 MHz, >50 us latches the frame
+
+struct led_i80_output_t {
+    esp_lcd_i80_bus_handle_t bus;
+    esp_lcd_panel_io_handle_t io;
+    size_t lane_count;
+    size_t pixel_count;
+    size_t lane_starts[LED_I80_MAX_LANES + 1]; // lane i covers pixels [lane_starts[i], lane_starts[i + 1])
+    size_t pixels_per_lane;     // longest lane
+    size_t buffer_size;         // bytes per DMA buffer
+    uint8_t *buffers[2];        // DMA bit-plane buffers, one being filled while the other is on the bus
+    uint8_t next;               // buffer the next prepare writes to
+    uint8_t lut[256];           // applied to every pixel byte during the transpose
+    led_i80_output_done_cb_t on_done;
+    void *user_ctx;
+};
+
+static bool IRAM_ATTR led_i80_output_on_trans_done(esp_lcd_panel_io_handle_t io, esp_lcd_panel_io_event_data_t *edata, void *user_ctx)
+{
+    led_i80_output_handle_t output = (led_i80_output_handle_t)user_ctx;
+    return output->on_done ? output->on_done(output->user_ctx) : false;
+}
+
+/**
+ * @brief Transpose an 8x8 bit matrix
+ *
+ * Byte r of the input is row r; afterwards byte c holds bit c of every
+ * input row, row r landing in bit r. (Hacker's Delight, transpose8.)
+ */
+static inline uint64_t led_i80_transpose8(uint64_t x)
+{
+    uint64_t t;
+    t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+    x = x ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+    x = x ^ t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+    x = x ^ t ^ (t << 28);
+    return x;
+}
+
+// Byte `byte` of pixel `pixel` of every lane in the group of 8 starting at `lane`, one lane per byte
+static inline uint64_t led_i80_gather(const led_i80_output_handle_t output, const uint8_t *pixels, size_t lane, size_t pixel, size_t byte)
+{
+    uint64_t rows = 0;
+    for (size_t i = 0; i < 8; i++) {
+        size_t index = output->lane_starts[lane + i] + pixel;
+        if (index < output->lane_starts[lane + i + 1]) {
+            rows |= (uint64_t)output->lut[pixels[index * LED_FRAMEBUFFER_BYTES_PER_PIXEL + byte]] << (8 * i);
+        }
+    }
+    return rows;
+}
+
+void led_i80_output_prepare(led_i80_output_handle_t output, const uint8_t *pixels)
+{
+    uint8_t *out = output->buffers[output->next];
+    size_t word_bytes = output->lane_count / 8;
+    uint8_t high[2] = { 0xFF, 0xFF };
+
+    for (size_t pixel = 0; pixel < output->pixels_per_lane; pixel++) {
+        for (size_t byte = 0; byte < LED_FRAMEBUFFER_BYTES_PER_PIXEL; byte++) {
+            uint64_t planes[2];
+            for (size_t group = 0; group < word_bytes; group++) {
+                planes[group] = led_i80_transpose8(led_i80_gather(output, pixels, group * 8, pixel, byte));
+            }
+            // plane byte k holds bit k of every lane, send MSB first
+            for (int bit = 7; bit >= 0; bit--) {
+                memcpy(out, high, word_bytes);
+                out += word_bytes;
+                for (size_t group = 0; group < word_bytes; group++) {
+                    *out++ = (uint8_t)(planes[group] >> (8 * bit));
+                }
+                memset(out, 0, word_bytes);
+                out += word_bytes;
+            }
+        }
+    }
+    // the reset tail was zeroed at allocation and is never written
+}
+
+void led_i80_output_set_lut(led_i80_output_handle_t output, const uint8_t *lut)
+{
+    for (int value = 0; value < 256; value++) {
+        output->lut[value] = lut ? lut[value] : value;
+    }
+}
+
+esp_err_t led_i80_output_start(led_i80_output_handle_t output)
+{
+    ESP_RETURN_ON_FALSE(output, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    uint8_t *buffer = output->buffers[output->next];
+    // lcd_cmd -1: no command phase, just the data
+    ESP_RETURN_ON_ERROR(esp_lcd_panel_io_tx_color(output->io, -1, buffer, output->buffer_size), TAG, "tx failed");
+    output->next ^= 1;
+    return ESP_OK;
+}
+
+esp_err_t led_i80_output_new(const led_i80_output_config_t *config, led_i80_output_handle_t *ret_output)
+{
+    esp_err_t ret = ESP_OK;
+    led_i80_output_handle_t output = NULL;
+    ESP_GOTO_ON_FALSE(config && ret_output && config->data_gpio_nums, ESP_ERR_INVALID_ARG, err, TAG, "invalid argument");
+    ESP_GOTO_ON_FALSE(config->lane_count == 8 || config->lane_count == 16, ESP_ERR_INVALID_ARG, err, TAG,
+                      "lane count must be 8 or 16");
+    ESP_GOTO_ON_FALSE(config->pixel_count >= config->lane_count, ESP_ERR_INVALID_ARG, err, TAG, "fewer pixels than lanes");
+    output = led_mem_calloc(1, sizeof(*output), 4, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    ESP_GOTO_ON_FALSE(output, ESP_ERR_NO_MEM, err, TAG, "no mem for i80 output");
+    output->lane_count = config->lane_count;
+    output->pixel_count = config->pixel_count;
+    output->on_done = config->on_done;
+    output->user_ctx = config->user_ctx;
+    led_i80_output_set_lut(output, NULL);
+    for (size_t i = 0; i <= config->lane_count; i++) {
+        output->lane_starts[i] = led_framebuffer_slice_start(config->pixel_count, config->lane_count, i);
+    }
+    // lanes beyond the bus width stay empty so the gather loop never reads them
+    for (size_t i = config->lane_count + 1; i <= LED_I80_MAX_LANES; i++) {
+        output->lane_starts[i] = config->pixel_count;
+    }
+    output->pixels_per_lane = output->lane_starts[1] - output->lane_starts[0];
+    for (size_t i = 1; i < config->lane_count; i++) {
+        size_t count = output->lane_starts[i + 1] - output->lane_starts[i];
+        if (count > output->pixels_per_lane) {
+            output->pixels_per_lane = count;
+        }
+    }
+
+    size_t word_bytes = config->lane_count / 8;
+    size_t data_words = output->pixels_per_lane * LED_FRAMEBUFFER_BYTES_PER_PIXEL * 8 * LED_I80_WORDS_PER_BIT;
+    output->buffer_size = (data_words + LED_I80_RESET_WORDS) * word_bytes;
+    for (int i = 0; i < 2; i++) {
+        output->buffers[i] = led_mem_calloc(1, output->buffer_size, 4, MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA);
+        ESP_GOTO_ON_FALSE(output->buffers[i], ESP_ERR_NO_MEM, err, TAG, "no mem for %u byte DMA buffer", (unsigned)output->buffer_size);
+    }
+
+    esp_lcd_i80_bus_config_t bus_config = {
+        .clk_src = LCD_CLK_SRC_DEFAULT,
+        .dc_gpio_num = config->dc_gpio_num,
+        .wr_gpio_num = config->wr_gpio_num,
+        .bus_width = config->lane_count,
+        .max_transfer_bytes = output->buffer_size,
+    };
+    for (size_t i = 0; i < config->lane_count; i++) {
+        bus_config.data_gpio_nums[i] = config->data_gpio_nums[i];
+    }
+    ESP_GOTO_ON_ERROR(esp_lcd_new_i80_bus(&bus_config, &output->bus), err, TAG, "create i80 bus failed");
+
+    esp_lcd_panel_io_i80_config_t io_config = {
+        .cs_gpio_num = -1,
+        .pclk_hz = LED_I80_PCLK_HZ,
+        .trans_queue_depth = 2,
+        .on_color_trans_done = led_i80_output_on_trans_done,
+        .user_ctx = output,
+        .lcd_cmd_bits = 8,
+        .lcd_param_bits = 8,
+        .dc_levels = {
+            .dc_data_level = 1,
+        },
+    };
+    ESP_GOTO_ON_ERROR(esp_lcd_new_panel_io_i80(output->bus, &io_config, &output->io), err, TAG, "create i80 panel io failed");
+    ESP_LOGI(TAG, "i80 output: %u lanes, %u pixels per lane, %u byte frames", (unsigned)config->lane_count,
+             (unsigned)output->pixels_per_lane, (unsigned)output->buffer_size);
+    *ret_output = output;
+    return ESP_OK;
+err:
+    if (output) {
+        led_i80_output_del(output);
+    }
+    return ret;
+}
+
+esp_err_t led_i80_output_del(led_i80_output_handle_t output)
+{
+    ESP_RETURN_ON_FALSE(output, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    if (output->io) {
+        esp_lcd_panel_io_del(output->io);
+    }
+    if (output->bus) {
+        esp_lcd_del_i80_bus(output->bus);
+    }
+    for (int i = 0; i < 2; i++) {
+        led_mem_free(output->buffers[i]);
+    }
+    led_mem_free(output);
+    return ESP_OK;
+}
@@ -0,0 +1,90 @@
+/**
+ * @file led_i80_output.h
+ * @brief Parallel LED strip output over the LCD_CAM i80 bus
+ *
+ * Each data line of an 8 or 16 bit i80 bus drives one strip (a "lane").
+ * The framebuffer is split evenly across the lanes, transposed into
+ * bit-planes and streamed by DMA. Every WS2812 bit becomes three bus
+ * clocks at 2.4 MHz: high, the data bit, low. That gives 417 ns / 833 ns
+ * high times for 0 / 1 bits, so all lanes run at the normal 800 kHz bit rate.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LED_I80_MAX_LANES 16 /*!< Widest i80 bus on the ESP32-S3 */
+
+typedef struct led_i80_output_t *led_i80_output_handle_t;
+
+/**
+ * @brief Called from the LCD DMA ISR once a frame has been sent
+ *
+ * @return Whether a higher priority task was woken
+ */
+typedef bool (*led_i80_output_done_cb_t)(void *user_ctx);
+
+/**
+ * @brief i80 output configuration
+ */
+typedef struct {
+    const int *data_gpio_nums;  /*!< One GPIO per lane, lane_count entries */
+    size_t lane_count;          /*!< Bus width, 8 or 16 */
+    int wr_gpio_num;            /*!< Bus write clock, needs a free GPIO even though no strip uses it */
+    int dc_gpio_num;            /*!< Bus D/C line, needs a free GPIO even though no strip uses it */
+    size_t pixel_count;         /*!< Pixels over all lanes */
+    led_i80_output_done_cb_t on_done; /*!< Frame done callback */
+    void *user_ctx;             /*!< Passed to on_done */
+} led_i80_output_config_t;
+
+/**
+ * @brief Create the i80 bus, panel IO and both DMA bit-plane buffers
+ *
+ * @param[in] config Output configuration
+ * @param[out] ret_output Returned output handle
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NO_MEM out of memory for the DMA buffers
+ *      - ESP_OK if the output is ready
+ */
+esp_err_t led_i80_output_new(const led_i80_output_config_t *config, led_i80_output_handle_t *ret_output);
+
+/**
+ * @brief Release the bus and buffers, no frame may be in flight
+ */
+esp_err_t led_i80_output_del(led_i80_output_handle_t output);
+
+/**
+ * @brief Transpose a GRB framebuffer into the idle DMA buffer
+ *
+ * Safe to call while the previous frame is still on the bus, so the
+ * transpose overlaps with the transmission.
+ *
+ * @param[in] output Output handle
+ * @param[in] pixels GRB pixel data, pixel_count pixels as configured
+ */
+void led_i80_output_prepare(led_i80_output_handle_t output, const uint8_t *pixels);
+
+/**
+ * @brief Load the byte LUT the transpose applies, NULL restores the identity
+ *
+ * Takes effect from the next led_i80_output_prepare(), the table is copied.
+ */
+void led_i80_output_set_lut(led_i80_output_handle_t output, const uint8_t *lut);
+
+/**
+ * @brief Start sending the buffer filled by the last led_i80_output_prepare()
+ *
+ * The caller must make sure the previous frame is done (on_done) first.
+ */
+esp_err_t led_i80_output_start(led_i80_output_handle_t output);
+
+#ifdef __cplusplus
+}
+#endif
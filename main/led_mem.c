@@ -0,0 +1,104 @@
+/**
+ * @file led_mem.c
+ * @brief Bump allocator over a static arena, or the heap
+ */
+
+#include <string.h>
+#include "sdkconfig.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "led_mem.h"
+
+static const char *TAG = "led_mem";
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static size_t s_used;           // arena: bump offset, heap: live bytes
+static size_t s_allocations;    // live allocations
+
+#if CONFIG_LED_ARENA_ENABLE
+// .bss in internal RAM, DMA-capable on every target with RMT DMA or LCD_CAM
+static uint8_t s_arena[CONFIG_LED_ARENA_SIZE] __attribute__((aligned(16)));
+#define LED_MEM_CAPACITY sizeof(s_arena)
+#else
+#define LED_MEM_CAPACITY 0
+#endif
+
+void *led_mem_calloc(size_t count, size_t size, size_t align, uint32_t caps)
+{
+    if (size && count > SIZE_MAX / size) {
+        return NULL;
+    }
+    size_t bytes = count * size;
+    void *ptr = NULL;
+#if CONFIG_LED_ARENA_ENABLE
+    portENTER_CRITICAL(&s_lock);
+    size_t start = (s_used + align - 1) & ~(align - 1);
+    if (start <= sizeof(s_arena) && bytes <= sizeof(s_arena) - start) {
+        ptr = &s_arena[start];
+        s_used = start + bytes;
+        s_allocations++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    if (!ptr) {
+        ESP_LOGE(TAG, "arena full: %u bytes wanted, %u of %u used, raise CONFIG_LED_ARENA_SIZE", (unsigned)bytes,
+                 (unsigned)s_used, (unsigned)sizeof(s_arena));
+        return NULL;
+    }
+    // never reused, still zero from startup
+#else
+    ptr = heap_caps_aligned_calloc(align, 1, bytes, caps);
+    if (ptr) {
+        portENTER_CRITICAL(&s_lock);
+        s_used += heap_caps_get_allocated_size(ptr);
+        s_allocations++;
+        portEXIT_CRITICAL(&s_lock);
+    }
+#endif
+    return ptr;
+}
+
+void led_mem_free(void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+#if CONFIG_LED_ARENA_ENABLE
+    if ((uint8_t *)ptr >= s_arena && (uint8_t *)ptr < s_arena + sizeof(s_arena)) {
+        portENTER_CRITICAL(&s_lock);
+        s_allocations--;
+        portEXIT_CRITICAL(&s_lock);
+        return;
+    }
+#endif
+    size_t bytes = heap_caps_get_allocated_size(ptr);
+    heap_caps_free(ptr);
+    portENTER_CRITICAL(&s_lock);
+    s_used -= bytes;
+    s_allocations--;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void led_mem_get_usage(size_t *ret_used, size_t *ret_capacity)
+{
+    portENTER_CRITICAL(&s_lock);
+    if (ret_used) {
+        *ret_used = s_used;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    if (ret_capacity) {
+        *ret_capacity = LED_MEM_CAPACITY;
+    }
+}
+
+void led_mem_report(void)
+{
+    size_t used, capacity;
+    led_mem_get_usage(&used, &capacity);
+    if (capacity) {
+        ESP_LOGI(TAG, "arena: %u of %u bytes used, %u live allocations", (unsigned)used, (unsigned)capacity,
+                 (unsigned)s_allocations);
+    } else {
+        ESP_LOGI(TAG, "heap: %u bytes in %u allocations", (unsigned)used, (unsigned)s_allocations);
+    }
+}
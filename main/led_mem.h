@@ -0,0 +1,50 @@
+/**
+ * @file led_mem.h
+ * @brief Allocation for the LED modules, heap or static arena
+ *
+ * With CONFIG_LED_ARENA_ENABLE every allocation is carved out of a static
+ * internal-RAM block of CONFIG_LED_ARENA_SIZE bytes, so the footprint is
+ * known at link time and the heap never fragments. Without it these are
+ * thin wrappers around heap_caps. Either way allocations are counted for
+ * led_mem_report().
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Zeroed allocation of count * size bytes
+ *
+ * @param[in] count Number of elements
+ * @param[in] size Element size
+ * @param[in] align Alignment in bytes, power of two
+ * @param[in] caps MALLOC_CAP_* flags for the heap; the arena is internal DMA-capable RAM and satisfies all of them
+ * @return Memory, NULL if out of memory
+ */
+void *led_mem_calloc(size_t count, size_t size, size_t align, uint32_t caps);
+
+/**
+ * @brief Release memory from led_mem_calloc(), NULL is fine
+ *
+ * Arena memory is not reused, it stays counted as used.
+ */
+void led_mem_free(void *ptr);
+
+/**
+ * @brief Bytes in use and the capacity (0 when using the heap)
+ */
+void led_mem_get_usage(size_t *ret_used, size_t *ret_capacity);
+
+/**
+ * @brief Log the footprint
+ */
+void led_mem_report(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,487 @@
+/**
+ * @file led_net.c
+ * @brief DDP and E1.31 receivers, frame latching and paced playout
+ */
+
+#include <string.h>
+#include "esp_check.h"
+#include "lwip/igmp.h"
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+#include "lwip/priv/tcpip_priv.h"
+#include "led_net.h"
+#include "led_pixel_ops.h"
+
+static const char *TAG = "led_net";
+
+#define LED_NET_TASK_STACK 3072
+
+#define LED_NET_DDP_HEADER_LEN      10
+#define LED_NET_DDP_TIMECODE_LEN    4
+#define LED_NET_DDP_VERSION_MASK    0xC0
+#define LED_NET_DDP_VERSION_1       0x40
+#define LED_NET_DDP_FLAG_TIMECODE   0x10
+#define LED_NET_DDP_FLAG_STORAGE    0x08
+#define LED_NET_DDP_FLAG_REPLY      0x04
+#define LED_NET_DDP_FLAG_QUERY      0x02
+#define LED_NET_DDP_FLAG_PUSH       0x01
+#define LED_NET_DDP_ID_DISPLAY      1
+#define LED_NET_DDP_ID_ALL          255
+
+// E1.31 field offsets, ANSI E1.31-2018 section 4
+#define LED_NET_E131_ROOT_VECTOR    18
+#define LED_NET_E131_FRAME_VECTOR   40
+#define LED_NET_E131_SYNC_UNIVERSE  45 // in a synchronization packet
+#define LED_NET_E131_SYNC_LEN       49
+#define LED_NET_E131_DATA_SYNC      109
+#define LED_NET_E131_SEQUENCE       111
+#define LED_NET_E131_OPTIONS        112
+#define LED_NET_E131_UNIVERSE       113
+#define LED_NET_E131_DMP_VECTOR     117
+#define LED_NET_E131_VALUE_COUNT    123
+#define LED_NET_E131_START_CODE     125
+#define LED_NET_E131_HEADER_LEN     126
+#define LED_NET_E131_VECTOR_DATA    0x00000004
+#define LED_NET_E131_VECTOR_EXTENDED 0x00000008
+#define LED_NET_E131_VECTOR_FRAME_DATA 0x00000002
+#define LED_NET_E131_VECTOR_DMP     0x02
+#define LED_NET_E131_VECTOR_SYNC    0x00000001
+#define LED_NET_E131_OPTION_PREVIEW 0x80
+#define LED_NET_E131_OPTION_TERMINATED 0x40
+
+static const uint8_t s_e131_acn_id[12] = { 'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0 };
+
+// position k of a wire pixel takes RGB channel s_led_net_orders[order][k]
+static const uint8_t s_led_net_orders[LED_COLOR_ORDER_MAX][3] = {
+    [LED_COLOR_ORDER_GRB] = { 1, 0, 2 },
+    [LED_COLOR_ORDER_RGB] = { 0, 1, 2 },
+    [LED_COLOR_ORDER_BRG] = { 2, 0, 1 },
+    [LED_COLOR_ORDER_RBG] = { 0, 2, 1 },
+    [LED_COLOR_ORDER_GBR] = { 1, 2, 0 },
+    [LED_COLOR_ORDER_BGR] = { 2, 1, 0 },
+};
+
+static inline uint16_t led_net_be16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static inline uint32_t led_net_be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+/**
+ * @brief Buffer the current frame is received into, opening one if needed
+ *
+ * Takes a free buffer, or else the oldest frame waiting to be sent, which
+ * is then lost. -1 if the transmit side holds everything else.
+ */
+static int led_net_receiving(led_net_t *net)
+{
+    if (net->receiving >= 0) {
+        return net->receiving;
+    }
+    uint8_t slot;
+    if (xQueueReceive(net->free_frames, &slot, 0) != pdTRUE) {
+        if (xQueueReceive(net->ready_frames, &slot, 0) != pdTRUE) {
+            return -1;
+        }
+        net->stats.dropped_frames++;
+    }
+    net->receiving = slot;
+    net->received_start = SIZE_MAX;
+    net->received_end = 0;
+    net->last_write_start = SIZE_MAX;
+    net->last_write_end = SIZE_MAX;
+    net->e131_sync_universe = 0;
+    return slot;
+}
+
+/**
+ * @brief Reorder pixels [first, end) of fb from RGB into the strip's color order
+ */
+static void led_net_reorder(const led_net_t *net, led_framebuffer_t *fb, size_t first, size_t end)
+{
+    uint8_t *pixels = fb->pixels + first * LED_FRAMEBUFFER_BYTES_PER_PIXEL;
+    if (net->config.order == LED_COLOR_ORDER_GRB) {
+        led_pixel_rgb_to_grb(pixels, end - first);
+    } else if (net->config.order != LED_COLOR_ORDER_RGB) {
+        const uint8_t *order = s_led_net_orders[net->config.order];
+        for (size_t i = first; i < end; i++, pixels += LED_FRAMEBUFFER_BYTES_PER_PIXEL) {
+            uint8_t rgb[3] = { pixels[0], pixels[1], pixels[2] };
+            pixels[0] = rgb[order[0]];
+            pixels[1] = rgb[order[1]];
+            pixels[2] = rgb[order[2]];
+        }
+    }
+}
+
+/**
+ * @brief Copy len payload bytes at pbuf offset src into the current frame at byte offset dst
+ *
+ * Reorders the pixels the packet completes right away, so bytes left over
+ * from the buffer's previous frame (a lost packet) are never converted twice.
+ */
+static void led_net_write(led_net_t *net, struct pbuf *p, uint16_t src, size_t dst, size_t len)
+{
+    int slot = led_net_receiving(net);
+    if (slot < 0) {
+        net->stats.lost_packets++;
+        return;
+    }
+    led_framebuffer_t *fb = &net->frames[slot];
+    size_t size = led_framebuffer_size(fb);
+    if (dst >= size || !len) {
+        return;
+    }
+    if (len > size - dst) {
+        len = size - dst;
+    }
+    pbuf_copy_partial(p, fb->pixels + dst, len, src);
+    size_t end_byte = dst + len;
+    size_t first = (dst + LED_FRAMEBUFFER_BYTES_PER_PIXEL - 1) / LED_FRAMEBUFFER_BYTES_PER_PIXEL;
+    size_t end = end_byte / LED_FRAMEBUFFER_BYTES_PER_PIXEL;
+    // a pixel split with the packet before gets its other bytes from that one, only if they arrived back to back
+    if (dst % LED_FRAMEBUFFER_BYTES_PER_PIXEL && dst == net->last_write_end) {
+        first--;
+    }
+    if (end_byte % LED_FRAMEBUFFER_BYTES_PER_PIXEL && end_byte == net->last_write_start) {
+        end++;
+    }
+    if (end > first) {
+        led_net_reorder(net, fb, first, end);
+    }
+    net->last_write_start = dst;
+    net->last_write_end = end_byte;
+    net->received_start = dst < net->received_start ? dst : net->received_start;
+    net->received_end = dst + len > net->received_end ? dst + len : net->received_end;
+}
+
+/**
+ * @brief Current frame is complete: queue it for the transmit task
+ */
+static void led_net_latch(led_net_t *net)
+{
+    if (net->receiving < 0) {
+        return;
+    }
+    uint8_t slot = net->receiving;
+    led_framebuffer_t *fb = &net->frames[slot];
+    if (net->received_end > net->received_start) {
+        size_t first = net->received_start / LED_FRAMEBUFFER_BYTES_PER_PIXEL;
+        size_t end = (net->received_end + LED_FRAMEBUFFER_BYTES_PER_PIXEL - 1) / LED_FRAMEBUFFER_BYTES_PER_PIXEL;
+        led_framebuffer_mark_dirty(fb, first, end);
+    }
+    net->latch_us[slot] = esp_timer_get_time();
+    net->receiving = -1;
+    net->stats.frames++;
+    // the queue holds the whole pool, this never blocks
+    xQueueSend(net->ready_frames, &slot, 0);
+}
+
+/**
+ * @brief Hand the counters to led_net_get_stats(), which runs in other tasks
+ */
+static void led_net_publish_stats(led_net_t *net)
+{
+    portENTER_CRITICAL(&net->stats_lock);
+    net->published = net->stats;
+    portEXIT_CRITICAL(&net->stats_lock);
+}
+
+static void led_net_ddp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
+{
+    led_net_t *net = (led_net_t *)arg;
+    net->stats.packets++;
+    uint8_t header[LED_NET_DDP_HEADER_LEN];
+    if (pbuf_copy_partial(p, header, sizeof(header), 0) != sizeof(header)) {
+        goto bad;
+    }
+    uint8_t flags = header[0];
+    if ((flags & LED_NET_DDP_VERSION_MASK) != LED_NET_DDP_VERSION_1 ||
+            (flags & (LED_NET_DDP_FLAG_STORAGE | LED_NET_DDP_FLAG_REPLY | LED_NET_DDP_FLAG_QUERY)) ||
+            (header[3] != LED_NET_DDP_ID_DISPLAY && header[3] != LED_NET_DDP_ID_ALL)) {
+        goto bad;
+    }
+    uint16_t data_start = LED_NET_DDP_HEADER_LEN + (flags & LED_NET_DDP_FLAG_TIMECODE ? LED_NET_DDP_TIMECODE_LEN : 0);
+    uint16_t data_len = led_net_be16(&header[8]);
+    if (p->tot_len < data_start || data_len > p->tot_len - data_start) {
+        goto bad;
+    }
+    led_net_write(net, p, data_start, led_net_be32(&header[4]), data_len);
+    if (flags & LED_NET_DDP_FLAG_PUSH) {
+        led_net_latch(net);
+    }
+    pbuf_free(p);
+    led_net_publish_stats(net);
+    return;
+bad:
+    net->stats.bad_packets++;
+    pbuf_free(p);
+    led_net_publish_stats(net);
+}
+
+static void led_net_e131_data(led_net_t *net, struct pbuf *p, const uint8_t *header)
+{
+    uint16_t universe = led_net_be16(&header[LED_NET_E131_UNIVERSE]);
+    size_t index = (uint16_t)(universe - net->config.e131_universe);
+    // other universes on the same network are someone else's
+    if (index >= net->e131_universe_count || (header[LED_NET_E131_OPTIONS] & LED_NET_E131_OPTION_PREVIEW)) {
+        return;
+    }
+    // sequence numbers wrap, anything within 20 behind the last one is a reordered duplicate (E1.31 6.7.2)
+    int8_t age = (int8_t)(header[LED_NET_E131_SEQUENCE] - net->e131_sequence[index]);
+    if (net->e131_sequence[index] >= 0 && age <= 0 && age > -20) {
+        net->stats.late_packets++;
+        return;
+    }
+    net->e131_sequence[index] = header[LED_NET_E131_SEQUENCE];
+    if (header[LED_NET_E131_OPTIONS] & LED_NET_E131_OPTION_TERMINATED) {
+        return;
+    }
+
+    size_t count = led_net_be16(&header[LED_NET_E131_VALUE_COUNT]);
+    if (count < 1) {
+        // not even a start code
+        net->stats.bad_packets++;
+        return;
+    }
+    size_t len = count - 1;
+    len = len < LED_NET_E131_PIXEL_CHANNELS ? len : LED_NET_E131_PIXEL_CHANNELS;
+    size_t available = p->tot_len - LED_NET_E131_HEADER_LEN;
+    len = len < available ? len : available;
+    led_net_write(net, p, LED_NET_E131_HEADER_LEN, index * LED_NET_E131_PIXEL_CHANNELS, len);
+
+    uint16_t sync_universe = led_net_be16(&header[LED_NET_E131_DATA_SYNC]);
+    if (sync_universe) {
+        net->e131_sync_universe = sync_universe;
+    } else if (index == net->e131_universe_count - 1) {
+        led_net_latch(net);
+    }
+}
+
+static void led_net_e131_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
+{
+    led_net_t *net = (led_net_t *)arg;
+    net->stats.packets++;
+    uint8_t header[LED_NET_E131_HEADER_LEN];
+    uint16_t header_len = pbuf_copy_partial(p, header, sizeof(header), 0);
+    if (header_len < LED_NET_E131_SYNC_LEN || led_net_be16(&header[0]) != 0x0010 ||
+            memcmp(&header[4], s_e131_acn_id, sizeof(s_e131_acn_id))) {
+        goto bad;
+    }
+    uint32_t root_vector = led_net_be32(&header[LED_NET_E131_ROOT_VECTOR]);
+    uint32_t frame_vector = led_net_be32(&header[LED_NET_E131_FRAME_VECTOR]);
+    if (root_vector == LED_NET_E131_VECTOR_EXTENDED && frame_vector == LED_NET_E131_VECTOR_SYNC) {
+        uint16_t sync_universe = led_net_be16(&header[LED_NET_E131_SYNC_UNIVERSE]);
+        if (net->receiving >= 0 && net->e131_sync_universe == sync_universe) {
+            led_net_latch(net);
+        }
+    } else if (root_vector == LED_NET_E131_VECTOR_DATA && frame_vector == LED_NET_E131_VECTOR_FRAME_DATA) {
+        if (header_len < LED_NET_E131_HEADER_LEN || header[LED_NET_E131_DMP_VECTOR] != LED_NET_E131_VECTOR_DMP ||
+                header[LED_NET_E131_START_CODE] != 0) {
+            // short, or not plain DMX levels (e.g. a per-address priority packet)
+            goto bad;
+        }
+        led_net_e131_data(net, p, header);
+    } else {
+        goto bad;
+    }
+    pbuf_free(p);
+    led_net_publish_stats(net);
+    return;
+bad:
+    net->stats.bad_packets++;
+    pbuf_free(p);
+    led_net_publish_stats(net);
+}
+
+/**
+ * @brief Sends every latched frame once it is playout_delay_ms old
+ */
+static void led_net_tx_task(void *arg)
+{
+    led_net_t *net = (led_net_t *)arg;
+    int64_t delay_us = (int64_t)net->config.playout_delay_ms * 1000;
+    bool sent_any = false;
+    uint8_t on_wire = 0;
+    while (1) {
+        uint8_t slot;
+        xQueueReceive(net->ready_frames, &slot, portMAX_DELAY);
+        int64_t wait_us = net->latch_us[slot] + delay_us - esp_timer_get_time();
+        if (wait_us > 0) {
+            esp_timer_start_once(net->playout_timer, wait_us);
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        esp_err_t ret = led_controller_transmit_buffer(net->controller, &net->frames[slot], -1);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "frame not sent: %s", esp_err_to_name(ret));
+        }
+        // the previous frame is off the wire now, its buffer can be received into again
+        if (sent_any) {
+            xQueueSend(net->free_frames, &on_wire, portMAX_DELAY);
+        }
+        on_wire = slot;
+        sent_any = true;
+    }
+}
+
+static void led_net_playout_cb(void *arg)
+{
+    led_net_t *net = (led_net_t *)arg;
+    xTaskNotifyGive(net->tx_task);
+}
+
+typedef struct {
+    struct tcpip_api_call_data call; // must come first, lwIP hands this pointer back
+    led_net_t *net;
+} led_net_open_call_t;
+
+static struct udp_pcb *led_net_open(uint16_t port, udp_recv_fn recv, void *arg)
+{
+    struct udp_pcb *pcb = udp_new();
+    if (!pcb) {
+        return NULL;
+    }
+    if (udp_bind(pcb, IP_ANY_TYPE, port) != ERR_OK) {
+        udp_remove(pcb);
+        return NULL;
+    }
+    udp_recv(pcb, recv, arg);
+    return pcb;
+}
+
+/**
+ * @brief Opens the sockets, runs in the lwIP thread like the raw API requires
+ */
+static err_t led_net_open_sockets(struct tcpip_api_call_data *call)
+{
+    led_net_t *net = ((led_net_open_call_t *)call)->net;
+    if (net->config.protocols & LED_NET_PROTOCOL_DDP) {
+        net->ddp_pcb = led_net_open(LED_NET_DDP_PORT, led_net_ddp_recv, net);
+        if (!net->ddp_pcb) {
+            return ERR_MEM;
+        }
+    }
+    if (net->config.protocols & LED_NET_PROTOCOL_E131) {
+        net->e131_pcb = led_net_open(LED_NET_E131_PORT, led_net_e131_recv, net);
+        if (!net->e131_pcb) {
+            return ERR_MEM;
+        }
+        for (size_t i = 0; net->config.e131_multicast && i < net->e131_universe_count; i++) {
+            // 239.255.<universe high>.<universe low>
+            uint16_t universe = net->config.e131_universe + i;
+            ip4_addr_t group;
+            IP4_ADDR(&group, 239, 255, universe >> 8, universe & 0xFF);
+            if (igmp_joingroup(IP4_ADDR_ANY4, &group) != ERR_OK) {
+                ESP_LOGW(TAG, "could not join the group of universe %u", universe);
+            }
+        }
+    }
+    return ERR_OK;
+}
+
+static err_t led_net_close_sockets(struct tcpip_api_call_data *call)
+{
+    led_net_t *net = ((led_net_open_call_t *)call)->net;
+    if (net->ddp_pcb) {
+        udp_remove(net->ddp_pcb);
+        net->ddp_pcb = NULL;
+    }
+    if (net->e131_pcb) {
+        udp_remove(net->e131_pcb);
+        net->e131_pcb = NULL;
+    }
+    return ERR_OK;
+}
+
+static void led_net_release(led_net_t *net)
+{
+    if (net->ddp_pcb || net->e131_pcb) {
+        led_net_open_call_t call = { .net = net };
+        tcpip_api_call(led_net_close_sockets, &call.call);
+    }
+    if (net->playout_timer) {
+        esp_timer_delete(net->playout_timer);
+    }
+    if (net->free_frames) {
+        vQueueDelete(net->free_frames);
+    }
+    if (net->ready_frames) {
+        vQueueDelete(net->ready_frames);
+    }
+    for (size_t i = 0; i < LED_NET_MAX_FRAMES; i++) {
+        led_framebuffer_deinit(&net->frames[i]);
+    }
+    memset(net, 0, sizeof(*net));
+}
+
+esp_err_t led_net_init(const led_net_config_t *config, led_controller_t *controller, led_net_t *net)
+{
+    esp_err_t ret = ESP_OK;
+    ESP_RETURN_ON_FALSE(config && controller && net && config->protocols && config->order < LED_COLOR_ORDER_MAX,
+                        ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(config->frame_count >= 3 && config->frame_count <= LED_NET_MAX_FRAMES, ESP_ERR_INVALID_ARG,
+                        TAG, "frame count must be 3-%d", LED_NET_MAX_FRAMES);
+    size_t pixel_count = controller->frames[0].pixel_count;
+    size_t universe_count = (pixel_count * LED_FRAMEBUFFER_BYTES_PER_PIXEL + LED_NET_E131_PIXEL_CHANNELS - 1) /
+                            LED_NET_E131_PIXEL_CHANNELS;
+    ESP_RETURN_ON_FALSE(!(config->protocols & LED_NET_PROTOCOL_E131) ||
+                        (universe_count <= LED_NET_MAX_UNIVERSES && config->e131_universe >= 1 &&
+                         config->e131_universe + universe_count - 1 <= 63999),
+                        ESP_ERR_INVALID_ARG, TAG, "strip doesn't fit universes %u-63999", config->e131_universe);
+    memset(net, 0, sizeof(*net));
+    net->config = *config;
+    net->controller = controller;
+    net->receiving = -1;
+    portMUX_INITIALIZE(&net->stats_lock);
+    net->e131_universe_count = universe_count;
+    for (size_t i = 0; i < LED_NET_MAX_UNIVERSES; i++) {
+        net->e131_sequence[i] = -1;
+    }
+
+    net->free_frames = xQueueCreateStatic(config->frame_count, sizeof(uint8_t), net->free_frames_storage,
+                                          &net->free_frames_buffer);
+    net->ready_frames = xQueueCreateStatic(config->frame_count, sizeof(uint8_t), net->ready_frames_storage,
+                                           &net->ready_frames_buffer);
+    for (uint8_t i = 0; i < config->frame_count; i++) {
+        ESP_GOTO_ON_ERROR(led_framebuffer_init(&net->frames[i], pixel_count), err, TAG, "create framebuffer failed");
+        xQueueSend(net->free_frames, &i, 0);
+    }
+
+    esp_timer_create_args_t timer_args = {
+        .callback = led_net_playout_cb,
+        .arg = net,
+        .name = "led_net_playout",
+    };
+    ESP_GOTO_ON_ERROR(esp_timer_create(&timer_args, &net->playout_timer), err, TAG, "create playout timer failed");
+    ESP_GOTO_ON_FALSE(xTaskCreatePinnedToCore(led_net_tx_task, "led_net_tx", LED_NET_TASK_STACK, net, config->tx_priority,
+                                              &net->tx_task, config->tx_core) == pdPASS,
+                      ESP_ERR_NO_MEM, err, TAG, "create transmit task failed");
+
+    // sockets last, packets start arriving as soon as they are open
+    led_net_open_call_t call = { .net = net };
+    if (tcpip_api_call(led_net_open_sockets, &call.call) != ERR_OK) {
+        // the task is blocked on an empty queue, nothing else can have touched the pool yet
+        vTaskDelete(net->tx_task);
+        ESP_LOGE(TAG, "open sockets failed");
+        ret = ESP_FAIL;
+        goto err;
+    }
+    ESP_LOGI(TAG, "listening for%s%s, %u pixels", net->ddp_pcb ? " DDP" : "", net->e131_pcb ? " E1.31" : "",
+             (unsigned)pixel_count);
+    return ESP_OK;
+err:
+    led_net_release(net);
+    return ret;
+}
+
+esp_err_t led_net_get_stats(led_net_t *net, led_net_stats_t *ret_stats)
+{
+    ESP_RETURN_ON_FALSE(net && ret_stats, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    portENTER_CRITICAL(&net->stats_lock);
+    *ret_stats = net->published;
+    portEXIT_CRITICAL(&net->stats_lock);
+    return ESP_OK;
+}
@@ -0,0 +1,141 @@
+/**
+ * @file led_net.h
+ * @brief Frames from the network: DDP and E1.31 (sACN) over UDP
+ *
+ * Packets are handled in the lwIP thread straight from their pbufs: the
+ * pixel payload is copied once, from the pbuf into a framebuffer of a
+ * small pool, and that framebuffer is what goes out on the wire. A frame
+ * is latched when the sender says it is complete (DDP push flag, E1.31
+ * synchronization packet, or the last universe of the strip when the
+ * sender doesn't use sync), then handed to a transmit task.
+ *
+ * The transmit task is the jitter buffer: every frame goes out
+ * playout_delay_ms after it was latched, so frames that arrive in bursts
+ * over Wi-Fi are sent as evenly as they were rendered. A frame that can't
+ * get a buffer because the transmit side is behind replaces the oldest
+ * frame still waiting.
+ *
+ * Pixels a frame doesn't cover keep whatever their buffer held, senders
+ * are expected to send the whole strip every frame. Each packet's pixels
+ * are put into the strip's color order as it arrives; a pixel split
+ * across two packets only if they arrive one after the other.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "led_controller.h"
+#include "led_effects.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LED_NET_DDP_PORT           4048 /*!< DDP's UDP port */
+#define LED_NET_E131_PORT          5568 /*!< E1.31's UDP port */
+#define LED_NET_MAX_FRAMES         8    /*!< Framebuffer pool size limit */
+#define LED_NET_MAX_UNIVERSES      32   /*!< E1.31 universes one strip can span */
+#define LED_NET_E131_PIXEL_CHANNELS 510 /*!< DMX channels used per universe, 170 whole pixels */
+
+/**
+ * @brief Protocols to listen for, can be or-ed together
+ */
+typedef enum {
+    LED_NET_PROTOCOL_DDP = 1 << 0,  /*!< DDP on LED_NET_DDP_PORT, offsets in bytes across the whole strip */
+    LED_NET_PROTOCOL_E131 = 1 << 1, /*!< E1.31 on LED_NET_E131_PORT, 170 pixels per universe */
+} led_net_protocol_t;
+
+/**
+ * @brief Network input configuration
+ */
+typedef struct {
+    uint32_t protocols;         /*!< led_net_protocol_t flags */
+    led_color_order_t order;    /*!< Strip color order, both protocols send RGB */
+    size_t frame_count;         /*!< Framebuffers in the pool, 3-LED_NET_MAX_FRAMES. One is being received, one or
+                                     two are held by the transmit side, the rest absorb bursts */
+    uint32_t playout_delay_ms;  /*!< Send each frame this long after it was latched, 0 sends right away */
+    uint16_t e131_universe;     /*!< E1.31 universe of the first pixel, the strip continues in the following ones */
+    bool e131_multicast;        /*!< Join the multicast group of every universe, not just unicast */
+    BaseType_t tx_core;         /*!< Core the transmit task is pinned to */
+    UBaseType_t tx_priority;    /*!< Transmit task priority */
+} led_net_config_t;
+
+/**
+ * @brief Network input counters
+ */
+typedef struct {
+    uint32_t packets;           /*!< Packets received on either port */
+    uint32_t bad_packets;       /*!< Malformed or unsupported packets, ignored */
+    uint32_t late_packets;      /*!< E1.31 packets older than one already received for their universe, ignored */
+    uint32_t lost_packets;      /*!< Packets that found no free buffer, every other one was in use */
+    uint32_t frames;            /*!< Frames latched */
+    uint32_t dropped_frames;    /*!< Latched frames replaced by a newer one before they were sent */
+} led_net_stats_t;
+
+/**
+ * @brief Network input state
+ */
+typedef struct {
+    led_net_config_t config;    /*!< Copy of the configuration */
+    led_controller_t *controller; /*!< Where frames are sent */
+    led_framebuffer_t frames[LED_NET_MAX_FRAMES]; /*!< The pool */
+    int64_t latch_us[LED_NET_MAX_FRAMES]; /*!< When each ready frame was latched */
+    QueueHandle_t free_frames;  /*!< Pool indices ready to be received into */
+    QueueHandle_t ready_frames; /*!< Latched pool indices waiting to be sent, in order */
+    StaticQueue_t free_frames_buffer;  /*!< Queue storage */
+    StaticQueue_t ready_frames_buffer; /*!< Queue storage */
+    uint8_t free_frames_storage[LED_NET_MAX_FRAMES];  /*!< Queue items */
+    uint8_t ready_frames_storage[LED_NET_MAX_FRAMES]; /*!< Queue items */
+    int receiving;              /*!< Pool index being received into, -1 for none. lwIP thread only, like
+                                     everything down to e131_sequence */
+    size_t received_start;      /*!< First byte of the current frame written so far */
+    size_t received_end;        /*!< One past the last one */
+    size_t last_write_start;    /*!< Byte range of the previous packet, to finish a pixel split across two */
+    size_t last_write_end;      /*!< One past its last byte, SIZE_MAX before the first packet of a frame */
+    uint16_t e131_sync_universe; /*!< Sync universe the current frame waits for, 0 to latch on the last universe */
+    size_t e131_universe_count; /*!< Universes the strip spans */
+    int16_t e131_sequence[LED_NET_MAX_UNIVERSES]; /*!< Last sequence number per universe, -1 before the first */
+    struct udp_pcb *ddp_pcb;    /*!< DDP socket, NULL if not listening */
+    struct udp_pcb *e131_pcb;   /*!< E1.31 socket, NULL if not listening */
+    TaskHandle_t tx_task;       /*!< Transmit task */
+    esp_timer_handle_t playout_timer; /*!< Wakes the transmit task when the next frame is due */
+    led_net_stats_t stats;      /*!< Counters, lwIP thread only */
+    led_net_stats_t published;  /*!< Copy of stats as of the last packet, what led_net_get_stats() reads */
+    portMUX_TYPE stats_lock;    /*!< Guards published */
+} led_net_t;
+
+/**
+ * @brief Allocate the pool, open the sockets and start the transmit task
+ *
+ * Call once the network is up, multicast groups are joined on the
+ * interfaces that exist at this point. The controller is used from the
+ * transmit task only from then on, and the input runs for the rest of
+ * the program.
+ *
+ * @param[in] config Network input configuration
+ * @param[in] controller Strip to show the frames on
+ * @param[out] net State to initialize, must stay at the same address forever
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NO_MEM out of memory
+ *      - ESP_FAIL a socket could not be opened
+ *      - ESP_OK if the input is listening
+ */
+esp_err_t led_net_init(const led_net_config_t *config, led_controller_t *controller, led_net_t *net);
+
+/**
+ * @brief Copy the counters, safe to call from any task
+ *
+ * The lwIP thread publishes them after every packet, so they always
+ * agree with each other but may be one packet behind.
+ */
+esp_err_t led_net_get_stats(led_net_t *net, led_net_stats_t *ret_stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,185 @@
+/**
+ * @file led_pipeline.c
+ * @brief Render/transmit tasks and the framebuffer pool between them
+ *
+ * Pool slots circulate through two queues: the render task takes a slot
+ * from free_frames, draws it and puts it on ready_frames; the transmit
+ * task sends it and returns the slot it sent before, which the fence in
+ * led_controller_transmit_buffer() has just seen leave the wire.
+ */
+
+#include <string.h>
+#include "esp_check.h"
+#include "led_pipeline.h"
+
+static const char *TAG = "led_pipeline";
+
+#define LED_PIPELINE_RENDER_STACK 4096
+#define LED_PIPELINE_TX_STACK     4096
+
+/**
+ * @brief Transmit loop with dithering, never returns
+ *
+ * Rendered frames are copied into the working frame, so their slot goes
+ * straight back to the render task. Refreshes are paced by their own
+ * scheduler, the render rate only decides how often the content changes.
+ */
+static void led_pipeline_dither_loop(led_pipeline_t *pipeline)
+{
+    led_controller_t *controller = &pipeline->controller;
+    uint32_t fps = pipeline->config.dither_fps;
+    if (fps) {
+        led_scheduler_config_t scheduler_config = {
+            .target_fps = fps,
+            .power_save = pipeline->config.controller.power_save,
+        };
+        ESP_ERROR_CHECK(led_scheduler_init(&scheduler_config, &pipeline->dither_scheduler));
+    }
+    bool loaded = false;
+    while (1) {
+        if (fps) {
+            led_scheduler_frame_t info;
+            led_scheduler_wait_frame(&pipeline->dither_scheduler, &info);
+        }
+        uint8_t slot;
+        // nothing to show until the first frame, after that refresh whether or not a new one came in
+        if (xQueueReceive(pipeline->ready_frames, &slot, loaded ? 0 : portMAX_DELAY) == pdTRUE) {
+            led_controller_dither_load(controller, pipeline->frames[slot]);
+            xQueueSend(pipeline->free_frames, &slot, portMAX_DELAY);
+            loaded = true;
+        }
+        esp_err_t ret = led_controller_dither_refresh(controller, -1);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "frame not sent: %s", esp_err_to_name(ret));
+        }
+        if (fps) {
+            // nothing more to do until the next refresh is due
+            led_controller_idle(controller, -1);
+        }
+    }
+}
+
+static void led_pipeline_tx_task(void *arg)
+{
+    led_pipeline_t *pipeline = (led_pipeline_t *)arg;
+    // created here so the output interrupt is allocated on this core
+    esp_err_t init_ret = led_controller_init(&pipeline->config.controller, &pipeline->controller);
+    pipeline->init_ret = init_ret;
+    // on failure the creator releases the pipeline right away, don't touch it after this
+    xTaskNotifyGive(pipeline->creator);
+    if (init_ret != ESP_OK) {
+        vTaskDelete(NULL);
+    }
+
+    if (pipeline->config.controller.dither) {
+        led_pipeline_dither_loop(pipeline);
+    }
+
+    bool sent_any = false;
+    uint8_t on_wire = 0;
+    while (1) {
+        uint8_t slot;
+        xQueueReceive(pipeline->ready_frames, &slot, portMAX_DELAY);
+        esp_err_t ret = led_controller_transmit_buffer(&pipeline->controller, pipeline->frames[slot], -1);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "frame not sent: %s", esp_err_to_name(ret));
+        }
+        // the previous frame is off the wire now, its slot can be drawn into again
+        if (sent_any) {
+            xQueueSend(pipeline->free_frames, &on_wire, portMAX_DELAY);
+        }
+        on_wire = slot;
+        sent_any = true;
+        if (!uxQueueMessagesWaiting(pipeline->ready_frames)) {
+            // no frame rendered ahead, let the chip sleep until the render task has one
+            led_controller_idle(&pipeline->controller, -1);
+        }
+    }
+}
+
+static void led_pipeline_render_task(void *arg)
+{
+    led_pipeline_t *pipeline = (led_pipeline_t *)arg;
+    // the scheduler wakes the task that creates it, so it has to be this one
+    led_scheduler_config_t scheduler_config = {
+        .target_fps = pipeline->config.target_fps,
+        .power_save = pipeline->config.controller.power_save,
+    };
+    ESP_ERROR_CHECK(led_scheduler_init(&scheduler_config, &pipeline->scheduler));
+
+    while (1) {
+        led_scheduler_frame_t info;
+        led_scheduler_wait_frame(&pipeline->scheduler, &info);
+        uint8_t slot;
+        xQueueReceive(pipeline->free_frames, &slot, portMAX_DELAY);
+        pipeline->config.render_cb(pipeline->frames[slot], &info, pipeline->config.user_ctx);
+        xQueueSend(pipeline->ready_frames, &slot, portMAX_DELAY);
+    }
+}
+
+static void led_pipeline_release(led_pipeline_t *pipeline)
+{
+    for (size_t i = 0; i < LED_PIPELINE_MAX_FRAMES; i++) {
+        led_framebuffer_deinit(&pipeline->extra_frames[i]);
+    }
+    if (pipeline->free_frames) {
+        vQueueDelete(pipeline->free_frames);
+    }
+    if (pipeline->ready_frames) {
+        vQueueDelete(pipeline->ready_frames);
+    }
+    memset(pipeline, 0, sizeof(*pipeline));
+}
+
+esp_err_t led_pipeline_init(const led_pipeline_config_t *config, led_pipeline_t *pipeline)
+{
+    esp_err_t ret = ESP_OK;
+    ESP_RETURN_ON_FALSE(config && pipeline && config->render_cb && config->target_fps, ESP_ERR_INVALID_ARG, TAG,
+                        "invalid argument");
+    ESP_RETURN_ON_FALSE(config->frame_count >= 2 && config->frame_count <= LED_PIPELINE_MAX_FRAMES, ESP_ERR_INVALID_ARG,
+                        TAG, "frame count must be 2-%d", LED_PIPELINE_MAX_FRAMES);
+    ESP_RETURN_ON_FALSE(config->render_core != config->tx_core, ESP_ERR_INVALID_ARG, TAG, "render and tx need their own cores");
+    memset(pipeline, 0, sizeof(*pipeline));
+    pipeline->config = *config;
+
+    pipeline->free_frames = xQueueCreateStatic(config->frame_count, sizeof(uint8_t), pipeline->free_frames_storage,
+                                               &pipeline->free_frames_buffer);
+    pipeline->ready_frames = xQueueCreateStatic(config->frame_count, sizeof(uint8_t), pipeline->ready_frames_storage,
+                                                &pipeline->ready_frames_buffer);
+    // the controller's own two buffers are the first pool slots, unless they carry the dithered frames
+    size_t own_frames = config->controller.dither ? 0 : 2;
+    for (size_t i = own_frames; i < config->frame_count; i++) {
+        ESP_GOTO_ON_ERROR(led_framebuffer_init(&pipeline->extra_frames[i - own_frames], config->controller.pixel_count),
+                          err, TAG, "create framebuffer failed");
+    }
+
+    pipeline->creator = xTaskGetCurrentTaskHandle();
+    ESP_GOTO_ON_FALSE(xTaskCreatePinnedToCore(led_pipeline_tx_task, "led_tx", LED_PIPELINE_TX_STACK, pipeline,
+                                              config->tx_priority, &pipeline->tx_task, config->tx_core) == pdPASS,
+                      ESP_ERR_NO_MEM, err, TAG, "create tx task failed");
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    ESP_GOTO_ON_ERROR(pipeline->init_ret, err, TAG, "init controller failed");
+
+    for (size_t i = 0; i < config->frame_count; i++) {
+        pipeline->frames[i] = i < own_frames ? &pipeline->controller.frames[i] : &pipeline->extra_frames[i - own_frames];
+    }
+    for (uint8_t i = 0; i < config->frame_count; i++) {
+        xQueueSend(pipeline->free_frames, &i, 0);
+    }
+
+    if (xTaskCreatePinnedToCore(led_pipeline_render_task, "led_render", LED_PIPELINE_RENDER_STACK, pipeline,
+                                config->render_priority, &pipeline->render_task, config->render_core) != pdPASS) {
+        // nothing has been queued yet, so the tx task is idle in xQueueReceive
+        vTaskDelete(pipeline->tx_task);
+        led_controller_deinit(&pipeline->controller);
+        ESP_LOGE(TAG, "create render task failed");
+        ret = ESP_ERR_NO_MEM;
+        goto err;
+    }
+    ESP_LOGI(TAG, "render on core %d, tx on core %d, %u frames", (int)config->render_core, (int)config->tx_core,
+             (unsigned)config->frame_count);
+    return ESP_OK;
+err:
+    led_pipeline_release(pipeline);
+    return ret;
+}
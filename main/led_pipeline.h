@@ -0,0 +1,120 @@
+/**
+ * @file led_pipeline.h
+ * @brief Render and transmit on separate cores
+ *
+ * A render task pinned to one core draws frames into a small pool of
+ * framebuffers and queues them; a transmit task pinned to the other core
+ * owns the LED controller and sends whatever is queued. The controller is
+ * created from the transmit task, so the RMT (or LCD) interrupt lands on
+ * the transmit core too and never preempts rendering.
+ *
+ * Rendering frame N+1 overlaps with sending frame N; with a compute-heavy
+ * effect the frame rate is bounded by max(render, transmit) instead of
+ * their sum.
+ *
+ * With controller.dither set, the transmit task decouples from the render
+ * rate: every rendered frame is loaded into the controller's working
+ * frame, and dithered refreshes of it go out at dither_fps in between.
+ *
+ * With controller.power_save both tasks run at full speed only while they
+ * have a frame to work on, and the transmit task takes the RMT channels
+ * down whenever it runs out of frames (see led_controller_idle()), so the
+ * chip can light-sleep until the next deadline.
+ */
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "led_controller.h"
+#include "led_scheduler.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LED_PIPELINE_MAX_FRAMES 4 /*!< Framebuffer pool size limit */
+
+/**
+ * @brief Draws one frame, called from the render task
+ *
+ * The buffer holds whatever was rendered into it frame_count frames ago,
+ * effects that don't redraw every pixel have to account for that.
+ *
+ * @param[out] frame Buffer to draw into
+ * @param[in] info Which frame is due, see led_scheduler_wait_frame()
+ * @param[in] user_ctx led_pipeline_config_t::user_ctx
+ */
+typedef void (*led_pipeline_render_cb_t)(led_framebuffer_t *frame, const led_scheduler_frame_t *info, void *user_ctx);
+
+/**
+ * @brief Pipeline configuration
+ */
+typedef struct {
+    led_controller_config_t controller; /*!< Strip configuration, the controller is created on the transmit core */
+    led_pipeline_render_cb_t render_cb; /*!< Frame renderer */
+    void *user_ctx;             /*!< Passed to render_cb */
+    uint32_t target_fps;        /*!< Render rate */
+    size_t frame_count;         /*!< Framebuffers in the pool, 2-LED_PIPELINE_MAX_FRAMES. 2 reuses the controller's
+                                     own buffers, every extra one lets rendering run one more frame ahead */
+    BaseType_t render_core;     /*!< Core the render task is pinned to */
+    BaseType_t tx_core;         /*!< Core the transmit task and the output interrupt are pinned to */
+    UBaseType_t render_priority; /*!< Render task priority */
+    UBaseType_t tx_priority;    /*!< Transmit task priority, above render_priority so frames go out on time */
+    uint32_t dither_fps;        /*!< With controller.dither, refresh rate of the dithered output, 0 for as fast as
+                                     the wire goes */
+} led_pipeline_config_t;
+
+/**
+ * @brief Pipeline state
+ */
+typedef struct {
+    led_pipeline_config_t config; /*!< Copy of the configuration */
+    led_controller_t controller;  /*!< Owned by the transmit task */
+    led_framebuffer_t extra_frames[LED_PIPELINE_MAX_FRAMES]; /*!< Pool slots beyond the controller's two buffers, all
+                                                                  of them when dithering (the controller's send the
+                                                                  dithered frames) */
+    led_framebuffer_t *frames[LED_PIPELINE_MAX_FRAMES]; /*!< The whole pool */
+    QueueHandle_t free_frames;    /*!< Pool indices ready to be rendered into */
+    QueueHandle_t ready_frames;   /*!< Rendered pool indices waiting to be sent, in order */
+    StaticQueue_t free_frames_buffer;  /*!< Queue storage, the pipeline allocates nothing but its extra frames */
+    StaticQueue_t ready_frames_buffer; /*!< Queue storage */
+    uint8_t free_frames_storage[LED_PIPELINE_MAX_FRAMES];  /*!< Queue items */
+    uint8_t ready_frames_storage[LED_PIPELINE_MAX_FRAMES]; /*!< Queue items */
+    TaskHandle_t render_task;     /*!< Render task */
+    TaskHandle_t tx_task;         /*!< Transmit task */
+    TaskHandle_t creator;         /*!< Task waiting in led_pipeline_init() for the controller */
+    esp_err_t init_ret;           /*!< Controller init result handed back to the creator */
+    led_scheduler_t scheduler;    /*!< Render pacing, owned by the render task */
+    led_scheduler_t dither_scheduler; /*!< Refresh pacing with dithering, owned by the transmit task */
+} led_pipeline_t;
+
+/**
+ * @brief Create the controller on the transmit core and start both tasks
+ *
+ * Frames start going out right away and the pipeline runs for the rest of
+ * the program.
+ *
+ * @param[in] config Pipeline configuration
+ * @param[out] pipeline Pipeline to initialize, must stay at the same address forever
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NO_MEM out of memory
+ *      - Whatever led_controller_init() returned on the transmit core
+ *      - ESP_OK if both tasks are running
+ */
+esp_err_t led_pipeline_init(const led_pipeline_config_t *config, led_pipeline_t *pipeline);
+
+/**
+ * @brief The controller, for settings like led_controller_set_correction()
+ */
+static inline led_controller_t *led_pipeline_controller(led_pipeline_t *pipeline)
+{
+    return &pipeline->controller;
+}
+
+#ifdef __cplusplus
+}
+#endif
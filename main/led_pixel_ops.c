@@ -0,0 +1,90 @@
+/**
+ * @file led_pixel_ops.c
+ * @brief Portable pixel kernels and the dispatch to the PIE ones
+ */
+
+#include <string.h>
+#include "sdkconfig.h"
+#include "led_pixel_ops.h"
+
+#if CONFIG_IDF_TARGET_ESP32S3
+#define LED_PIXEL_SIMD_BYTES 16
+
+/**
+ * @brief PIE kernel in led_pixel_ops_esp32s3.S
+ *
+ * buf must be 16-byte aligned, blocks counts 16-byte blocks, factor points
+ * at the 8-bit multiplier (broadcast-loaded into every lane).
+ */
+extern void led_pixel_scale_aes3(uint8_t *buf, size_t blocks, const uint8_t *factor);
+#endif
+
+static void led_pixel_scale_c(uint8_t *buf, size_t len, uint32_t factor)
+{
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (uint8_t)((buf[i] * factor) >> 8);
+    }
+}
+
+void led_pixel_scale(uint8_t *buf, size_t len, uint8_t scale)
+{
+    if (scale == 255) {
+        return;
+    }
+    // (scale + 1) keeps the multiplier in 8 bits for the SIMD lanes
+    uint8_t factor = scale + 1;
+#if CONFIG_IDF_TARGET_ESP32S3
+    size_t head = (LED_PIXEL_SIMD_BYTES - ((uintptr_t)buf & (LED_PIXEL_SIMD_BYTES - 1))) & (LED_PIXEL_SIMD_BYTES - 1);
+    if (head > len) {
+        head = len;
+    }
+    led_pixel_scale_c(buf, head, factor);
+    buf += head;
+    len -= head;
+    size_t blocks = len / LED_PIXEL_SIMD_BYTES;
+    if (blocks) {
+        led_pixel_scale_aes3(buf, blocks, &factor);
+        buf += blocks * LED_PIXEL_SIMD_BYTES;
+        len -= blocks * LED_PIXEL_SIMD_BYTES;
+    }
+#endif
+    led_pixel_scale_c(buf, len, factor);
+}
+
+void led_pixel_apply_lut(uint8_t *buf, size_t len, const uint8_t lut[256])
+{
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = lut[buf[i]];
+    }
+}
+
+void led_pixel_rgb_to_grb(uint8_t *buf, size_t pixel_count)
+{
+    for (size_t i = 0; i < pixel_count; i++) {
+        uint8_t r = buf[0];
+        buf[0] = buf[1];
+        buf[1] = r;
+        buf += 3;
+    }
+}
+
+void led_pixel_blend(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t len, uint8_t alpha)
+{
+    // weights out of 256 so the divide is a shift, alpha 255 maps to exactly 256
+    uint32_t wa = alpha + (alpha >> 7);
+    uint32_t wb = 256 - wa;
+    size_t i = 0;
+    // 4 bytes per step as two 16-bit lanes per multiply, a*wa + b*wb never exceeds 16 bits
+    for (; i + 4 <= len; i += 4) {
+        uint32_t x, y;
+        memcpy(&x, &a[i], 4);
+        memcpy(&y, &b[i], 4);
+        uint32_t even = (((x & 0x00FF00FF) * wa + (y & 0x00FF00FF) * wb) >> 8) & 0x00FF00FF;
+        uint32_t odd = (((x >> 8) & 0x00FF00FF) * wa + ((y >> 8) & 0x00FF00FF) * wb) & 0xFF00FF00;
+        uint32_t out = even | odd;
+        memcpy(&dst[i], &out, 4);
+    }
+    for (; i < len; i++) {
+        dst[i] = (uint8_t)((a[i] * wa + b[i] * wb) >> 8);
+    }
+}
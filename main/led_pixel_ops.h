@@ -0,0 +1,56 @@
+/**
+ * @file led_pixel_ops.h
+ * @brief Whole-buffer pixel post-processing
+ *
+ * Everything here works on raw byte ranges (normally a framebuffer's
+ * `pixels`), so one call processes the whole strip. On the ESP32-S3 the
+ * brightness multiply runs on the PIE SIMD unit 16 bytes at a time, other
+ * targets and unaligned heads/tails use the portable C path.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Scale every byte by (scale + 1) / 256
+ *
+ * 255 leaves the buffer untouched, 0 turns it off.
+ *
+ * @param[inout] buf Bytes to scale, 16-byte alignment gets the SIMD path from the first byte
+ * @param[in] len Number of bytes
+ * @param[in] scale Brightness, 0-255
+ */
+void led_pixel_scale(uint8_t *buf, size_t len, uint8_t scale);
+
+/**
+ * @brief Replace every byte by lut[byte] (gamma curves and the like)
+ */
+void led_pixel_apply_lut(uint8_t *buf, size_t len, const uint8_t lut[256]);
+
+/**
+ * @brief Swap the first two bytes of every 3-byte pixel, RGB <-> GRB
+ *
+ * For pixel data coming in RGB order (files, network) that has to go
+ * out to WS2812 strips.
+ */
+void led_pixel_rgb_to_grb(uint8_t *buf, size_t pixel_count);
+
+/**
+ * @brief Cross-fade two buffers: dst = a * alpha + b * (1 - alpha)
+ *
+ * @param[out] dst Result, may be the same buffer as a or b
+ * @param[in] a Buffer shown at alpha 255
+ * @param[in] b Buffer shown at alpha 0
+ * @param[in] len Number of bytes
+ * @param[in] alpha Weight of a, 0-255
+ */
+void led_pixel_blend(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t len, uint8_t alpha);
+
+#ifdef __cplusplus
+}
+#endif
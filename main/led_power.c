@@ -0,0 +1,41 @@
+/**
+ * @file led_power.c
+ * @brief Per-frame current estimate and limit
+ */
+
+#include <math.h>
+#include <string.h>
+#include "led_power.h"
+
+void led_power_init(led_power_t *power, const led_power_config_t *config)
+{
+    memset(power, 0, sizeof(*power));
+    power->config = *config;
+    power->scale = 255;
+}
+
+uint8_t led_power_limit(led_power_t *power, uint32_t duty_sum, size_t pixel_count, uint8_t brightness)
+{
+    const led_power_config_t *config = &power->config;
+    float idle_ua = (float)pixel_count * config->idle_ua;
+    float lit_ua = duty_sum * (config->channel_ua / 255.0f);
+    // led_pixel_scale() multiplies by (scale + 1) / 256 before the curve, so the duty goes with that to the gamma
+    float draw_ua = lit_ua * powf((brightness + 1) / 256.0f, config->gamma) + idle_ua;
+    power->estimate_ma = (uint32_t)(draw_ua / 1000.0f);
+    power->scale = brightness;
+    float budget_ua = config->budget_ma * 1000.0f;
+    if (!config->budget_ma || draw_ua <= budget_ua) {
+        return brightness;
+    }
+    power->limited_frames++;
+    if (budget_ua <= idle_ua) {
+        // can't even afford the strip idling, everything off is the best there is
+        power->scale = 0;
+        return 0;
+    }
+    float factor = powf((budget_ua - idle_ua) / lit_ua, 1.0f / config->gamma);
+    // rounding down keeps the result inside the budget
+    int scale = (int)(factor * 256.0f) - 1;
+    power->scale = scale < 0 ? 0 : scale > brightness ? brightness : (uint8_t)scale;
+    return power->scale;
+}
@@ -0,0 +1,73 @@
+/**
+ * @file led_power.h
+ * @brief Current budget for the strip
+ *
+ * Estimates what a frame draws from the duty sum the effect kernels
+ * return (see led_effect_engine_render()) and, when that is more than
+ * the supply can give, picks a lower brightness for the frame that fits.
+ * A WS2812-style LED draws close to a fixed current per channel while
+ * that channel's PWM is on plus a small idle current, so the draw is
+ * simply linear in the duty sum.
+ *
+ * The scale comes out per frame with nothing to settle, a frame that
+ * would pull too much never goes out at full brightness.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Supply and LED figures
+ */
+typedef struct {
+    uint32_t budget_ma;         /*!< Current the supply can spare for the strip, 0 turns the limiter off */
+    uint32_t channel_ua;        /*!< Draw of one channel fully on */
+    uint32_t idle_ua;           /*!< Draw of one pixel with everything off */
+    float gamma;                /*!< Output gamma, same as led_controller_set_correction(), to undo the scaling through */
+} led_power_config_t;
+
+/**
+ * @brief Numbers for a WS2812B, 5V
+ */
+#define LED_POWER_DEFAULT_CONFIG(budget) \
+{                                        \
+    .budget_ma = (budget),               \
+    .channel_ua = 12000,                 \
+    .idle_ua = 1000,                     \
+    .gamma = 1.0f,                       \
+}
+
+/**
+ * @brief Limiter state
+ */
+typedef struct {
+    led_power_config_t config;  /*!< Copy of the config */
+    uint32_t estimate_ma;       /*!< Last frame's draw as asked for, before limiting */
+    uint8_t scale;              /*!< Last frame's scale as returned by led_power_limit() */
+    uint32_t limited_frames;    /*!< Frames dimmed to stay in the budget */
+} led_power_t;
+
+/**
+ * @brief Set up the limiter, see led_power_config_t
+ */
+void led_power_init(led_power_t *power, const led_power_config_t *config);
+
+/**
+ * @brief Brightness for a frame that stays within the budget
+ *
+ * @param[in] power Limiter
+ * @param[in] duty_sum The frame's duty sum through the output curve, see led_effect_kernel_t
+ * @param[in] pixel_count Strip length, for the idle draw
+ * @param[in] brightness Scale the frame would get anyway (led_pixel_scale() semantics), 255 = full
+ * @return brightness if the frame fits, otherwise the highest scale below it that does
+ */
+uint8_t led_power_limit(led_power_t *power, uint32_t duty_sum, size_t pixel_count, uint8_t brightness);
+
+#ifdef __cplusplus
+}
+#endif
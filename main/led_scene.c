@@ -0,0 +1,229 @@
+/**
+ * @file led_scene.c
+ * @brief Scene partition mapping, validation and frame decoding
+ */
+
+#include <string.h>
+#include "esp_check.h"
+#include "esp_rom_crc.h"
+#include "led_scene.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "led_scene";
+
+#define LED_SCENE_RLE_RUN_LEN     4 // count, G, R, B
+#define LED_SCENE_DELTA_PATCH_LEN 4 // u16 skip, u16 count, then the pixels
+
+// with an IRAM-safe ISR the encoder can't read flash, every frame needs a RAM copy
+#if CONFIG_LED_IRAM_SAFE
+#define LED_SCENE_COPY_RAW true
+#else
+#define LED_SCENE_COPY_RAW false
+#endif
+
+static inline uint16_t led_scene_le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+/**
+ * @brief Check one directory entry and its frame table against the partition
+ */
+static esp_err_t led_scene_check_entry(const led_scene_library_t *library, const led_scene_entry_t *entry)
+{
+    uint32_t size = library->header->size;
+    ESP_RETURN_ON_FALSE(entry->pixel_count && entry->frame_count && entry->fps && entry->fps <= 1000,
+                        ESP_ERR_INVALID_SIZE, TAG, "scene %.16s is empty", entry->name);
+    ESP_RETURN_ON_FALSE(!(entry->frames_offset & 3) && entry->frames_offset <= size &&
+                        entry->frame_count <= (size - entry->frames_offset) / sizeof(led_scene_frame_t),
+                        ESP_ERR_INVALID_SIZE, TAG, "scene %.16s: frame table out of range", entry->name);
+    const led_scene_frame_t *frames = (const led_scene_frame_t *)(library->base + entry->frames_offset);
+    uint32_t raw_size = entry->pixel_count * LED_FRAMEBUFFER_BYTES_PER_PIXEL;
+    for (uint32_t i = 0; i < entry->frame_count; i++) {
+        const led_scene_frame_t *frame = &frames[i];
+        ESP_RETURN_ON_FALSE(frame->offset <= size && frame->size <= size - frame->offset, ESP_ERR_INVALID_SIZE, TAG,
+                            "scene %.16s: frame %lu out of range", entry->name, (unsigned long)i);
+        ESP_RETURN_ON_FALSE(frame->encoding <= LED_SCENE_FRAME_DELTA && (i || frame->encoding != LED_SCENE_FRAME_DELTA),
+                            ESP_ERR_INVALID_SIZE, TAG, "scene %.16s: frame %lu has a bad encoding", entry->name,
+                            (unsigned long)i);
+        ESP_RETURN_ON_FALSE(frame->encoding != LED_SCENE_FRAME_RAW || frame->size == raw_size, ESP_ERR_INVALID_SIZE,
+                            TAG, "scene %.16s: frame %lu is %lu bytes, expected %lu", entry->name, (unsigned long)i,
+                            (unsigned long)frame->size, (unsigned long)raw_size);
+    }
+    return ESP_OK;
+}
+
+esp_err_t led_scene_library_open(const char *label, led_scene_library_t *library)
+{
+    esp_err_t ret = ESP_OK;
+    ESP_RETURN_ON_FALSE(library, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    memset(library, 0, sizeof(*library));
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, LED_SCENE_PARTITION_SUBTYPE, label);
+    ESP_RETURN_ON_FALSE(partition, ESP_ERR_NOT_FOUND, TAG, "no scene partition%s%s", label ? " " : "", label ? label : "");
+    ESP_RETURN_ON_FALSE(partition->size >= sizeof(led_scene_partition_header_t), ESP_ERR_INVALID_SIZE, TAG,
+                        "partition too small");
+    const void *base;
+    ESP_RETURN_ON_ERROR(esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &base, &library->mmap),
+                        TAG, "map scene partition failed");
+    library->partition = partition;
+    library->base = base;
+    library->header = (const led_scene_partition_header_t *)base;
+    library->entries = (const led_scene_entry_t *)(library->header + 1);
+
+    const led_scene_partition_header_t *header = library->header;
+    ESP_GOTO_ON_FALSE(header->magic == LED_SCENE_MAGIC && header->version == LED_SCENE_VERSION, ESP_ERR_INVALID_VERSION,
+                      err, TAG, "no scenes in partition %s (or format %u)", partition->label, header->version);
+    ESP_GOTO_ON_FALSE(header->size >= sizeof(*header) && header->size <= partition->size &&
+                      header->scene_count <= (header->size - sizeof(*header)) / sizeof(led_scene_entry_t),
+                      ESP_ERR_INVALID_SIZE, err, TAG, "scene directory out of range");
+    // one read through everything, while nothing else is going on yet
+    uint32_t crc = esp_rom_crc32_le(0, library->base + sizeof(*header), header->size - sizeof(*header));
+    ESP_GOTO_ON_FALSE(crc == header->crc32, ESP_ERR_INVALID_CRC, err, TAG, "scene partition damaged");
+    for (size_t i = 0; i < header->scene_count; i++) {
+        ESP_GOTO_ON_ERROR(led_scene_check_entry(library, &library->entries[i]), err, TAG, "invalid scene %u", (unsigned)i);
+    }
+    ESP_LOGI(TAG, "%u scenes, %lu KB in partition %s", header->scene_count, (unsigned long)(header->size / 1024),
+             partition->label);
+    return ESP_OK;
+err:
+    led_scene_library_close(library);
+    return ret;
+}
+
+void led_scene_library_close(led_scene_library_t *library)
+{
+    if (!library || !library->base) {
+        return;
+    }
+    esp_partition_munmap(library->mmap);
+    memset(library, 0, sizeof(*library));
+}
+
+int led_scene_find(const led_scene_library_t *library, const char *name)
+{
+    for (size_t i = 0; name && i < library->header->scene_count; i++) {
+        if (strlen(name) <= LED_SCENE_NAME_LEN && strncmp(library->entries[i].name, name, LED_SCENE_NAME_LEN) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+esp_err_t led_scene_player_init(led_scene_player_t *player, const led_scene_library_t *library, size_t index,
+                                size_t pixel_count)
+{
+    ESP_RETURN_ON_FALSE(player && library && library->base, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(index < library->header->scene_count, ESP_ERR_NOT_FOUND, TAG, "no scene %u", (unsigned)index);
+    const led_scene_entry_t *entry = &library->entries[index];
+    ESP_RETURN_ON_FALSE(entry->pixel_count == pixel_count, ESP_ERR_INVALID_SIZE, TAG,
+                        "scene %.16s is for %lu pixels, strip has %u", entry->name, (unsigned long)entry->pixel_count,
+                        (unsigned)pixel_count);
+    memset(player, 0, sizeof(*player));
+    player->library = library;
+    player->entry = entry;
+    player->frames = (const led_scene_frame_t *)(library->base + entry->frames_offset);
+
+    bool decode = LED_SCENE_COPY_RAW;
+    for (uint32_t i = 0; !decode && i < entry->frame_count; i++) {
+        decode = player->frames[i].encoding != LED_SCENE_FRAME_RAW;
+    }
+    for (int i = 0; i < 2; i++) {
+        player->views[i].pixel_count = pixel_count;
+        if (decode) {
+            esp_err_t ret = led_framebuffer_init(&player->decoded[i], pixel_count);
+            if (ret != ESP_OK) {
+                led_scene_player_deinit(player);
+                return ret;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+void led_scene_player_deinit(led_scene_player_t *player)
+{
+    if (!player) {
+        return;
+    }
+    for (int i = 0; i < 2; i++) {
+        if (player->decoded[i].pixels) {
+            led_framebuffer_deinit(&player->decoded[i]);
+        }
+    }
+    memset(player, 0, sizeof(*player));
+}
+
+/**
+ * @brief Expand one stored frame into out, pixel_count pixels
+ */
+static esp_err_t led_scene_decode(const led_scene_frame_t *frame, const uint8_t *data, const uint8_t *previous,
+                                  uint8_t *out, size_t pixel_count)
+{
+    size_t size = frame->size;
+    size_t pos = 0;
+    size_t i = 0;
+    switch (frame->encoding) {
+    case LED_SCENE_FRAME_RAW:
+        memcpy(out, data, size);
+        return ESP_OK;
+    case LED_SCENE_FRAME_RLE:
+        for (; i + LED_SCENE_RLE_RUN_LEN <= size; i += LED_SCENE_RLE_RUN_LEN) {
+            size_t count = data[i];
+            if (!count || count > pixel_count - pos) {
+                break;
+            }
+            for (uint8_t *p = &out[pos * LED_FRAMEBUFFER_BYTES_PER_PIXEL]; count--; p += LED_FRAMEBUFFER_BYTES_PER_PIXEL) {
+                p[0] = data[i + 1];
+                p[1] = data[i + 2];
+                p[2] = data[i + 3];
+                pos++;
+            }
+        }
+        return i == size && pos == pixel_count ? ESP_OK : ESP_ERR_INVALID_SIZE;
+    default:
+        // the frame table check keeps deltas off frame 0, so there always is a previous frame
+        memcpy(out, previous, pixel_count * LED_FRAMEBUFFER_BYTES_PER_PIXEL);
+        while (i + LED_SCENE_DELTA_PATCH_LEN <= size) {
+            size_t skip = led_scene_le16(&data[i]);
+            size_t count = led_scene_le16(&data[i + 2]);
+            size_t bytes = count * LED_FRAMEBUFFER_BYTES_PER_PIXEL;
+            i += LED_SCENE_DELTA_PATCH_LEN;
+            if (skip > pixel_count - pos || count > pixel_count - pos - skip || bytes > size - i) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            pos += skip;
+            memcpy(&out[pos * LED_FRAMEBUFFER_BYTES_PER_PIXEL], &data[i], bytes);
+            pos += count;
+            i += bytes;
+        }
+        return i == size ? ESP_OK : ESP_ERR_INVALID_SIZE;
+    }
+}
+
+esp_err_t led_scene_player_next(led_scene_player_t *player, led_framebuffer_t **ret_frame)
+{
+    const led_scene_frame_t *frame = &player->frames[player->next];
+    const uint8_t *data = player->library->base + frame->offset;
+    led_framebuffer_t *out;
+    if (!player->decoded[0].pixels) {
+        // every frame is raw, send it from where it is
+        out = &player->views[player->slot];
+        out->pixels = (uint8_t *)data;
+    } else {
+        out = &player->decoded[player->slot];
+        esp_err_t ret = led_scene_decode(frame, data, player->previous, out->pixels, out->pixel_count);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "scene %.16s: frame %lu damaged", player->entry->name, (unsigned long)player->next);
+            player->next = 0;
+            player->previous = NULL;
+            return ret;
+        }
+    }
+    // a different frame every time as far as the controller is concerned
+    led_framebuffer_mark_dirty(out, 0, out->pixel_count);
+    player->slot ^= 1;
+    player->previous = out->pixels;
+    player->next = (player->next + 1) % player->entry->frame_count;
+    *ret_frame = out;
+    return ESP_OK;
+}
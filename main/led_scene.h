@@ -0,0 +1,186 @@
+/**
+ * @file led_scene.h
+ * @brief Precomputed animations played straight out of a flash partition
+ *
+ * A scene partition (tools/led_scene_pack.py builds one) holds any number
+ * of named scenes, each a sequence of frames already in GRB wire order.
+ * The partition is memory-mapped once, nothing is copied into RAM:
+ * uncompressed frames are handed to the controller as framebuffers whose
+ * pixels point into the mapping, so the encoder reads them right out of
+ * flash (through the cache) while they go out. Playing an animation then
+ * costs no rendering and no RAM however long it is.
+ *
+ * Frames that repeat a color or change little can be stored RLE or as a
+ * delta to the previous frame. Those are decoded into one of two small
+ * RAM frames, the cost is the copy plus whatever changed.
+ *
+ * Layout, all little-endian and every structure 4-byte aligned:
+ *
+ *     led_scene_partition_header_t
+ *     led_scene_entry_t[scene_count]
+ *     per scene: led_scene_frame_t[frame_count], then its frame data
+ *
+ * Offsets are from the start of the partition. The first frame of a
+ * scene can't be a delta, playback loops back to it.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "led_framebuffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LED_SCENE_PARTITION_SUBTYPE 0x40        /*!< Data partition subtype, see partitions.csv */
+#define LED_SCENE_MAGIC             0x4E43534C  /*!< "LSCN" */
+#define LED_SCENE_VERSION           1
+#define LED_SCENE_NAME_LEN          16
+
+/**
+ * @brief How one frame is stored
+ */
+typedef enum {
+    LED_SCENE_FRAME_RAW = 0,    /*!< pixel_count * 3 bytes GRB, played from flash without a copy */
+    LED_SCENE_FRAME_RLE = 1,    /*!< Runs of (count 1-255, G, R, B) covering every pixel */
+    LED_SCENE_FRAME_DELTA = 2,  /*!< Patches on the previous frame: (u16 skip, u16 count, count * 3 bytes GRB)... */
+} led_scene_frame_encoding_t;
+
+/**
+ * @brief Start of the partition
+ */
+typedef struct {
+    uint32_t magic;             /*!< LED_SCENE_MAGIC */
+    uint16_t version;           /*!< LED_SCENE_VERSION */
+    uint16_t scene_count;       /*!< Entries following the header */
+    uint32_t size;              /*!< Bytes used from the start of the partition */
+    uint32_t crc32;             /*!< esp_rom_crc32_le(0, ...) over the bytes after this header, up to size */
+} led_scene_partition_header_t;
+
+/**
+ * @brief Directory entry of one scene
+ */
+typedef struct {
+    char name[LED_SCENE_NAME_LEN]; /*!< NUL padded, not terminated at full length */
+    uint32_t frames_offset;     /*!< Where its led_scene_frame_t table starts */
+    uint32_t pixel_count;       /*!< Strip length it was made for */
+    uint32_t frame_count;       /*!< Frames in the table */
+    uint16_t fps;               /*!< Playback rate */
+    uint16_t reserved;          /*!< 0 */
+} led_scene_entry_t;
+
+/**
+ * @brief Frame table entry
+ */
+typedef struct {
+    uint32_t offset;            /*!< Where the frame data starts */
+    uint32_t size;              /*!< Bytes of frame data */
+    uint8_t encoding;           /*!< led_scene_frame_encoding_t */
+    uint8_t reserved[3];        /*!< 0 */
+} led_scene_frame_t;
+
+/**
+ * @brief A mapped scene partition
+ */
+typedef struct {
+    const esp_partition_t *partition; /*!< Partition found by led_scene_library_open() */
+    esp_partition_mmap_handle_t mmap; /*!< Mapping handle */
+    const uint8_t *base;        /*!< Start of the mapping */
+    const led_scene_partition_header_t *header; /*!< Validated header, at base */
+    const led_scene_entry_t *entries; /*!< header->scene_count directory entries */
+} led_scene_library_t;
+
+/**
+ * @brief Plays one scene frame by frame
+ */
+typedef struct {
+    const led_scene_library_t *library; /*!< Where the frames are */
+    const led_scene_entry_t *entry; /*!< Scene being played */
+    const led_scene_frame_t *frames; /*!< Its frame table */
+    uint32_t next;              /*!< Frame led_scene_player_next() returns next */
+    led_framebuffer_t views[2]; /*!< Point into flash, used when every frame is raw */
+    led_framebuffer_t decoded[2]; /*!< Used otherwise (and with CONFIG_LED_IRAM_SAFE), NULL pixels if unused */
+    uint8_t slot;               /*!< Entry of views or decoded the next frame goes into, alternates */
+    const uint8_t *previous;    /*!< Pixels of the frame returned last, base for a delta */
+} led_scene_player_t;
+
+/**
+ * @brief Map the scene partition and check it
+ *
+ * @param[in] label Partition label, NULL for the first one with LED_SCENE_PARTITION_SUBTYPE
+ * @param[out] library Library to initialize
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NOT_FOUND no such partition
+ *      - ESP_ERR_INVALID_VERSION not a scene partition or a newer format
+ *      - ESP_ERR_INVALID_SIZE the directory or a frame table points outside the partition
+ *      - ESP_ERR_INVALID_CRC the contents are damaged
+ *      - ESP_OK if the library is mapped
+ */
+esp_err_t led_scene_library_open(const char *label, led_scene_library_t *library);
+
+/**
+ * @brief Unmap the partition, no player may use it anymore
+ */
+void led_scene_library_close(led_scene_library_t *library);
+
+/**
+ * @brief Index of the scene with this name, -1 if there is none
+ */
+int led_scene_find(const led_scene_library_t *library, const char *name);
+
+/**
+ * @brief Get ready to play a scene from its first frame
+ *
+ * Decode frames are only allocated if the scene has compressed frames
+ * (or always with CONFIG_LED_IRAM_SAFE, where the TX ISR can't read flash).
+ *
+ * @param[out] player Player to initialize
+ * @param[in] library Open library, must outlive the player
+ * @param[in] index Scene index
+ * @param[in] pixel_count Strip length, the scene has to match it
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NOT_FOUND no scene with that index
+ *      - ESP_ERR_INVALID_SIZE the scene was made for another strip length
+ *      - ESP_ERR_NO_MEM out of memory for the decode frames
+ *      - ESP_OK if the player is ready
+ */
+esp_err_t led_scene_player_init(led_scene_player_t *player, const led_scene_library_t *library, size_t index,
+                                size_t pixel_count);
+
+/**
+ * @brief Free the decode frames
+ */
+void led_scene_player_deinit(led_scene_player_t *player);
+
+/**
+ * @brief Frame rate the scene was made for
+ */
+static inline uint32_t led_scene_player_fps(const led_scene_player_t *player)
+{
+    return player->entry->fps;
+}
+
+/**
+ * @brief The next frame, looping at the end of the scene
+ *
+ * The frame stays valid until the call after next, so it can be on the
+ * wire through led_controller_transmit_buffer() while this decodes the
+ * following one. Don't write to it, raw frames are in flash.
+ *
+ * @param[in] player Player
+ * @param[out] ret_frame Frame to send
+ * @return
+ *      - ESP_ERR_INVALID_SIZE the frame data is damaged, playback restarts from the first frame
+ *      - ESP_OK if ret_frame is ready
+ */
+esp_err_t led_scene_player_next(led_scene_player_t *player, led_framebuffer_t **ret_frame);
+
+#ifdef __cplusplus
+}
+#endif
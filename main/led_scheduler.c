@@ -0,0 +1,115 @@
+/**
+ * @file led_scheduler.c
+ * @brief esp_timer driven frame deadlines
+ */
+
+#include <string.h>
+#include "esp_check.h"
+#include "led_scheduler.h"
+
+static const char *TAG = "led_sched";
+
+#define LED_SCHEDULER_MAX_FPS 1000
+
+static void led_scheduler_timer_cb(void *arg)
+{
+    led_scheduler_t *scheduler = (led_scheduler_t *)arg;
+    xTaskNotifyGive(scheduler->task);
+}
+
+static esp_err_t led_scheduler_start(led_scheduler_t *scheduler, uint32_t target_fps)
+{
+    ESP_RETURN_ON_FALSE(target_fps && target_fps <= LED_SCHEDULER_MAX_FPS, ESP_ERR_INVALID_ARG, TAG,
+                        "invalid target fps %lu", (unsigned long)target_fps);
+    scheduler->period_us = 1000000 / target_fps;
+    scheduler->start_us = esp_timer_get_time();
+    scheduler->frame = UINT32_MAX; // next frame handed out is 0
+    ESP_RETURN_ON_ERROR(esp_timer_start_periodic(scheduler->timer, scheduler->period_us), TAG, "start frame timer failed");
+    // frame 0 is due now, the first timer tick is frame 1
+    xTaskNotifyGive(scheduler->task);
+    return ESP_OK;
+}
+
+esp_err_t led_scheduler_init(const led_scheduler_config_t *config, led_scheduler_t *scheduler)
+{
+    ESP_RETURN_ON_FALSE(config && scheduler, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    memset(scheduler, 0, sizeof(*scheduler));
+    scheduler->task = xTaskGetCurrentTaskHandle();
+    esp_timer_create_args_t timer_args = {
+        .callback = led_scheduler_timer_cb,
+        .arg = scheduler,
+        .name = "led_frame",
+        .skip_unhandled_events = true, // a late task skips frames anyway, no point in catching up on ticks
+    };
+    ESP_RETURN_ON_ERROR(esp_timer_create(&timer_args, &scheduler->timer), TAG, "create frame timer failed");
+    if (config->power_save) {
+        // without CONFIG_PM_ENABLE there is nothing to hold, the scheduler just runs without a lock
+        esp_err_t pm_ret = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "led_frame", &scheduler->pm_lock);
+        if (pm_ret != ESP_OK && pm_ret != ESP_ERR_NOT_SUPPORTED) {
+            esp_timer_delete(scheduler->timer);
+            scheduler->timer = NULL;
+            ESP_LOGE(TAG, "create pm lock failed");
+            return pm_ret;
+        }
+        if (scheduler->pm_lock) {
+            // the task is running already, the lock describes it until its first wait
+            esp_pm_lock_acquire(scheduler->pm_lock);
+        }
+    }
+    esp_err_t ret = led_scheduler_start(scheduler, config->target_fps);
+    if (ret != ESP_OK) {
+        if (scheduler->pm_lock) {
+            esp_pm_lock_release(scheduler->pm_lock);
+            esp_pm_lock_delete(scheduler->pm_lock);
+        }
+        esp_timer_delete(scheduler->timer);
+        scheduler->timer = NULL;
+    }
+    return ret;
+}
+
+esp_err_t led_scheduler_deinit(led_scheduler_t *scheduler)
+{
+    ESP_RETURN_ON_FALSE(scheduler && scheduler->timer, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    esp_timer_stop(scheduler->timer);
+    esp_timer_delete(scheduler->timer);
+    if (scheduler->pm_lock) {
+        esp_pm_lock_release(scheduler->pm_lock);
+        esp_pm_lock_delete(scheduler->pm_lock);
+    }
+    memset(scheduler, 0, sizeof(*scheduler));
+    return ESP_OK;
+}
+
+esp_err_t led_scheduler_wait_frame(led_scheduler_t *scheduler, led_scheduler_frame_t *ret_frame)
+{
+    ESP_RETURN_ON_FALSE(scheduler && scheduler->timer && ret_frame, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    uint32_t next = scheduler->frame + 1;
+    uint32_t frame;
+    if (scheduler->pm_lock) {
+        // done with the last frame, the chip may slow down or sleep until the timer fires
+        esp_pm_lock_release(scheduler->pm_lock);
+    }
+    do {
+        // a wakeup can belong to a frame that was already handed out, then wait for the next one
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        frame = (uint32_t)((esp_timer_get_time() - scheduler->start_us) / scheduler->period_us);
+    } while ((int32_t)(frame - next) < 0);
+    if (scheduler->pm_lock) {
+        esp_pm_lock_acquire(scheduler->pm_lock);
+    }
+
+    ret_frame->frame = frame;
+    ret_frame->time_us = (int64_t)frame * scheduler->period_us;
+    ret_frame->skipped = frame - next;
+    scheduler->skipped += ret_frame->skipped;
+    scheduler->frame = frame;
+    return ESP_OK;
+}
+
+esp_err_t led_scheduler_set_fps(led_scheduler_t *scheduler, uint32_t target_fps)
+{
+    ESP_RETURN_ON_FALSE(scheduler && scheduler->timer, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    esp_timer_stop(scheduler->timer);
+    return led_scheduler_start(scheduler, target_fps);
+}
@@ -0,0 +1,100 @@
+/**
+ * @file led_scheduler.h
+ * @brief Fixed-rate frame pacing on absolute deadlines
+ *
+ * A periodic esp_timer wakes the render task once per frame period. The
+ * deadlines are absolute (frame n is due at start + n * period), so
+ * render and transmit time never make the animation drift, and a task
+ * that falls behind skips straight to the current frame instead of
+ * working through a backlog. Unlike vTaskDelay() the period isn't rounded
+ * to RTOS ticks, so 60 or 120 fps work with CONFIG_FREERTOS_HZ=100.
+ *
+ * With power_save the scheduler holds a CPU_FREQ_MAX power management
+ * lock only while the task works on a frame, from the wakeup to the next
+ * led_scheduler_wait_frame(). In between, DFS and automatic light sleep
+ * (CONFIG_PM_ENABLE, tickless idle) are free to kick in, and the frame
+ * timer wakes the chip up in time for the next deadline.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Scheduler configuration
+ */
+typedef struct {
+    uint32_t target_fps;        /*!< Frames per second, 1-1000 */
+    bool power_save;            /*!< Run at full speed only between a wakeup and the next wait, see above */
+} led_scheduler_config_t;
+
+/**
+ * @brief What the render task should draw
+ */
+typedef struct {
+    uint32_t frame;             /*!< Index of the frame to render, counted from the start */
+    int64_t time_us;            /*!< Deadline of that frame relative to the start, drive animations from this */
+    uint32_t skipped;           /*!< Frames skipped since the previous call because the task was late */
+} led_scheduler_frame_t;
+
+/**
+ * @brief Scheduler state
+ */
+typedef struct {
+    esp_timer_handle_t timer;   /*!< Periodic frame timer */
+    TaskHandle_t task;          /*!< Task woken every period */
+    int64_t period_us;          /*!< Frame period */
+    int64_t start_us;           /*!< Deadline of frame 0 */
+    uint32_t frame;             /*!< Last frame handed out */
+    uint32_t skipped;           /*!< Frames skipped in total */
+    esp_pm_lock_handle_t pm_lock; /*!< Held while a frame is being worked on, NULL without power_save or CONFIG_PM_ENABLE */
+} led_scheduler_t;
+
+/**
+ * @brief Start the frame timer, frame 0 is due right away
+ *
+ * The calling task is the one that gets woken; the scheduler uses its
+ * task notification, so that task must not use notifications otherwise.
+ *
+ * @param[in] config Scheduler configuration
+ * @param[out] scheduler Scheduler to initialize, must stay at the same address while running
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_OK if the timer is running
+ */
+esp_err_t led_scheduler_init(const led_scheduler_config_t *config, led_scheduler_t *scheduler);
+
+/**
+ * @brief Stop the timer and release it
+ */
+esp_err_t led_scheduler_deinit(led_scheduler_t *scheduler);
+
+/**
+ * @brief Block until the next frame deadline
+ *
+ * If one or more deadlines already passed, returns immediately with the
+ * most recent one and reports the others as skipped. With power_save the
+ * PM lock is dropped while waiting and taken again before this returns.
+ *
+ * @param[in] scheduler Scheduler
+ * @param[out] ret_frame Frame to render
+ */
+esp_err_t led_scheduler_wait_frame(led_scheduler_t *scheduler, led_scheduler_frame_t *ret_frame);
+
+/**
+ * @brief Change the frame rate, the frame count restarts at 0 with a new time base
+ */
+esp_err_t led_scheduler_set_fps(led_scheduler_t *scheduler, uint32_t target_fps);
+
+#ifdef __cplusplus
+}
+#endif
@@ -4,8 +4,12 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include "esp_attr.h"
 #include "esp_check.h"
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
 #include "led_strip_encoder.h"
+#include "led_mem.h"
 #include "sdkconfig.h"
 #ifndef CONFIG_LOG_MAXIMUM_LEVEL
 #define CONFIG_LOG_MAXIMUM_LEVEL ESP_LOG_VERBOSE
@@ -14,65 +18,199 @@
 
 static const char *TAG = "led_encoder";
 
+#define LED_STRIP_SYMBOLS_PER_BYTE 8
+#define LED_STRIP_MAX_TICKS        0x7FFF // rmt_symbol_word_t durations are 15 bits
+
+// With an IRAM-safe RMT ISR the refill path must not touch flash either
+#if CONFIG_RMT_ISR_IRAM_SAFE
+#define LED_STRIP_ENCODER_FUNC_ATTR IRAM_ATTR
+#else
+#define LED_STRIP_ENCODER_FUNC_ATTR
+#endif
+
+/**
+ * @brief RMT symbols for one byte, MSB first
+ *
+ * Wrapped in a struct so expanding a byte is a single 32-byte copy.
+ */
+typedef struct {
+    rmt_symbol_word_t symbols[LED_STRIP_SYMBOLS_PER_BYTE];
+} rmt_led_strip_byte_symbols_t;
+
 typedef struct {
     rmt_encoder_t base;
-    rmt_encoder_t *bytes_encoder;
-    rmt_encoder_t *copy_encoder;
-    int state;
+    rmt_encoder_t *simple_encoder;
+    rmt_symbol_word_t bit0;
+    rmt_symbol_word_t bit1;
     rmt_symbol_word_t reset_code;
+    bool rgbw;          // extract a white byte, 4 bytes out for every 3 in
+    rmt_led_strip_byte_symbols_t byte_symbols[256]; // symbols sent for every input byte value, LUT already applied
+    uint32_t cycles;    // CPU cycles spent in the callback, running total
+    uint32_t calls;     // callback invocations, running total
 } rmt_led_strip_encoder_t;
 
-static size_t rmt_encode_led_strip(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
+static const led_strip_timing_t s_led_strip_timings[LED_STRIP_CHIP_MAX] = {
+    // T0H and T1H are what the chip samples, the low times just have to stay clear of the reset
+    [LED_STRIP_CHIP_WS2812] = { .t0h_ns = 300, .t0l_ns = 900, .t1h_ns = 900, .t1l_ns = 300, .reset_us = 50, .bytes_per_pixel = 3 },
+    [LED_STRIP_CHIP_WS2812B] = { .t0h_ns = 300, .t0l_ns = 600, .t1h_ns = 600, .t1l_ns = 600, .reset_us = 280, .bytes_per_pixel = 3 },
+    [LED_STRIP_CHIP_WS2811] = { .t0h_ns = 250, .t0l_ns = 1000, .t1h_ns = 600, .t1l_ns = 650, .reset_us = 280, .bytes_per_pixel = 3 },
+    [LED_STRIP_CHIP_SK6812] = { .t0h_ns = 300, .t0l_ns = 800, .t1h_ns = 600, .t1l_ns = 500, .reset_us = 80, .bytes_per_pixel = 3 },
+    [LED_STRIP_CHIP_SK6812_RGBW] = { .t0h_ns = 300, .t0l_ns = 800, .t1h_ns = 600, .t1l_ns = 500, .reset_us = 80, .bytes_per_pixel = 4 },
+};
+
+const led_strip_timing_t *led_strip_get_timing(led_strip_chip_t chip)
 {
-    rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
-    rmt_encoder_handle_t bytes_encoder = led_encoder->bytes_encoder;
-    rmt_encoder_handle_t copy_encoder = led_encoder->copy_encoder;
-    rmt_encode_state_t session_state = RMT_ENCODING_RESET;
-    rmt_encode_state_t state = RMT_ENCODING_RESET;
-    size_t encoded_symbols = 0;
-    switch (led_encoder->state) {
-    case 0: // send RGB data
-        encoded_symbols += bytes_encoder->encode(bytes_encoder, channel, primary_data, data_size, &session_state);
-        if (session_state & RMT_ENCODING_COMPLETE) {
-            led_encoder->state = 1; // switch to next state when current encoding session finished
+    return (unsigned)chip < LED_STRIP_CHIP_MAX ? &s_led_strip_timings[chip] : NULL;
+}
+
+/**
+ * @brief Duration in RMT ticks, rounded to nearest
+ */
+static uint32_t rmt_led_strip_ticks(uint32_t resolution, uint32_t ns)
+{
+    return ((uint64_t)resolution * ns + 500000000) / 1000000000;
+}
+
+/**
+ * @brief Rebuild the symbol table so input byte v is sent as lut[v]
+ *
+ * Folding the LUT into the table means correction costs nothing per byte,
+ * the ISR copy is the same whichever curve is loaded.
+ */
+static void rmt_led_strip_build_symbols(rmt_led_strip_encoder_t *led_encoder, const uint8_t *lut)
+{
+    // WS2812 transfer bit order: G7...G0R7...R0B7...B0, so MSB first
+    for (int value = 0; value < 256; value++) {
+        uint8_t out = lut ? lut[value] : value;
+        for (int bit = 0; bit < LED_STRIP_SYMBOLS_PER_BYTE; bit++) {
+            led_encoder->byte_symbols[value].symbols[bit] = (out & (0x80 >> bit)) ? led_encoder->bit1 : led_encoder->bit0;
         }
-        if (session_state & RMT_ENCODING_MEM_FULL) {
-            state |= RMT_ENCODING_MEM_FULL;
-            goto out; // yield if there's no free space for encoding artifacts
+    }
+}
+
+/**
+ * @brief Simple encoder callback, runs from the RMT ISR on every refill
+ *
+ * Emits as many whole bytes as fit into the free space by copying them
+ * out of the lookup table, then the reset code once all bytes are out.
+ */
+static size_t LED_STRIP_ENCODER_FUNC_ATTR rmt_encode_led_strip_cb(const void *data, size_t data_size, size_t symbols_written,
+                                                                  size_t symbols_free, rmt_symbol_word_t *symbols, bool *done, void *arg)
+{
+    rmt_led_strip_encoder_t *led_encoder = (rmt_led_strip_encoder_t *)arg;
+    const uint8_t *bytes = (const uint8_t *)data;
+    size_t byte_index = symbols_written / LED_STRIP_SYMBOLS_PER_BYTE;
+
+    if (led_encoder->rgbw) {
+        // whole pixels only, min_chunk_size guarantees room for one
+        size_t pixel_index = byte_index / 4;
+        size_t pixel_total = data_size / 3;
+        if (pixel_index < pixel_total) {
+            esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+            size_t pixel_count = symbols_free / (4 * LED_STRIP_SYMBOLS_PER_BYTE);
+            if (pixel_count > pixel_total - pixel_index) {
+                pixel_count = pixel_total - pixel_index;
+            }
+            const uint8_t *in = bytes + pixel_index * 3;
+            rmt_led_strip_byte_symbols_t *out = (rmt_led_strip_byte_symbols_t *)symbols;
+            for (size_t i = 0; i < pixel_count; i++, in += 3, out += 4) {
+                uint8_t w = in[0] < in[1] ? in[0] : in[1];
+                w = w < in[2] ? w : in[2];
+                out[0] = led_encoder->byte_symbols[in[0] - w];
+                out[1] = led_encoder->byte_symbols[in[1] - w];
+                out[2] = led_encoder->byte_symbols[in[2] - w];
+                out[3] = led_encoder->byte_symbols[w];
+            }
+            led_encoder->cycles += esp_cpu_get_cycle_count() - start;
+            led_encoder->calls++;
+            return pixel_count * 4 * LED_STRIP_SYMBOLS_PER_BYTE;
         }
-    // fall-through
-    case 1: // send reset code
-        encoded_symbols += copy_encoder->encode(copy_encoder, channel, &led_encoder->reset_code,
-                                                sizeof(led_encoder->reset_code), &session_state);
-        if (session_state & RMT_ENCODING_COMPLETE) {
-            led_encoder->state = RMT_ENCODING_RESET; // back to the initial encoding session
-            state |= RMT_ENCODING_COMPLETE;
+    } else if (byte_index < data_size) {
+        esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+        size_t byte_count = symbols_free / LED_STRIP_SYMBOLS_PER_BYTE;
+        if (byte_count > data_size - byte_index) {
+            byte_count = data_size - byte_index;
         }
-        if (session_state & RMT_ENCODING_MEM_FULL) {
-            state |= RMT_ENCODING_MEM_FULL;
-            goto out; // yield if there's no free space for encoding artifacts
+        rmt_led_strip_byte_symbols_t *out = (rmt_led_strip_byte_symbols_t *)symbols;
+        for (size_t i = 0; i < byte_count; i++) {
+            out[i] = led_encoder->byte_symbols[bytes[byte_index + i]];
         }
+        led_encoder->cycles += esp_cpu_get_cycle_count() - start;
+        led_encoder->calls++;
+        return byte_count * LED_STRIP_SYMBOLS_PER_BYTE;
+    }
+
+    // all pixel data is out, latch it with the reset code
+    if (symbols_free < 1) {
+        return 0;
     }
-out:
-    *ret_state = state;
-    return encoded_symbols;
+    symbols[0] = led_encoder->reset_code;
+    *done = true;
+    return 1;
+}
+
+static size_t LED_STRIP_ENCODER_FUNC_ATTR rmt_encode_led_strip(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
+{
+    rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
+    rmt_encoder_handle_t simple_encoder = led_encoder->simple_encoder;
+    return simple_encoder->encode(simple_encoder, channel, primary_data, data_size, ret_state);
 }
 
 static esp_err_t rmt_del_led_strip_encoder(rmt_encoder_t *encoder)
 {
     rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
-    rmt_del_encoder(led_encoder->bytes_encoder);
-    rmt_del_encoder(led_encoder->copy_encoder);
-    free(led_encoder);
+    rmt_del_encoder(led_encoder->simple_encoder);
+    led_mem_free(led_encoder);
     return ESP_OK;
 }
 
-static esp_err_t rmt_led_strip_encoder_reset(rmt_encoder_t *encoder)
+static esp_err_t LED_STRIP_ENCODER_FUNC_ATTR rmt_led_strip_encoder_reset(rmt_encoder_t *encoder)
 {
     rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
-    rmt_encoder_reset(led_encoder->bytes_encoder);
-    rmt_encoder_reset(led_encoder->copy_encoder);
-    led_encoder->state = RMT_ENCODING_RESET;
+    return rmt_encoder_reset(led_encoder->simple_encoder);
+}
+
+/**
+ * @brief Resolve the timing and turn it into the 0/1 bit and reset symbols
+ */
+static esp_err_t rmt_led_strip_make_codes(const led_strip_encoder_config_t *config, const led_strip_timing_t **ret_timing,
+                                          rmt_symbol_word_t *ret_bit0, rmt_symbol_word_t *ret_bit1,
+                                          rmt_symbol_word_t *ret_reset)
+{
+    const led_strip_timing_t *timing = config->timing ? config->timing : led_strip_get_timing(config->chip);
+    ESP_RETURN_ON_FALSE(timing && (timing->bytes_per_pixel == 3 || timing->bytes_per_pixel == 4), ESP_ERR_INVALID_ARG,
+                        TAG, "invalid timing profile");
+    uint32_t t0h = rmt_led_strip_ticks(config->resolution, timing->t0h_ns);
+    uint32_t t0l = rmt_led_strip_ticks(config->resolution, timing->t0l_ns);
+    uint32_t t1h = rmt_led_strip_ticks(config->resolution, timing->t1h_ns);
+    uint32_t t1l = rmt_led_strip_ticks(config->resolution, timing->t1l_ns);
+    // the reset is split over both halves of one symbol
+    uint32_t reset_ticks = rmt_led_strip_ticks(config->resolution, (uint32_t)timing->reset_us * 1000 / 2);
+    ESP_RETURN_ON_FALSE(t0h && t0l && t1h && t1l && reset_ticks, ESP_ERR_INVALID_ARG, TAG,
+                        "resolution %lu Hz too coarse for the timing", (unsigned long)config->resolution);
+    ESP_RETURN_ON_FALSE(t0h <= LED_STRIP_MAX_TICKS && t0l <= LED_STRIP_MAX_TICKS && t1h <= LED_STRIP_MAX_TICKS &&
+                        t1l <= LED_STRIP_MAX_TICKS && reset_ticks <= LED_STRIP_MAX_TICKS,
+                        ESP_ERR_INVALID_ARG, TAG, "resolution %lu Hz too fine for the timing",
+                        (unsigned long)config->resolution);
+    *ret_timing = timing;
+    *ret_bit0 = (rmt_symbol_word_t) {
+        .level0 = 1,
+        .duration0 = t0h,
+        .level1 = 0,
+        .duration1 = t0l,
+    };
+    *ret_bit1 = (rmt_symbol_word_t) {
+        .level0 = 1,
+        .duration0 = t1h,
+        .level1 = 0,
+        .duration1 = t1l,
+    };
+    *ret_reset = (rmt_symbol_word_t) {
+        .level0 = 0,
+        .duration0 = reset_ticks,
+        .level1 = 0,
+        .duration1 = reset_ticks,
+    };
     return ESP_OK;
 }
 
@@ -81,49 +219,82 @@ esp_err_t rmt_new_led_strip_encoder(const led_strip_encoder_config_t *config, rm
     esp_err_t ret = ESP_OK;
     rmt_led_strip_encoder_t *led_encoder = NULL;
     ESP_GOTO_ON_FALSE(config && ret_encoder, ESP_ERR_INVALID_ARG, err, TAG, "invalid argument");
-    led_encoder = rmt_alloc_encoder_mem(sizeof(rmt_led_strip_encoder_t));
+    const led_strip_timing_t *timing;
+    rmt_symbol_word_t bit0, bit1, reset_code;
+    ESP_GOTO_ON_ERROR(rmt_led_strip_make_codes(config, &timing, &bit0, &bit1, &reset_code), err, TAG, "invalid config");
+    // internal RAM like rmt_alloc_encoder_mem(), the table is read from the refill ISR
+    led_encoder = led_mem_calloc(1, sizeof(rmt_led_strip_encoder_t), 4, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
     ESP_GOTO_ON_FALSE(led_encoder, ESP_ERR_NO_MEM, err, TAG, "no mem for led strip encoder");
     led_encoder->base.encode = rmt_encode_led_strip;
     led_encoder->base.del = rmt_del_led_strip_encoder;
     led_encoder->base.reset = rmt_led_strip_encoder_reset;
-    // different led strip might have its own timing requirements, following parameter is for WS2812
-    rmt_bytes_encoder_config_t bytes_encoder_config = {
-        .bit0 = {
-            .level0 = 1,
-            .duration0 = 0.3 * config->resolution / 1000000, // T0H=0.3us
-            .level1 = 0,
-            .duration1 = 0.9 * config->resolution / 1000000, // T0L=0.9us
-        },
-        .bit1 = {
-            .level0 = 1,
-            .duration0 = 0.9 * config->resolution / 1000000, // T1H=0.9us
-            .level1 = 0,
-            .duration1 = 0.3 * config->resolution / 1000000, // T1L=0.3us
-        },
-        .flags.msb_first = 1 // WS2812 transfer bit order: G7...G0R7...R0B7...B0
-    };
-    ESP_GOTO_ON_ERROR(rmt_new_bytes_encoder(&bytes_encoder_config, &led_encoder->bytes_encoder), err, TAG, "create bytes encoder failed");
-    rmt_copy_encoder_config_t copy_encoder_config = {};
-    ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &led_encoder->copy_encoder), err, TAG, "create copy encoder failed");
+    led_encoder->rgbw = timing->bytes_per_pixel == 4;
+    led_encoder->bit0 = bit0;
+    led_encoder->bit1 = bit1;
+    led_encoder->reset_code = reset_code;
+    rmt_led_strip_build_symbols(led_encoder, config->lut);
 
-    uint32_t reset_ticks = config->resolution / 1000000 * 50 / 2; // reset code duration defaults to 50us
-    led_encoder->reset_code = (rmt_symbol_word_t) {
-        .level0 = 0,
-        .duration0 = reset_ticks,
-        .level1 = 0,
-        .duration1 = reset_ticks,
+    rmt_simple_encoder_config_t simple_encoder_config = {
+        .callback = rmt_encode_led_strip_cb,
+        .arg = led_encoder,
+        // one byte is the smallest unit we emit, a whole pixel with white extraction
+        .min_chunk_size = LED_STRIP_SYMBOLS_PER_BYTE * (led_encoder->rgbw ? 4 : 1),
     };
+    ESP_GOTO_ON_ERROR(rmt_new_simple_encoder(&simple_encoder_config, &led_encoder->simple_encoder), err, TAG, "create simple encoder failed");
     *ret_encoder = &led_encoder->base;
     return ESP_OK;
 err:
     if (led_encoder) {
-        if (led_encoder->bytes_encoder) {
-            rmt_del_encoder(led_encoder->bytes_encoder);
+        led_mem_free(led_encoder);
+    }
+    return ret;
+}
+
+static void led_strip_encode_byte(rmt_symbol_word_t *symbols, uint8_t value, rmt_symbol_word_t bit0, rmt_symbol_word_t bit1)
+{
+    for (int bit = 0; bit < LED_STRIP_SYMBOLS_PER_BYTE; bit++) {
+        symbols[bit] = (value & (0x80 >> bit)) ? bit1 : bit0;
+    }
+}
+
+esp_err_t led_strip_encode_symbols(const led_strip_encoder_config_t *config, const uint8_t *pixels, size_t pixel_count,
+                                   rmt_symbol_word_t *symbols, size_t *ret_symbol_count)
+{
+    ESP_RETURN_ON_FALSE(config && pixels && symbols && ret_symbol_count, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    const led_strip_timing_t *timing;
+    rmt_symbol_word_t bit0, bit1, reset_code;
+    ESP_RETURN_ON_ERROR(rmt_led_strip_make_codes(config, &timing, &bit0, &bit1, &reset_code), TAG, "invalid config");
+    const uint8_t *lut = config->lut;
+    rmt_symbol_word_t *out = symbols;
+    for (size_t i = 0; i < pixel_count; i++, pixels += 3) {
+        uint8_t w = 0;
+        if (timing->bytes_per_pixel == 4) {
+            w = pixels[0] < pixels[1] ? pixels[0] : pixels[1];
+            w = w < pixels[2] ? w : pixels[2];
         }
-        if (led_encoder->copy_encoder) {
-            rmt_del_encoder(led_encoder->copy_encoder);
+        for (int c = 0; c < timing->bytes_per_pixel; c++, out += LED_STRIP_SYMBOLS_PER_BYTE) {
+            uint8_t value = c < 3 ? pixels[c] - w : w;
+            led_strip_encode_byte(out, lut ? lut[value] : value, bit0, bit1);
         }
-        free(led_encoder);
     }
-    return ret;
+    *out++ = reset_code;
+    *ret_symbol_count = out - symbols;
+    return ESP_OK;
+}
+
+esp_err_t rmt_led_strip_encoder_set_lut(rmt_encoder_handle_t encoder, const uint8_t *lut)
+{
+    ESP_RETURN_ON_FALSE(encoder, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
+    rmt_led_strip_build_symbols(led_encoder, lut);
+    return ESP_OK;
+}
+
+esp_err_t rmt_led_strip_encoder_get_stats(rmt_encoder_handle_t encoder, uint32_t *ret_cycles, uint32_t *ret_calls)
+{
+    ESP_RETURN_ON_FALSE(encoder && ret_cycles && ret_calls, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
+    *ret_cycles = led_encoder->cycles;
+    *ret_calls = led_encoder->calls;
+    return ESP_OK;
 }
@@ -5,6 +5,7 @@
  */
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 #include "driver/rmt_encoder.h"
 
@@ -12,16 +13,63 @@
 extern "C" {
 #endif
 
+/**
+ * @brief LED chips with a built-in timing profile
+ */
+typedef enum {
+    LED_STRIP_CHIP_WS2812 = 0,  /*!< Original WS2812 timing, safe for most clones: 1.2 us bits, 50 us reset */
+    LED_STRIP_CHIP_WS2812B,     /*!< WS2812B V5 and later: 0.9/1.2 us bits, 280 us reset */
+    LED_STRIP_CHIP_WS2811,      /*!< WS2811 in 800 kHz mode */
+    LED_STRIP_CHIP_SK6812,      /*!< SK6812 RGB: 1.1 us bits, 80 us reset */
+    LED_STRIP_CHIP_SK6812_RGBW, /*!< SK6812 RGBW, SK6812 timing with a fourth (white) byte per pixel */
+    LED_STRIP_CHIP_MAX,
+} led_strip_chip_t;
+
+/**
+ * @brief Bit timing of one LED chip
+ *
+ * Every value is the shortest the chip reliably accepts, plus a little
+ * margin, so a frame takes as little wire time as the chip allows.
+ */
+typedef struct {
+    uint16_t t0h_ns;            /*!< High time of a 0 bit */
+    uint16_t t0l_ns;            /*!< Low time of a 0 bit */
+    uint16_t t1h_ns;            /*!< High time of a 1 bit */
+    uint16_t t1l_ns;            /*!< Low time of a 1 bit */
+    uint16_t reset_us;          /*!< Low time that latches the frame */
+    uint8_t bytes_per_pixel;    /*!< 3 for GRB, 4 for GRBW. Framebuffers stay GRB, white is extracted while encoding */
+} led_strip_timing_t;
+
 /**
  * @brief Type of led strip encoder configuration
  */
 typedef struct {
     uint32_t resolution; /*!< Encoder resolution, in Hz */
+    const uint8_t *lut;  /*!< 256-entry table applied to every byte as it is encoded (gamma, brightness), NULL for none */
+    led_strip_chip_t chip; /*!< Chip to take the timing from */
+    const led_strip_timing_t *timing; /*!< Custom timing used instead of the chip's, NULL for none */
 } led_strip_encoder_config_t;
 
+/**
+ * @brief Symbols led_strip_encode_symbols() writes for a frame, reset code included
+ */
+#define LED_STRIP_FRAME_SYMBOLS(pixel_count, bytes_per_pixel) ((pixel_count) * (bytes_per_pixel) * 8 + 1)
+
+/**
+ * @brief Built-in timing profile of a chip, NULL if chip is out of range
+ */
+const led_strip_timing_t *led_strip_get_timing(led_strip_chip_t chip);
+
 /**
  * @brief Create RMT encoder for encoding LED strip pixels into RMT symbols
  *
+ * Symbols for all 256 byte values are precomputed from the resolution when
+ * the encoder is created (8 KB), so the refill ISR only copies table rows.
+ *
+ * The input is always GRB, 3 bytes per pixel. With a 4-byte profile each
+ * pixel goes out as G-W, R-W, B-W, W where W = min(G, R, B), so greys are
+ * shown on the white die.
+ *
  * @param[in] config Encoder configuration
  * @param[out] ret_encoder Returned encoder handle
  * @return
@@ -31,6 +79,53 @@ typedef struct {
  */
 esp_err_t rmt_new_led_strip_encoder(const led_strip_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder);
 
+/**
+ * @brief Expand a whole frame into RMT symbols ahead of time, for a copy encoder
+ *
+ * Produces exactly what the strip encoder would send for the same config:
+ * 8 symbols per byte MSB first, white extracted for 4-byte profiles, the
+ * reset code at the end. No table is built, so this is the quick way to
+ * get a few pixels lit without the 8 KB encoder.
+ *
+ * @param[in] config Encoder configuration, lut may be NULL
+ * @param[in] pixels pixel_count * 3 bytes, GRB
+ * @param[in] pixel_count Number of pixels
+ * @param[out] symbols Room for LED_STRIP_FRAME_SYMBOLS(pixel_count, bytes_per_pixel) symbols
+ * @param[out] ret_symbol_count Symbols written
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_OK if symbols holds the frame
+ */
+esp_err_t led_strip_encode_symbols(const led_strip_encoder_config_t *config, const uint8_t *pixels, size_t pixel_count,
+                                   rmt_symbol_word_t *symbols, size_t *ret_symbol_count);
+
+/**
+ * @brief Load a new byte LUT, every byte value v is sent as lut[v] from then on
+ *
+ * The LUT is folded into the symbol table, so the encoder does no extra
+ * work per byte. Rebuilding the table takes a moment and must not race a
+ * transmission using this encoder.
+ *
+ * @param[in] encoder Encoder created by rmt_new_led_strip_encoder()
+ * @param[in] lut 256 entries, copied, NULL restores the identity
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_OK if the table was rebuilt
+ */
+esp_err_t rmt_led_strip_encoder_set_lut(rmt_encoder_handle_t encoder, const uint8_t *lut);
+
+/**
+ * @brief Running totals of the time spent expanding bytes into symbols
+ *
+ * Both counters only ever grow (and wrap), take differences between two
+ * reads to get the cost of what was sent in between.
+ *
+ * @param[in] encoder Encoder created by rmt_new_led_strip_encoder()
+ * @param[out] ret_cycles CPU cycles spent in the refill callback
+ * @param[out] ret_calls Number of refills
+ */
+esp_err_t rmt_led_strip_encoder_get_stats(rmt_encoder_handle_t encoder, uint32_t *ret_cycles, uint32_t *ret_calls);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,152 @@
+/**
+ * @file led_symbol_cache.c
+ * @brief Slot lookup, admission and eviction
+ */
+
+#include <string.h>
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "led_framebuffer.h"
+#include "led_mem.h"
+#include "led_symbol_cache.h"
+
+static const char *TAG = "led_symcache";
+
+esp_err_t led_symbol_cache_init(led_symbol_cache_t *cache, const led_symbol_cache_config_t *config)
+{
+    ESP_RETURN_ON_FALSE(cache && config && config->segment_count && config->segment_count <= LED_SYMBOL_CACHE_MAX_SEGMENTS,
+                        ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    const led_strip_timing_t *timing = config->encoder.timing ? config->encoder.timing :
+                                       led_strip_get_timing(config->encoder.chip);
+    ESP_RETURN_ON_FALSE(timing, ESP_ERR_INVALID_ARG, TAG, "invalid chip");
+    memset(cache, 0, sizeof(*cache));
+    cache->encoder = config->encoder;
+    cache->encoder.lut = NULL;
+    cache->segment_count = config->segment_count;
+    for (size_t i = 0; i < config->segment_count; i++) {
+        cache->segment_pixels[i] = config->segment_pixels[i];
+        cache->segment_offset[i] = cache->frame_symbols;
+        cache->segment_symbols[i] = LED_STRIP_FRAME_SYMBOLS(config->segment_pixels[i], timing->bytes_per_pixel);
+        cache->frame_symbols += cache->segment_symbols[i];
+        cache->frame_bytes += config->segment_pixels[i] * LED_FRAMEBUFFER_BYTES_PER_PIXEL;
+    }
+    size_t slot_bytes = cache->frame_symbols * sizeof(rmt_symbol_word_t) + cache->frame_bytes +
+                        sizeof(led_symbol_cache_slot_t);
+    cache->slot_count = config->budget_bytes / slot_bytes;
+    ESP_RETURN_ON_FALSE(cache->slot_count, ESP_ERR_INVALID_ARG, TAG, "%u bytes don't hold one %u-byte frame",
+                        (unsigned)config->budget_bytes, (unsigned)slot_bytes);
+
+    // internal RAM, the copy encoder reads the symbols from the refill ISR
+    cache->slots = led_mem_calloc(cache->slot_count, sizeof(led_symbol_cache_slot_t), 4, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    cache->pixels = led_mem_calloc(cache->slot_count, cache->frame_bytes, 4, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    cache->symbols = led_mem_calloc(cache->slot_count * cache->frame_symbols, sizeof(rmt_symbol_word_t), 4,
+                                    MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!cache->slots || !cache->pixels || !cache->symbols) {
+        led_symbol_cache_deinit(cache);
+        ESP_LOGE(TAG, "no mem for %u frames", (unsigned)cache->slot_count);
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "%u frames of %u symbols", (unsigned)cache->slot_count, (unsigned)cache->frame_symbols);
+    return ESP_OK;
+}
+
+void led_symbol_cache_deinit(led_symbol_cache_t *cache)
+{
+    if (!cache) {
+        return;
+    }
+    led_mem_free(cache->slots);
+    led_mem_free(cache->pixels);
+    led_mem_free(cache->symbols);
+    memset(cache, 0, sizeof(*cache));
+}
+
+void led_symbol_cache_set_lut(led_symbol_cache_t *cache, const uint8_t *lut)
+{
+    if (lut) {
+        memcpy(cache->lut, lut, sizeof(cache->lut));
+    }
+    cache->encoder.lut = lut ? cache->lut : NULL;
+    // the slot on the wire keeps its symbols, it just won't be found again
+    for (size_t i = 0; i < cache->slot_count; i++) {
+        cache->slots[i].valid = false;
+    }
+    cache->ghost_count = 0;
+}
+
+/**
+ * @brief Whether crc missed recently, and remember it if not
+ */
+static bool led_symbol_cache_seen(led_symbol_cache_t *cache, uint32_t crc)
+{
+    for (size_t i = 0; i < cache->ghost_count; i++) {
+        if (cache->ghosts[i] == crc) {
+            return true;
+        }
+    }
+    cache->ghosts[cache->ghost_next] = crc;
+    cache->ghost_next = (cache->ghost_next + 1) % LED_SYMBOL_CACHE_GHOSTS;
+    if (cache->ghost_count < LED_SYMBOL_CACHE_GHOSTS) {
+        cache->ghost_count++;
+    }
+    return false;
+}
+
+/**
+ * @brief Slot to encode a new frame into: a free one, else the least recently used, never the one on the wire
+ */
+static int led_symbol_cache_victim(const led_symbol_cache_t *cache)
+{
+    int victim = -1;
+    for (size_t i = 0; i < cache->slot_count; i++) {
+        if (cache->symbols + i * cache->frame_symbols == cache->on_wire) {
+            continue;
+        }
+        if (!cache->slots[i].valid) {
+            return (int)i;
+        }
+        // clock differences, so wrapping doesn't matter
+        if (victim < 0 || cache->clock - cache->slots[i].last_used > cache->clock - cache->slots[victim].last_used) {
+            victim = (int)i;
+        }
+    }
+    return victim;
+}
+
+const rmt_symbol_word_t *led_symbol_cache_get(led_symbol_cache_t *cache, const uint8_t *pixels, uint32_t crc)
+{
+    cache->clock++;
+    for (size_t i = 0; i < cache->slot_count; i++) {
+        led_symbol_cache_slot_t *slot = &cache->slots[i];
+        if (slot->valid && slot->crc == crc && !memcmp(cache->pixels + i * cache->frame_bytes, pixels, cache->frame_bytes)) {
+            slot->last_used = cache->clock;
+            cache->hits++;
+            return cache->symbols + i * cache->frame_symbols;
+        }
+    }
+    if (!led_symbol_cache_seen(cache, crc)) {
+        return NULL;
+    }
+    int victim = led_symbol_cache_victim(cache);
+    if (victim < 0) {
+        return NULL;
+    }
+    led_symbol_cache_slot_t *slot = &cache->slots[victim];
+    rmt_symbol_word_t *symbols = cache->symbols + victim * cache->frame_symbols;
+    const uint8_t *segment_pixels = pixels;
+    for (size_t i = 0; i < cache->segment_count; i++) {
+        size_t written;
+        if (led_strip_encode_symbols(&cache->encoder, segment_pixels, cache->segment_pixels[i],
+                                     symbols + cache->segment_offset[i], &written) != ESP_OK) {
+            slot->valid = false;
+            return NULL;
+        }
+        segment_pixels += cache->segment_pixels[i] * LED_FRAMEBUFFER_BYTES_PER_PIXEL;
+    }
+    memcpy(cache->pixels + victim * cache->frame_bytes, pixels, cache->frame_bytes);
+    slot->valid = true;
+    slot->crc = crc;
+    slot->last_used = cache->clock;
+    cache->inserts++;
+    return symbols;
+}
@@ -0,0 +1,140 @@
+/**
+ * @file led_symbol_cache.h
+ * @brief Fully encoded frames, sent with the RMT copy encoder
+ *
+ * A looping effect or scene sends the same few frames over and over, and
+ * every time the strip encoder's refill ISR expands them bit by bit. The
+ * cache keeps the finished rmt_symbol_word_t stream of such frames (each
+ * output's slice plus its reset code) in a fixed block of memory sized by
+ * a budget. A frame found there goes out through a copy encoder, the
+ * refills are then plain copies and the CPU time they free can go to more
+ * channels.
+ *
+ * Frames are looked up by the CRC32 the controller works out anyway and
+ * compared byte for byte, so a collision can't show the wrong frame. Only
+ * a frame seen twice within the last LED_SYMBOL_CACHE_GHOSTS misses gets
+ * a slot, a stream of one-off frames (a moving rainbow) passes through
+ * without evicting a loop. When full, the least recently sent slot goes,
+ * never the one on the wire.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/rmt_types.h"
+#include "led_strip_encoder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LED_SYMBOL_CACHE_MAX_SEGMENTS 8  /*!< Outputs one frame can be split into */
+#define LED_SYMBOL_CACHE_GHOSTS       32 /*!< Recent misses remembered for admission */
+
+/**
+ * @brief Cache configuration
+ */
+typedef struct {
+    size_t budget_bytes;        /*!< Memory for the slots (symbols and a copy of the pixels), at least one frame */
+    led_strip_encoder_config_t encoder; /*!< Resolution and timing of the outputs, lut is ignored (see set_lut) */
+    size_t segment_count;       /*!< Outputs, each frame is encoded as this many separate streams */
+    size_t segment_pixels[LED_SYMBOL_CACHE_MAX_SEGMENTS]; /*!< Pixels per output, in framebuffer order */
+} led_symbol_cache_config_t;
+
+/**
+ * @brief Bookkeeping of one slot
+ */
+typedef struct {
+    bool valid;                 /*!< Slot holds a frame */
+    uint32_t crc;               /*!< CRC32 of its pixels */
+    uint32_t last_used;         /*!< Cache clock when it was last returned */
+} led_symbol_cache_slot_t;
+
+/**
+ * @brief Cache state
+ */
+typedef struct {
+    led_strip_encoder_config_t encoder; /*!< Copy of the config, lut points at lut below or is NULL */
+    uint8_t lut[256];           /*!< Output correction folded into the cached symbols */
+    size_t segment_count;       /*!< Streams per frame */
+    size_t segment_pixels[LED_SYMBOL_CACHE_MAX_SEGMENTS]; /*!< Pixels per stream */
+    size_t segment_offset[LED_SYMBOL_CACHE_MAX_SEGMENTS]; /*!< Where each stream starts in a slot's symbols */
+    size_t segment_symbols[LED_SYMBOL_CACHE_MAX_SEGMENTS]; /*!< Symbols per stream, reset code included */
+    size_t frame_bytes;         /*!< Pixel bytes per frame */
+    size_t frame_symbols;       /*!< Symbols per frame over all streams */
+    size_t slot_count;          /*!< Frames the budget holds */
+    led_symbol_cache_slot_t *slots; /*!< slot_count entries */
+    uint8_t *pixels;            /*!< slot_count * frame_bytes, to verify hits */
+    rmt_symbol_word_t *symbols; /*!< slot_count * frame_symbols, read by the RMT copy encoder */
+    const rmt_symbol_word_t *on_wire; /*!< Slot being sent, never evicted, NULL if the last frame wasn't cached */
+    uint32_t clock;             /*!< Lookup counter, for LRU */
+    uint32_t ghosts[LED_SYMBOL_CACHE_GHOSTS]; /*!< CRCs of recent misses */
+    size_t ghost_count;         /*!< Valid entries in ghosts */
+    size_t ghost_next;          /*!< Entry the next miss overwrites */
+    uint32_t hits;              /*!< Lookups that found the frame */
+    uint32_t inserts;           /*!< Frames encoded into a slot */
+} led_symbol_cache_t;
+
+/**
+ * @brief Allocate the slots, empty
+ *
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments, or a budget too small for one frame
+ *      - ESP_ERR_NO_MEM out of memory
+ *      - ESP_OK if the cache is ready
+ */
+esp_err_t led_symbol_cache_init(led_symbol_cache_t *cache, const led_symbol_cache_config_t *config);
+
+/**
+ * @brief Free the slots, nothing may be sending from them anymore
+ */
+void led_symbol_cache_deinit(led_symbol_cache_t *cache);
+
+/**
+ * @brief Change the output correction, empties the cache
+ *
+ * Must not run while led_symbol_cache_get() does or cached symbols are on the wire.
+ *
+ * @param[in] lut 256 entries, copied, NULL for none
+ */
+void led_symbol_cache_set_lut(led_symbol_cache_t *cache, const uint8_t *lut);
+
+/**
+ * @brief Encoded symbols of a frame, if it is cached or should be from now on
+ *
+ * A miss for a frame seen recently encodes it into a slot right here,
+ * in the caller's task, so it is sent from the cache straight away too.
+ * Not thread safe: the caller serializes it with led_symbol_cache_set_lut(),
+ * the slot on the wire (led_symbol_cache_sending()) is never reused.
+ *
+ * @param[in] cache Cache
+ * @param[in] pixels Whole frame, frame_bytes
+ * @param[in] crc esp_rom_crc32_le(0, pixels, frame_bytes)
+ * @return Symbols of every stream back to back (see led_symbol_cache_segment()), NULL to use the strip encoder
+ */
+const rmt_symbol_word_t *led_symbol_cache_get(led_symbol_cache_t *cache, const uint8_t *pixels, uint32_t crc);
+
+/**
+ * @brief Tell the cache which symbols are being sent now, NULL for none
+ */
+static inline void led_symbol_cache_sending(led_symbol_cache_t *cache, const rmt_symbol_word_t *symbols)
+{
+    cache->on_wire = symbols;
+}
+
+/**
+ * @brief One output's stream within symbols from led_symbol_cache_get()
+ */
+static inline const rmt_symbol_word_t *led_symbol_cache_segment(const led_symbol_cache_t *cache,
+                                                                const rmt_symbol_word_t *symbols, size_t index,
+                                                                size_t *ret_symbol_count)
+{
+    *ret_symbol_count = cache->segment_symbols[index];
+    return symbols + cache->segment_offset[index];
+}
+
+#ifdef __cplusplus
+}
+#endif
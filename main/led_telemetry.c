@@ -0,0 +1,121 @@
+/**
+ * @file led_telemetry.c
+ * @brief SPSC record ring and the task that prints it
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "led_telemetry.h"
+#include "led_mem.h"
+
+static const char *TAG = "led_telemetry";
+
+#define LED_TELEMETRY_TASK_STACK 3072
+#define LED_TELEMETRY_LINE_MAX   160
+
+typedef struct {
+    led_telemetry_record_t *records;
+    size_t mask;                // capacity - 1
+    atomic_size_t head;         // next slot to write, only the producer stores it
+    atomic_size_t tail;         // next slot to read, only the telemetry task stores it
+    atomic_uint dropped;        // pushes that found the ring full
+    led_telemetry_config_t config;
+    TaskHandle_t task;
+} led_telemetry_t;
+
+static led_telemetry_t s_telemetry;
+
+bool led_telemetry_push(const char *tag, const char *fmt, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    led_telemetry_t *t = &s_telemetry;
+    if (!t->records) {
+        return false;
+    }
+    size_t head = atomic_load_explicit(&t->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&t->tail, memory_order_acquire);
+    if (head - tail > t->mask) {
+        atomic_fetch_add_explicit(&t->dropped, 1, memory_order_relaxed);
+        return false;
+    }
+    led_telemetry_record_t *record = &t->records[head & t->mask];
+    record->tag = tag;
+    record->fmt = fmt;
+    record->args[0] = a0;
+    record->args[1] = a1;
+    record->args[2] = a2;
+    record->args[3] = a3;
+    // publish the record only after it is complete
+    atomic_store_explicit(&t->head, head + 1, memory_order_release);
+    return true;
+}
+
+static bool led_telemetry_pop(led_telemetry_t *t, led_telemetry_record_t *record)
+{
+    size_t tail = atomic_load_explicit(&t->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&t->head, memory_order_acquire);
+    if (tail == head) {
+        return false;
+    }
+    *record = t->records[tail & t->mask];
+    atomic_store_explicit(&t->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+static void led_telemetry_task(void *arg)
+{
+    led_telemetry_t *t = (led_telemetry_t *)arg;
+    uint32_t budget_per_period = t->config.max_lines_per_sec * t->config.period_ms / 1000;
+    if (!budget_per_period) {
+        budget_per_period = 1;
+    }
+    char line[LED_TELEMETRY_LINE_MAX];
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(t->config.period_ms));
+        uint32_t printed = 0;
+        uint32_t suppressed = 0;
+        led_telemetry_record_t record;
+        while (led_telemetry_pop(t, &record)) {
+            if (printed == budget_per_period) {
+                suppressed++;
+                continue;
+            }
+            snprintf(line, sizeof(line), record.fmt, record.args[0], record.args[1], record.args[2], record.args[3]);
+            ESP_LOGI(record.tag, "%s", line);
+            printed++;
+        }
+        uint32_t dropped = atomic_exchange_explicit(&t->dropped, 0, memory_order_relaxed);
+        if (suppressed || dropped) {
+            ESP_LOGW(TAG, "%lu lines over the rate limit, %lu lost to a full ring", (unsigned long)suppressed,
+                     (unsigned long)dropped);
+        }
+    }
+}
+
+esp_err_t led_telemetry_init(const led_telemetry_config_t *config)
+{
+    led_telemetry_t *t = &s_telemetry;
+    ESP_RETURN_ON_FALSE(config && config->capacity && !(config->capacity & (config->capacity - 1)) && config->period_ms,
+                        ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(!t->task, ESP_ERR_INVALID_STATE, TAG, "telemetry already running");
+    led_telemetry_record_t *records = led_mem_calloc(config->capacity, sizeof(led_telemetry_record_t), 4,
+                                                     MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    ESP_RETURN_ON_FALSE(records, ESP_ERR_NO_MEM, TAG, "no mem for %u records", (unsigned)config->capacity);
+    t->config = *config;
+    t->mask = config->capacity - 1;
+    atomic_store(&t->head, 0);
+    atomic_store(&t->tail, 0);
+    atomic_store(&t->dropped, 0);
+    if (xTaskCreate(led_telemetry_task, "led_telemetry", LED_TELEMETRY_TASK_STACK, t, config->task_priority, &t->task) != pdPASS) {
+        led_mem_free(records);
+        t->task = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    // records last: push only starts using the ring once everything else is set up
+    atomic_thread_fence(memory_order_release);
+    t->records = records;
+    return ESP_OK;
+}
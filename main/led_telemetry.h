@@ -0,0 +1,76 @@
+/**
+ * @file led_telemetry.h
+ * @brief Deferred debug output for the render path
+ *
+ * Formatting and printing a log line over a 115200 baud UART takes
+ * milliseconds, far too long for a frame loop. led_telemetry_push() only
+ * copies a fixed-size binary record into a lock-free single-producer ring;
+ * a low-priority task drains the ring, formats the records and logs them,
+ * dropping the excess above a configurable line rate.
+ *
+ * The ring has one producer: push from a single task (the render task).
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LED_TELEMETRY_MAX_ARGS 4
+
+/**
+ * @brief One pending log line, the format is applied later by the telemetry task
+ */
+typedef struct {
+    const char *tag;            /*!< Log tag, must point to static storage */
+    const char *fmt;            /*!< printf format, must point to static storage and take LED_TELEMETRY_MAX_ARGS uint32_t */
+    uint32_t args[LED_TELEMETRY_MAX_ARGS]; /*!< Format arguments, unused ones are ignored */
+} led_telemetry_record_t;
+
+/**
+ * @brief Telemetry configuration
+ */
+typedef struct {
+    size_t capacity;            /*!< Ring size in records, power of two */
+    uint32_t period_ms;         /*!< How often the task drains the ring */
+    uint32_t max_lines_per_sec; /*!< Lines printed per second at most, the rest are counted and discarded */
+    uint32_t task_priority;     /*!< Telemetry task priority, keep it below the render task */
+} led_telemetry_config_t;
+
+#define LED_TELEMETRY_DEFAULT_CONFIG() { \
+    .capacity = 64,                      \
+    .period_ms = 100,                    \
+    .max_lines_per_sec = 20,             \
+    .task_priority = 1,                  \
+}
+
+/**
+ * @brief Allocate the ring and start the telemetry task
+ *
+ * @param[in] config Telemetry configuration
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_INVALID_STATE already running
+ *      - ESP_ERR_NO_MEM out of memory
+ *      - ESP_OK if the task is running
+ */
+esp_err_t led_telemetry_init(const led_telemetry_config_t *config);
+
+/**
+ * @brief Queue a log line without formatting it
+ *
+ * A handful of stores and no locks. Before led_telemetry_init() or with
+ * the ring full, the record is dropped and counted.
+ *
+ * @return true if the record was queued
+ */
+bool led_telemetry_push(const char *tag, const char *fmt, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+
+#ifdef __cplusplus
+}
+#endif
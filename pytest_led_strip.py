@@ -1,20 +1,65 @@
 # SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
 # SPDX-License-Identifier: CC0-1.0
 
+import json
+
 import pytest
 from pytest_embedded import Dut
 
 
-@pytest.mark.esp32
-@pytest.mark.esp32s2
 @pytest.mark.esp32s3
-@pytest.mark.esp32c3
-@pytest.mark.esp32c6
-@pytest.mark.esp32h2
-@pytest.mark.esp32p4
 @pytest.mark.generic
 def test_led_strip_example(dut: Dut) -> None:
-    dut.expect_exact('example: Create RMT TX channel')
-    dut.expect_exact('example: Install led strip encoder')
-    dut.expect_exact('example: Enable RMT TX channel')
-    dut.expect_exact('example: Start LED rainbow chase')
+    dut.expect_exact('NeoPixel: Starting Rainbow Demo')
+    dut.expect_exact('led_ctrl: RMT TX on GPIO 48')
+    # first periodic stats report, STATS_REPORT_MS after startup
+    dut.expect(r'led_ctrl: [\d.]+ fps \| frames \d+', timeout=10)
+
+
+@pytest.mark.esp32s3
+@pytest.mark.generic
+@pytest.mark.parametrize('config', ['bench'], indirect=True)
+def test_led_bench(dut: Dut) -> None:
+    results = []
+    while True:
+        match = dut.expect(r'BENCH(_DONE| (\{.*\}))\r?\n', timeout=60)
+        if match.group(1) == b'_DONE':
+            break
+        results.append(json.loads(match.group(2).decode()))
+
+    for result in results:
+        print('BENCH ' + json.dumps(result))
+    names = {result['name'] for result in results}
+    assert {'hsv_to_grb', 'hsv_span_to_grb', 'frame'} <= names
+    frames = [result for result in results if result['name'] == 'frame']
+    assert {frame['pixels'] for frame in frames} == {1, 60, 300, 1000}
+    # the S3 has a DMA-capable TX channel, every length has to come up on it too
+    channels = [result for result in results if result['name'] == 'dma_channel']
+    assert {channel['pixels'] for channel in channels if channel['ok']} == {1, 60, 300, 1000}, channels
+    assert {frame['pixels'] for frame in frames if frame['dma']} == {1, 60, 300, 1000}
+    for frame in frames:
+        # the frame can't go out faster than the wire allows
+        assert frame['tx_min_us'] >= frame['wire_us'] * 0.9, frame
+
+
+@pytest.mark.esp32s3
+@pytest.mark.generic
+@pytest.mark.parametrize('config', ['fastboot'], indirect=True)
+def test_led_fast_boot(dut: Dut) -> None:
+    match = dut.expect(r'NeoPixel: Boot to first frame: (\d+) us')
+    boot_us = int(match.group(1))
+    print(f'Boot to first frame: {boot_us} us')
+    # ROM, bootloader and app startup; the full pipeline's first frame comes well after this
+    assert 0 < boot_us < 1000000
+    dut.expect_exact('led_ctrl: RMT TX on GPIO 48')
+
+
+@pytest.mark.esp32s3
+@pytest.mark.generic
+@pytest.mark.parametrize('config', ['powersave'], indirect=True)
+def test_led_power_save(dut: Dut) -> None:
+    dut.expect(r'NeoPixel: Power save: \d+-\d+ MHz')
+    dut.expect_exact('led_ctrl: RMT TX on GPIO 48')
+    # frames keep coming with DFS and light sleep in between
+    match = dut.expect(r'led_ctrl: ([\d.]+) fps \| frames (\d+)', timeout=10)
+    assert int(match.group(2)) > 0
@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+"""Pack raw frame dumps into a scene partition image for main/led_scene.c.
+
+Each input is a file of back-to-back frames, PIXELS * 3 bytes each, in the
+color order given by --order (RGB by default, which is what most design
+tools export). Frames are stored in GRB wire order, every frame as raw,
+run-length or delta to the previous frame, whichever is smallest (unless
+--encoding forces one).
+
+    tools/led_scene_pack.py --pixels 300 --fps 50 intro=intro.rgb idle=idle.rgb -o scenes.bin
+    parttool.py write_partition --partition-name scenes --input scenes.bin
+
+The layout is documented in main/led_scene.h.
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+MAGIC = 0x4E43534C  # "LSCN"
+VERSION = 1
+NAME_LEN = 16
+PARTITION_SIZE = 0xF0000  # partitions.csv
+
+HEADER = struct.Struct('<IHHII')
+ENTRY = struct.Struct('<16sIIIHH')
+FRAME = struct.Struct('<IIB3x')
+
+RAW, RLE, DELTA = 0, 1, 2
+ENCODINGS = {'raw': RAW, 'rle': RLE, 'delta': DELTA}
+
+
+def to_grb(frame: bytes, order: str) -> bytes:
+    index = [order.index(c) for c in 'GRB']
+    out = bytearray(len(frame))
+    for i in range(0, len(frame), 3):
+        out[i:i + 3] = bytes(frame[i + j] for j in index)
+    return bytes(out)
+
+
+def encode_rle(frame: bytes) -> bytes:
+    out = bytearray()
+    i = 0
+    while i < len(frame):
+        pixel = frame[i:i + 3]
+        count = 1
+        while count < 255 and frame[i + count * 3:i + count * 3 + 3] == pixel:
+            count += 1
+        out += bytes([count]) + pixel
+        i += count * 3
+    return bytes(out)
+
+
+def encode_delta(frame: bytes, previous: bytes) -> bytes:
+    out = bytearray()
+    pixels = len(frame) // 3
+    pos = 0  # first pixel the next patch can start at
+    i = 0
+    while i < pixels:
+        if frame[i * 3:i * 3 + 3] == previous[i * 3:i * 3 + 3]:
+            i += 1
+            continue
+        start = i
+        # a gap of one unchanged pixel costs less to copy than a new patch header
+        while i < pixels and i - start < 0xFFFF and (frame[i * 3:i * 3 + 3] != previous[i * 3:i * 3 + 3] or
+                                                     frame[i * 3 + 3:i * 3 + 6] != previous[i * 3 + 3:i * 3 + 6]):
+            i += 1
+        while start - pos > 0xFFFF:
+            out += struct.pack('<HH', 0xFFFF, 0)
+            pos += 0xFFFF
+        out += struct.pack('<HH', start - pos, i - start) + frame[start * 3:i * 3]
+        pos = i
+    return bytes(out)
+
+
+def encode_frame(frame: bytes, previous: bytes, forced: int) -> tuple:
+    candidates = [(RAW, frame)]
+    if forced in (None, RLE):
+        candidates.append((RLE, encode_rle(frame)))
+    if previous is not None and forced in (None, DELTA):
+        candidates.append((DELTA, encode_delta(frame, previous)))
+    if forced is not None:
+        # deltas need a previous frame, the first one falls back to raw
+        candidates = [c for c in candidates if c[0] == forced] or candidates[:1]
+    # ties go to raw, it's played from flash without a copy
+    return min(candidates, key=lambda c: len(c[1]))
+
+
+def align(data: bytearray) -> None:
+    data += bytes(-len(data) % 4)
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('scenes', nargs='+', metavar='NAME=FILE', help='scene name (up to 16 bytes) and its frame dump')
+    parser.add_argument('--pixels', type=int, required=True, help='strip length the frames were made for')
+    parser.add_argument('--fps', type=int, default=50, help='playback rate, 1-1000 (default 50)')
+    parser.add_argument('--order', default='RGB', help='channel order of the input files (default RGB)')
+    parser.add_argument('--encoding', choices=['auto'] + list(ENCODINGS), default='auto',
+                        help='frame encoding, auto picks the smallest per frame')
+    parser.add_argument('--size', type=lambda v: int(v, 0), default=PARTITION_SIZE, help='partition size to check against')
+    parser.add_argument('-o', '--output', required=True, help='partition image to write')
+    args = parser.parse_args()
+
+    order = args.order.upper()
+    if sorted(order) != sorted('GRB') or not 1 <= args.fps <= 1000 or args.pixels <= 0:
+        parser.error('bad --order, --fps or --pixels')
+    forced = None if args.encoding == 'auto' else ENCODINGS[args.encoding]
+    frame_size = args.pixels * 3
+
+    scenes = []
+    for spec in args.scenes:
+        name, sep, path = spec.partition('=')
+        if not sep or not name or len(name.encode()) > NAME_LEN:
+            parser.error(f'bad scene {spec!r}, expected NAME=FILE with a name of up to {NAME_LEN} bytes')
+        with open(path, 'rb') as f:
+            data = f.read()
+        if not data or len(data) % frame_size:
+            parser.error(f'{path}: {len(data)} bytes is not a whole number of {frame_size}-byte frames')
+        frames = [to_grb(data[i:i + frame_size], order) for i in range(0, len(data), frame_size)]
+        scenes.append((name.encode(), frames))
+
+    image = bytearray(HEADER.size + ENTRY.size * len(scenes))
+    entries = []
+    for name, frames in scenes:
+        align(image)
+        table_offset = len(image)
+        image += bytes(FRAME.size * len(frames))
+        table = []
+        previous = None
+        counts = [0, 0, 0]
+        for frame in frames:
+            encoding, payload = encode_frame(frame, previous, forced)
+            align(image)
+            table.append(FRAME.pack(len(image), len(payload), encoding))
+            image += payload
+            counts[encoding] += 1
+            previous = frame
+        image[table_offset:table_offset + FRAME.size * len(frames)] = b''.join(table)
+        entries.append(ENTRY.pack(name, table_offset, args.pixels, len(frames), args.fps, 0))
+        print(f'{name.decode()}: {len(frames)} frames, {counts[RAW]} raw, {counts[RLE]} rle, {counts[DELTA]} delta')
+
+    image[HEADER.size:HEADER.size + ENTRY.size * len(scenes)] = b''.join(entries)
+    crc = zlib.crc32(image[HEADER.size:]) & 0xFFFFFFFF
+    image[:HEADER.size] = HEADER.pack(MAGIC, VERSION, len(scenes), len(image), crc)
+    if len(image) > args.size:
+        print(f'{len(image)} bytes don\'t fit the {args.size}-byte partition', file=sys.stderr)
+        return 1
+    with open(args.output, 'wb') as f:
+        f.write(image)
+    print(f'{args.output}: {len(image)} of {args.size} bytes')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())